@@ -0,0 +1,113 @@
+#include <stdlib.h>
+
+#include "Arena.h"
+
+/* Alignment of every slot (enough for pointers, longs and doubles) */
+#define ARENA_ALIGN sizeof(void*)
+
+
+/* Create an arena whose slots have (at least) slotSize bytes
+ *
+ * return: the created arena or NULL
+ */
+Arena* createArena(size_t slotSize) {
+	if (slotSize == 0)
+		return NULL;
+	Arena *arena = (Arena *)malloc(sizeof(Arena));
+	if (arena == NULL)
+		return NULL;
+
+	// A free slot must be able to hold the link of the free list
+	if (slotSize < sizeof(void*))
+		slotSize = sizeof(void*);
+	arena->slotSize = (slotSize + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	arena->blocks = NULL;
+	arena->cursor = arena->limit = NULL;
+	arena->freeList = NULL;
+	arena->used = 0;
+	return arena;
+}
+
+
+/* Allocate a new block, twice as large as the previous one
+ *
+ * return: 1 - on success, 0 - otherwise
+ */
+static int arenaGrow(Arena *arena) {
+	size_t slots = ARENA_MIN_BLOCK_SLOTS;
+	if (arena->blocks != NULL && arena->blocks->slots < ARENA_MAX_BLOCK_SLOTS)
+		slots = arena->blocks->slots * 2;
+	else if (arena->blocks != NULL)
+		slots = ARENA_MAX_BLOCK_SLOTS;
+
+	// The header is padded so that the first slot stays aligned
+	size_t header = (sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	ArenaBlock *block = (ArenaBlock *)malloc(header + slots * arena->slotSize);
+	if (block == NULL)
+		return 0;
+	block->slots = slots;
+	block->next = arena->blocks;
+	arena->blocks = block;
+	arena->cursor = (char *)block + header;
+	arena->limit = arena->cursor + slots * arena->slotSize;
+	return 1;
+}
+
+
+/* Hand out a slot, reusing a released one if there is any
+ */
+void* arenaAlloc(Arena *arena) {
+	if (arena == NULL)
+		return NULL;
+	void *slot = arena->freeList;
+	if (slot != NULL) {
+		arena->freeList = *(void **)slot;
+	} else {
+		if (arena->cursor == arena->limit && !arenaGrow(arena))
+			return NULL;
+		slot = arena->cursor;
+		arena->cursor += arena->slotSize;
+	}
+	arena->used++;
+	return slot;
+}
+
+
+/* Give a slot back to the arena
+ * (its memory is kept for the next allocation)
+ */
+void arenaFree(Arena *arena, void *slot) {
+	if (arena == NULL || slot == NULL)
+		return;
+	*(void **)slot = arena->freeList;
+	arena->freeList = slot;
+	arena->used--;
+}
+
+
+/* Number of bytes requested from malloc by the arena
+ */
+size_t arenaBytes(Arena *arena) {
+	size_t bytes = 0;
+	if (arena == NULL)
+		return 0;
+	for (ArenaBlock *block = arena->blocks; block != NULL; block = block->next)
+		bytes += sizeof(ArenaBlock) + block->slots * arena->slotSize;
+	return bytes;
+}
+
+
+/* Release every block of the arena at once
+ * (all the slots handed out become invalid)
+ */
+void destroyArena(Arena *arena) {
+	if (arena == NULL)
+		return;
+	ArenaBlock *block = arena->blocks;
+	while (block != NULL) {
+		ArenaBlock *temp = block;
+		block = block->next;
+		free(temp);
+	}
+	free(arena);
+}
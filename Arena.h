@@ -0,0 +1,40 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdlib.h>
+
+/* Number of slots in the first block of an arena
+ * (every new block doubles it, up to ARENA_MAX_BLOCK_SLOTS)
+ */
+#define ARENA_MIN_BLOCK_SLOTS 64
+#define ARENA_MAX_BLOCK_SLOTS 65536
+
+/*
+ * Header of a block of memory owned by an arena
+ * (the slots follow right after it)
+ */
+typedef struct ArenaBlock{
+	struct ArenaBlock *next;	// previously allocated block
+	size_t slots;				// number of slots in this block
+}ArenaBlock;
+
+/*
+ * Slab allocator handing out fixed-size slots carved out of large blocks
+ */
+typedef struct Arena{
+	size_t slotSize;		// size of a slot (multiple of the alignment)
+	ArenaBlock *blocks;		// list of allocated blocks, newest first
+	char *cursor;			// first never used slot in the newest block
+	char *limit;			// end of the newest block
+	void *freeList;			// released slots, linked through their first word
+	long used;				// number of slots currently handed out
+}Arena;
+
+
+Arena* createArena(size_t slotSize);
+void* arenaAlloc(Arena *arena);
+void arenaFree(Arena *arena, void *slot);
+size_t arenaBytes(Arena *arena);
+void destroyArena(Arena *arena);
+
+#endif /* ARENA_H_ */
@@ -9,9 +9,17 @@ void* createStrElement(void* str);
 
 void destroyStrElement(void* elem);
 
-void* createIndexInfo(void* index);
 
-void destroyIndexInfo(void* index);
+/* Allocate (or grow) the values of a key from old to capacity values,
+ * counting only the bytes added to the Range buffers of getTreeStats
+ */
+static int* resizeIndex(int* index, long old, long capacity) {
+	int *values = realloc(index, capacity * sizeof(int));
+	if (values != NULL)
+		TREE_COUNT(rangeBytes, (capacity - old) * sizeof(int));
+	return values;
+}
+
 
 /* Build a multi-dictionary based on a text file
  * The key (element) of a node will be represented by a word from the text
@@ -40,13 +48,16 @@ void buildTreeFromFile(char* fileName, TTree* tree) {
 	while (fgets(buffer, BUFLEN, file)) {
 		char *token = strtok(buffer, " ,.?!\n");
 		while (token) {
-			char *element = (char *)createStrElement(token);
-			int *info = createIndexInfo(&idx);
-			insert(tree, element, info);
+			if (tree->keyLength != 0) {
+				// Packed keys are truncated by the tree itself
+				insert(tree, token, &idx);
+			} else {
+				char *element = (char *)createStrElement(token);
+				insert(tree, element, &idx);
+				destroyStrElement(element);
+			}
 			idx += strlen(token);
 			token = strtok(NULL, " ,.?!\n\r");
-			destroyStrElement(element);
-			destroyIndexInfo(info);
 		}
 	}
 	fclose(file);
@@ -95,92 +106,108 @@ void printKey(char *fileName, Range *key) {
  * of duplicates)
  */
 Range* inorderKeyQuery(TTree* tree) {
-	if (tree == NULL || tree->root == NULL)
+	if (tree == NULL || isEmpty(tree))
 		return NULL;
 	Range *key_query = malloc(sizeof(Range));
 	key_query->capacity = tree->size;
-	key_query->index = malloc(key_query->capacity * sizeof(int));
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
 	key_query->size = 0;
-	TreeNode *min_node = minimum(tree->root);
+	TreeCursor cursor = cursorAt(tree, minimum(tree->root));
 	for (int i = 0; i < key_query->capacity; i++) {
 		key_query->size++;
-		key_query->index[i] = *(int*)min_node->info;
-		min_node = min_node->next;
+		key_query->index[i] = *(int*)cursorInfo(&cursor);
+		cursorNext(&cursor);
 	}
 	return key_query;
 }
 
 
+/* Returns at most length values of the in-order key, starting with
+ * the entry number offset (the full key is exported page by page)
+ */
+Range* inorderKeyPage(TTree* tree, long offset, long length) {
+	if (tree == NULL || isEmpty(tree) || offset < 0 || length < 0)
+		return NULL;
+	Range *key_query = malloc(sizeof(Range));
+	if (offset + length > tree->size)
+		length = offset < tree->size ? tree->size - offset : 0;
+	key_query->capacity = length;
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	key_query->size = 0;
+	TreeCursor cursor = selectEntry(tree, offset);
+	for (int i = 0; i < key_query->capacity; i++) {
+		key_query->size++;
+		key_query->index[i] = *(int*)cursorInfo(&cursor);
+		cursorNext(&cursor);
+	}
+	return key_query;
+}
+
+
+/* Append the values of a node and of its duplicates to a key
+ *
+ * return: 1 - on success, 0 - if the key could not grow
+ */
+static int appendDuplicates(TTree *tree, Range *key_query, TreeNode *x) {
+	long count = countOf(tree, x);
+	if (key_query->size + count > key_query->capacity) {
+		int capacity = key_query->capacity;
+		while (key_query->size + count > capacity)
+			capacity *= 2;
+		int *index = resizeIndex(key_query->index, key_query->capacity, capacity);
+		if (index == NULL)
+			return 0;
+		key_query->index = index;
+		key_query->capacity = capacity;
+	}
+	TreeCursor cursor = cursorAt(tree, x);
+	for (long i = 0; i < count; i++, cursorNext(&cursor)) {
+		key_query->index[key_query->size] = *(int*)cursorInfo(&cursor);
+		key_query->size++;
+	}
+	return 1;
+}
+
+
+/* Append, in order, the values of the nodes found on the given level
+ * of a subtree (only the levels above it are visited)
+ */
+static int appendLevel(TTree *tree, Range *key_query, TreeNode *x, int level) {
+	if (x == NULL)
+		return 1;
+	if (level == 1)
+		return appendDuplicates(tree, key_query, x);
+	return appendLevel(tree, key_query, x->left, level - 1) &&
+		   appendLevel(tree, key_query, x->right, level - 1);
+}
+
+
 /* Function for extracting the key formed from the values
  * nodes from the level containing the most frequent word
  * (if there are more words with a maximum number
  * of occurrences then the first node among them will be considered compliant
  * traversing the tree out of order)
+ *
+ * The most frequent word is kept up to date by an augmented tree (and
+ * found in one pass of the list otherwise), so only its level and the
+ * levels above it are visited
  */
 Range* levelKeyQuery(TTree* tree) {
-	if (tree == NULL || tree->root == NULL)
+	if (tree == NULL || isEmpty(tree))
 		return NULL;
-	Range *key_query = malloc(sizeof(Range));
-	key_query->size = 0;
-	key_query->capacity = tree->size;
-	key_query->index = malloc(key_query->capacity * sizeof(int));
-	TreeNode *y = minimum(tree->root);
-	TreeNode *max_freq = NULL, *curr = y, *curr_n = y;
-	int max = 0, nr_duplicates = 1;
-	while (curr_n) {
-		if (tree->compare(curr->elem, curr_n->elem) == 0) {
-			nr_duplicates++;
-		} else {
-			if (nr_duplicates > max) {
-				max = nr_duplicates;
-				max_freq = curr;
-			}
-			nr_duplicates = 1;
-			curr = curr_n;
-		}
-		curr_n = curr_n->next;
-	}
-	if (nr_duplicates > max) {
-			max = nr_duplicates;
-			max_freq = curr;
-	}
+	TreeNode *max_freq = mostFrequent(tree);
 	int level_max_freq = 0;
-	TreeNode *temp_freq = max_freq;
-	while (temp_freq) {
+	for (TreeNode *temp_freq = max_freq; temp_freq; temp_freq = temp_freq->parent)
 		level_max_freq++;
-		temp_freq = temp_freq->parent;
-	}
-	
-	y = minimum(tree->root);
-	TreeNode *temp_y = y;
-	int level_y = 0;
-	while(y) {
-		temp_y = y;
-		level_y = 0;
-		while (temp_y != NULL) {
-			level_y++;
-			temp_y = temp_y->parent;
-		}
-		if (level_max_freq == level_y) {
-			while (y->next && tree->compare(y->elem, y->next->elem) == 0) {
-				if (key_query->capacity == key_query->size) {
-					key_query->index = realloc(key_query->index, 2 * sizeof(int) * key_query->capacity);
-					
-					if (key_query->index)
-						key_query->capacity = key_query->capacity * 2;
-					else
-						return NULL;
-					}
-				key_query->index[key_query->size] = *(int*)y->info;
-				key_query->size++;
-				y = y->next;
-			}
-			key_query->index[key_query->size] = *(int*)y->info;
-			key_query->size++;
-			y = y->next;
-		} else {
-			y = y->end->next;
-		}
+
+	Range *key_query = malloc(sizeof(Range));
+	key_query->size = 0;
+	key_query->capacity = countOf(tree, max_freq);
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	if (!appendLevel(tree, key_query, tree->root, level_max_freq)) {
+		free(key_query->index);
+		free(key_query);
+		return NULL;
 	}
 	return key_query;
 }
@@ -189,33 +216,236 @@ Range* levelKeyQuery(TTree* tree) {
 
 /* Extract the key from the nodes located in a certain
  * specified range of values
+ *
+ * Only the matching entries are visited: the first one is found with
+ * upperBound and their number is known from countRange
  */
 Range* rangeKeyQuery(TTree* tree, char* q, char* p) {
-	if (tree == NULL || tree->root == NULL)
+	if (tree == NULL || isEmpty(tree))
 		return NULL;
 	Range *key_query = malloc(sizeof(Range));
 	key_query->size = 0;
-	key_query->capacity = tree->size;
-	key_query->index = malloc(sizeof(int) * key_query->capacity);
-	TreeNode *y = minimum(tree->root);
-	while (y) {
-		if (tree->compare(y->elem, q) == 1 && tree->compare(y->elem, p) == -1) {
-			if (key_query->capacity == key_query->size) {
-				key_query->index = realloc(key_query->index, 2 * sizeof(int) * key_query->capacity);
-				if (key_query->index)
-					key_query->capacity = key_query->capacity * 2;
-				else
-					return NULL;
-			}
-		key_query->index[key_query->size] = *(int*)y->info;
+	key_query->capacity = countRange(tree, q, p);
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	TreeCursor cursor = upperBound(tree, q);
+	while (key_query->size < key_query->capacity) {
+		key_query->index[key_query->size] = *(int*)cursorInfo(&cursor);
 		key_query->size++;
-		}
-		y = y->next;
+		cursorNext(&cursor);
+	}
+	return key_query;
+}
+
+
+/* Append the value of a snapshot entry to a key (doubling its capacity)
+ */
+static void appendIndex(VNode *x, void *arg) {
+	Range *key_query = (Range *)arg;
+	if (key_query->size == key_query->capacity) {
+		int *index = resizeIndex(key_query->index, key_query->capacity, 2 * key_query->capacity);
+		if (index == NULL)
+			return;
+		key_query->index = index;
+		key_query->capacity *= 2;
+	}
+	key_query->index[key_query->size] = *(int*)x->info;
+	key_query->size++;
+}
+
+
+static Range* snapshotKey(VSnapshot* snapshot, char* q, char* p) {
+	if (snapshot == NULL || snapshot->version == NULL || snapshotSize(snapshot) == 0)
+		return NULL;
+	Range *key_query = malloc(sizeof(Range));
+	key_query->size = 0;
+	key_query->capacity = 16;
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	snapshotForEach(snapshot, q, p, appendIndex, key_query);
+	return key_query;
+}
+
+
+/* The same keys as inorderKeyQuery and rangeKeyQuery, read from a
+ * snapshot (the tree can keep changing meanwhile)
+ */
+Range* snapshotInorderKey(VSnapshot* snapshot) {
+	return snapshotKey(snapshot, NULL, NULL);
+}
+
+Range* snapshotRangeKey(VSnapshot* snapshot, char* q, char* p) {
+	return snapshotKey(snapshot, q, p);
+}
+
+
+/* Key being stitched from the shards of a sharded tree */
+typedef struct ShardQuery{
+	Range *key_query;
+	char *q, *p;		// the range (NULL - the whole shard)
+}ShardQuery;
+
+
+/* Append the entries of a shard to the key, straight from its tree
+ */
+static void appendShard(TTree* shard, void* arg) {
+	ShardQuery *query = (ShardQuery *)arg;
+	Range *key_query = query->key_query;
+	if (shard->root == NULL)
+		return;
+	long count = query->q != NULL ? countRange(shard, query->q, query->p) : shard->size;
+	if (key_query->size + count > key_query->capacity) {
+		int *index = resizeIndex(key_query->index, key_query->capacity, key_query->size + count);
+		if (index == NULL)
+			return;
+		key_query->index = index;
+		key_query->capacity = key_query->size + count;
+	}
+	TreeCursor cursor = query->q != NULL ? upperBound(shard, query->q)
+										 : cursorAt(shard, minimum(shard->root));
+	for (long i = 0; i < count; i++) {
+		key_query->index[key_query->size] = *(int*)cursorInfo(&cursor);
+		key_query->size++;
+		cursorNext(&cursor);
+	}
+}
+
+
+static Range* shardedKey(STree* tree, char* q, char* p) {
+	if (tree == NULL)
+		return NULL;
+	ShardQuery query = {malloc(sizeof(Range)), q, p};
+	query.key_query->size = 0;
+	query.key_query->capacity = 0;
+	query.key_query->index = NULL;
+	shardedForEach(tree, q, p, appendShard, &query);
+	if (query.key_query->size == 0 && q == NULL) {
+		// empty tree, like inorderKeyQuery
+		free(query.key_query->index);
+		free(query.key_query);
+		return NULL;
 	}
+	return query.key_query;
+}
+
+
+/* The same keys as inorderKeyQuery and rangeKeyQuery, stitched from the
+ * shards in key order (every shard is read under its own lock)
+ */
+Range* shardedInorderKey(STree* tree) {
+	return shardedKey(tree, NULL, NULL);
+}
+
+Range* shardedRangeKey(STree* tree, char* q, char* p) {
+	return shardedKey(tree, q, p);
+}
+
+
+/* Copy the entries first ... last - 1 of a frozen tree into a key
+ * (a single slice of its info column)
+ */
+static Range* frozenKey(FTree* tree, long first, long last) {
+	if (tree == NULL || tree->size == 0 || tree->infoSize != sizeof(int))
+		return NULL;
+	Range *key_query = malloc(sizeof(Range));
+	key_query->size = last > first ? last - first : 0;
+	key_query->capacity = key_query->size;
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	if (key_query->size > 0)
+		memcpy(key_query->index, frozenInfo(tree, first), sizeof(int) * key_query->size);
 	return key_query;
 }
 
 
+/* The same keys as inorderKeyQuery and rangeKeyQuery, from a frozen
+ * tree (its infos have to be the int offsets)
+ */
+Range* frozenInorderKey(FTree* tree) {
+	return frozenKey(tree, 0, tree != NULL ? tree->size : 0);
+}
+
+Range* frozenRangeKey(FTree* tree, char* q, char* p) {
+	if (tree == NULL)
+		return NULL;
+	return frozenKey(tree, frozenUpperBound(tree, q), frozenLowerBound(tree, p));
+}
+
+
+/* Copy the entries first ... last - 1 of a mapped snapshot into a key
+ * (a single slice of its infos section)
+ */
+static Range* mappedKey(MTree* tree, long first, long last) {
+	if (tree == NULL || tree->header->size == 0 || tree->header->infoSize != sizeof(int))
+		return NULL;
+	Range *key_query = malloc(sizeof(Range));
+	key_query->size = last > first ? last - first : 0;
+	key_query->capacity = key_query->size;
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	if (key_query->size > 0)
+		memcpy(key_query->index, mappedInfo(tree, first), sizeof(int) * key_query->size);
+	return key_query;
+}
+
+
+/* Append, in order, the entries of the saved nodes found on the given
+ * level of a subtree
+ */
+static void appendMappedLevel(MTree *tree, Range *key_query, long x, int level) {
+	if (x == -1)
+		return;
+	if (level > 1) {
+		appendMappedLevel(tree, key_query, tree->nodes[x].left, level - 1);
+		appendMappedLevel(tree, key_query, tree->nodes[x].right, level - 1);
+		return;
+	}
+	long count = mappedCount(tree, x);
+	if (key_query->size + count > key_query->capacity) {
+		int capacity = key_query->capacity;
+		while (key_query->size + count > capacity)
+			capacity *= 2;
+		int *index = resizeIndex(key_query->index, key_query->capacity, capacity);
+		if (index == NULL)
+			return;
+		key_query->index = index;
+		key_query->capacity = capacity;
+	}
+	memcpy(key_query->index + key_query->size, mappedInfo(tree, tree->nodes[x].start),
+		   sizeof(int) * count);
+	key_query->size += count;
+}
+
+
+/* The same keys as inorderKeyQuery, levelKeyQuery and rangeKeyQuery,
+ * read from a mapped snapshot of the tree (its infos have to be the
+ * int offsets)
+ */
+Range* mappedInorderKey(MTree* tree) {
+	return mappedKey(tree, 0, tree != NULL ? tree->header->size : 0);
+}
+
+Range* mappedLevelKey(MTree* tree) {
+	if (tree == NULL || tree->header->size == 0 || tree->header->infoSize != sizeof(int))
+		return NULL;
+	// the nodes are numbered in key order: the path to the most frequent
+	// key is found by comparing indices
+	long max_freq = tree->header->maxNode;
+	int level_max_freq = 1;
+	for (long x = tree->header->root; x != max_freq; level_max_freq++)
+		x = max_freq < x ? tree->nodes[x].left : tree->nodes[x].right;
+
+	Range *key_query = malloc(sizeof(Range));
+	key_query->size = 0;
+	key_query->capacity = mappedCount(tree, max_freq);
+	key_query->index = resizeIndex(NULL, 0, key_query->capacity);
+	appendMappedLevel(tree, key_query, tree->header->root, level_max_freq);
+	return key_query;
+}
+
+Range* mappedRangeKey(MTree* tree, char* q, char* p) {
+	if (tree == NULL)
+		return NULL;
+	return mappedKey(tree, mappedUpperBound(tree, q), mappedLowerBound(tree, p));
+}
+
+
 void encrypt(char *inputFile, char *outputFile, Range *key) {
 
 	FILE * f_in  = fopen(inputFile,  "r");
@@ -231,7 +461,8 @@ void encrypt(char *inputFile, char *outputFile, Range *key) {
 
 	while (fgets(buff, BUFLEN, f_in) != NULL) {
 
-		for (int i = 0; i < strlen(buff); i++) {
+		size_t length = strlen(buff);
+		for (size_t i = 0; i < length; i++) {
 			if (buff[i] != ' ' && buff[i] != '\n' && buff[i] != '\r') {
 				c = ((toupper(buff[i]) - 'A') + key->index[idx] % 26) % 26 + 'A';
 				idx += 1;
@@ -266,7 +497,8 @@ void decrypt(char *inputFile, char *outputFile, Range *key) {
 
 	while (fgets(buff, BUFLEN, f_in) != NULL) {
 
-		for (int i = 0; i < strlen(buff); i++) {
+		size_t length = strlen(buff);
+		for (size_t i = 0; i < length; i++) {
 			if (buff[i] != ' ' && buff[i] != '\n' && buff[i] != '\r') {
 				c = ((toupper(buff[i]) - 'A') - (key->index[idx] % 26) + 26) % 26 + 'A';
 				idx += 1;
@@ -2,6 +2,10 @@
 #define CIPHER_H_
 
 #include "TreeMap.h"
+#include "VersionedTree.h"
+#include "ShardedTree.h"
+#include "FrozenTree.h"
+#include "MappedTree.h"
 
 /* Maximum length of teh buffer */
 #define BUFLEN 1024
@@ -26,8 +30,18 @@ void decrypt(char *inputFile, char *outputFile, Range *key);
 
 void printKey(char *fileName, Range *key);
 Range* inorderKeyQuery(TTree* tree);
+Range* inorderKeyPage(TTree* tree, long offset, long length);
 Range* levelKeyQuery(TTree* tree);
 Range* rangeKeyQuery(TTree* tree, char* q, char* p);
+Range* snapshotInorderKey(VSnapshot* snapshot);
+Range* snapshotRangeKey(VSnapshot* snapshot, char* q, char* p);
+Range* shardedInorderKey(STree* tree);
+Range* shardedRangeKey(STree* tree, char* q, char* p);
+Range* frozenInorderKey(FTree* tree);
+Range* frozenRangeKey(FTree* tree, char* q, char* p);
+Range* mappedInorderKey(MTree* tree);
+Range* mappedLevelKey(MTree* tree);
+Range* mappedRangeKey(MTree* tree, char* q, char* p);
 
 
 #endif /* CIPHER_H_ */
\ No newline at end of file
@@ -0,0 +1,982 @@
+#include <sched.h>
+#include <stdlib.h>
+
+#include "ConcurrentTree.h"
+
+#define MAX(a, b) (((a) >= (b))?(a):(b))
+
+/* Values of a node version */
+#define UNLINKED 1ul			// the node left the tree (exact value)
+#define SHRINKING 2ul			// a rotation is moving nodes out of the subtree
+#define SHRINK_INCR 4ul			// counts the finished rotations
+
+/* Spins before waiting for a rotation on the lock of the node */
+#define SPIN_COUNT 100
+
+/* Retired objects that make a writer try to free them */
+#define RECLAIM_BATCH 64
+
+/* Results of nodeCondition (a positive value is the new height) */
+#define UNLINK_REQUIRED -1
+#define REBALANCE_REQUIRED -2
+#define NOTHING_REQUIRED -3
+
+/* Results of the attempts */
+#define DONE 0
+#define RETRY 1
+
+/* Returned by attemptSearch when the search has to restart higher */
+static char retryToken;
+#define RETRY_INFO ((void*)&retryToken)
+
+
+static CNode* childOf(CNode* x, int dir) {
+	return dir < 0 ? atomic_load(&x->left) : atomic_load(&x->right);
+}
+
+static void setChild(CNode* x, int dir, CNode* child) {
+	if (dir < 0)
+		atomic_store(&x->left, child);
+	else
+		atomic_store(&x->right, child);
+}
+
+static unsigned long versionOf(CNode* x) {
+	return atomic_load(&x->version);
+}
+
+static long heightOf(CNode* x) {
+	return x == NULL ? 0 : atomic_load(&x->height);
+}
+
+static int isRouting(CNode* x) {
+	return atomic_load(&x->first) == NULL;
+}
+
+
+static void initNode(CNode* x, void* elem, CNode* parent) {
+	x->elem = elem;
+	atomic_init(&x->first, NULL);
+	x->last = NULL;
+	atomic_init(&x->parent, parent);
+	atomic_init(&x->left, NULL);
+	atomic_init(&x->right, NULL);
+	atomic_init(&x->height, 1);
+	atomic_init(&x->version, 0);
+	pthread_mutex_init(&x->lock, NULL);
+}
+
+
+static void destroyNode(CTree* tree, CNode* x) {
+	CEntry *entry = atomic_load(&x->first);
+	while (entry != NULL) {
+		CEntry *temp = entry;
+		entry = atomic_load(&entry->next);
+		tree->destroyInfo(temp->info);
+		free(temp);
+	}
+	tree->destroyElement(x->elem);
+	pthread_mutex_destroy(&x->lock);
+	free(x);
+}
+
+
+/* Create an empty tree with a series of associated methods
+ *
+ * return: the created tree or NULL
+ */
+CTree* createCTree(void* (*createElement)(void*),
+				   void (*destroyElement)(void*),
+				   void* (*createInfo)(void*),
+				   void (*destroyInfo)(void*),
+				   int compare(void*, void*)) {
+	CTree *tree = (CTree *)malloc(sizeof(CTree));
+	if (tree == NULL)
+		return NULL;
+	tree->createElement = createElement;
+	tree->destroyElement = destroyElement;
+	tree->createInfo = createInfo;
+	tree->destroyInfo = destroyInfo;
+	tree->compare = compare;
+	initNode(&tree->holder, NULL, NULL);
+	atomic_init(&tree->size, 0);
+	atomic_init(&tree->epoch, 1);
+	for (int i = 0; i < CTREE_READERS; i++)
+		atomic_init(&tree->readers[i], 0);
+	atomic_init(&tree->retired, NULL);
+	atomic_init(&tree->pending, 0);
+	pthread_mutex_init(&tree->reclaimer, NULL);
+	return tree;
+}
+
+
+/* Announce an operation, like snapshotOpen() on a VTree: the epoch is
+ * announced before the tree is read, so nothing the operation can reach
+ * is freed before it leaves. With every slot taken it waits for one
+ *
+ * return: the reader slot of the operation
+ */
+static int enter(CTree* tree) {
+	while (1) {
+		for (int i = 0; i < CTREE_READERS; i++) {
+			unsigned long free_slot = 0;
+			unsigned long epoch = atomic_load(&tree->epoch);
+			if (atomic_compare_exchange_strong(&tree->readers[i], &free_slot, epoch))
+				return i;
+		}
+		sched_yield();
+	}
+}
+
+static void leave(CTree* tree, int slot) {
+	atomic_store(&tree->readers[slot], 0);
+}
+
+
+/* Release a retired object
+ */
+static void release(CTree* tree, CRetired* item) {
+	if (item->node) {
+		destroyNode(tree, (CNode *)item->ptr);
+	} else {
+		tree->destroyInfo(((CEntry *)item->ptr)->info);
+		free(item->ptr);
+	}
+	free(item);
+}
+
+
+/* Queue a node or an occurrence already removed from the tree; the record
+ * is allocated by the caller before the removal, so it cannot fail here
+ *
+ * The epoch advances after the removal: an operation that announces the
+ * new epoch or a later one cannot reach the object
+ */
+static void retire(CTree* tree, CRetired* item, void* ptr, int node) {
+	item->ptr = ptr;
+	item->node = node;
+	item->epoch = atomic_fetch_add(&tree->epoch, 1) + 1;
+	item->next = atomic_load(&tree->retired);
+	while (!atomic_compare_exchange_weak(&tree->retired, &item->next, item))
+		;
+	atomic_fetch_add(&tree->pending, 1);
+}
+
+
+/* Free the retired objects no running operation can reach; the objects
+ * still visible to one are put back. One thread frees at a time, the
+ * others do not wait for it
+ */
+static void reclaim(CTree* tree) {
+	if (pthread_mutex_trylock(&tree->reclaimer) != 0)
+		return;
+	CRetired *item = atomic_exchange(&tree->retired, NULL);
+	unsigned long oldest = atomic_load(&tree->epoch);
+	for (int i = 0; i < CTREE_READERS; i++) {
+		unsigned long e = atomic_load(&tree->readers[i]);
+		if (e != 0 && e < oldest)
+			oldest = e;
+	}
+
+	CRetired *kept = NULL, *last = NULL;
+	long freed = 0;
+	while (item != NULL) {
+		CRetired *temp = item;
+		item = item->next;
+		if (temp->epoch <= oldest) {
+			release(tree, temp);
+			freed++;
+		} else {
+			temp->next = kept;
+			if (kept == NULL)
+				last = temp;
+			kept = temp;
+		}
+	}
+	if (kept != NULL) {
+		last->next = atomic_load(&tree->retired);
+		while (!atomic_compare_exchange_weak(&tree->retired, &last->next, kept))
+			;
+	}
+	atomic_fetch_sub(&tree->pending, freed);
+	pthread_mutex_unlock(&tree->reclaimer);
+}
+
+
+/* Wait until the rotation that is shrinking the subtree of x is over;
+ * the rotating thread holds the lock of x for the whole change
+ */
+static void waitUntilNotChanging(CNode* x) {
+	unsigned long version = versionOf(x);
+	if ((version & SHRINKING) == 0)
+		return;
+	for (int i = 0; i < SPIN_COUNT; i++)
+		if (versionOf(x) != version)
+			return;
+	pthread_mutex_lock(&x->lock);
+	pthread_mutex_unlock(&x->lock);
+}
+
+
+/* ------------------------- Relaxed rebalancing ------------------------- */
+
+/* A thread only locks a node after the lock of its parent, checking under
+ * that lock that it is still the parent, or while it holds no other lock.
+ * Two nodes only trade places in a rotation, which holds both locks, so
+ * two threads never wait for each other. ThreadSanitizer still reports a
+ * lock-order inversion: it remembers the order of two locks taken before
+ * a rotation swapped the nodes and sees the opposite order after it
+ */
+
+/* Decide what node x needs; the caller may hold no lock, the decision is
+ * checked again under the locks before acting on it
+ *
+ * return: UNLINK_REQUIRED, REBALANCE_REQUIRED, NOTHING_REQUIRED or the
+ *         height x should have
+ */
+static long nodeCondition(CNode* x) {
+	CNode *left = atomic_load(&x->left);
+	CNode *right = atomic_load(&x->right);
+
+	// a deleted key only stays as a routing node while it has two children
+	if ((left == NULL || right == NULL) && isRouting(x))
+		return UNLINK_REQUIRED;
+
+	long hL = heightOf(left);
+	long hR = heightOf(right);
+	long balance = hL - hR;
+	if (balance < -1 || balance > 1)
+		return REBALANCE_REQUIRED;
+
+	long height = 1 + MAX(hL, hR);
+	return height != heightOf(x) ? height : NOTHING_REQUIRED;
+}
+
+
+/* Repair the height of x (locked)
+ *
+ * return: the next node to repair or NULL
+ */
+static CNode* fixHeight(CNode* x) {
+	long c = nodeCondition(x);
+	if (c == REBALANCE_REQUIRED || c == UNLINK_REQUIRED)
+		return x;
+	if (c == NOTHING_REQUIRED)
+		return NULL;
+	atomic_store(&x->height, c);
+	return atomic_load(&x->parent);
+}
+
+
+/* Remove a routing node x with at most one child; parent and x are locked
+ *
+ * return: 1 if x was unlinked, 0 otherwise
+ */
+static int attemptUnlink(CNode* parent, CNode* x) {
+	CNode *pL = atomic_load(&parent->left);
+	CNode *pR = atomic_load(&parent->right);
+	if (pL != x && pR != x)
+		return 0;
+
+	CNode *left = atomic_load(&x->left);
+	CNode *right = atomic_load(&x->right);
+	if (left != NULL && right != NULL)
+		return 0;
+
+	CNode *splice = left != NULL ? left : right;
+	if (pL == x)
+		atomic_store(&parent->left, splice);
+	else
+		atomic_store(&parent->right, splice);
+	if (splice != NULL)
+		atomic_store(&splice->parent, parent);
+	atomic_store(&x->version, UNLINKED);
+	return 1;
+}
+
+
+/* Every rotation below runs with parent, x and the child that goes up
+ * locked; only x loses nodes from its subtree, so only its version is
+ * marked while the links change. They return the next node to repair
+ */
+
+static CNode* rotateRight(CNode* parent, CNode* x, CNode* xL, long hR,
+						  long hLL, CNode* xLR, long hLR) {
+	unsigned long version = versionOf(x);
+	CNode *pL = atomic_load(&parent->left);
+
+	atomic_store(&x->version, version | SHRINKING);
+
+	atomic_store(&x->left, xLR);
+	if (xLR != NULL)
+		atomic_store(&xLR->parent, x);
+	atomic_store(&xL->right, x);
+	atomic_store(&x->parent, xL);
+	if (pL == x)
+		atomic_store(&parent->left, xL);
+	else
+		atomic_store(&parent->right, xL);
+	atomic_store(&xL->parent, parent);
+
+	long hX = 1 + MAX(hLR, hR);
+	atomic_store(&x->height, hX);
+	atomic_store(&xL->height, 1 + MAX(hLL, hX));
+
+	atomic_store(&x->version, (version & ~SHRINKING) + SHRINK_INCR);
+
+	long balX = hLR - hR;
+	if (balX < -1 || balX > 1)
+		return x;
+	if ((xLR == NULL || hR == 0) && isRouting(x))
+		return x;
+	long balL = hLL - hX;
+	if (balL < -1 || balL > 1)
+		return xL;
+	if (hLL == 0 && isRouting(xL))
+		return xL;
+	return fixHeight(parent);
+}
+
+static CNode* rotateLeft(CNode* parent, CNode* x, long hL, CNode* xR,
+						 CNode* xRL, long hRL, long hRR) {
+	unsigned long version = versionOf(x);
+	CNode *pL = atomic_load(&parent->left);
+
+	atomic_store(&x->version, version | SHRINKING);
+
+	atomic_store(&x->right, xRL);
+	if (xRL != NULL)
+		atomic_store(&xRL->parent, x);
+	atomic_store(&xR->left, x);
+	atomic_store(&x->parent, xR);
+	if (pL == x)
+		atomic_store(&parent->left, xR);
+	else
+		atomic_store(&parent->right, xR);
+	atomic_store(&xR->parent, parent);
+
+	long hX = 1 + MAX(hL, hRL);
+	atomic_store(&x->height, hX);
+	atomic_store(&xR->height, 1 + MAX(hX, hRR));
+
+	atomic_store(&x->version, (version & ~SHRINKING) + SHRINK_INCR);
+
+	long balX = hRL - hL;
+	if (balX < -1 || balX > 1)
+		return x;
+	if ((xRL == NULL || hL == 0) && isRouting(x))
+		return x;
+	long balR = hRR - hX;
+	if (balR < -1 || balR > 1)
+		return xR;
+	if (hRR == 0 && isRouting(xR))
+		return xR;
+	return fixHeight(parent);
+}
+
+/* The double rotations also lock the grandchild that goes up; both x and
+ * its child lose nodes
+ */
+static CNode* rotateRightOverLeft(CNode* parent, CNode* x, CNode* xL, long hR,
+								  long hLL, CNode* xLR, long hLRL) {
+	unsigned long version = versionOf(x);
+	unsigned long versionL = versionOf(xL);
+	CNode *pL = atomic_load(&parent->left);
+	CNode *xLRL = atomic_load(&xLR->left);
+	CNode *xLRR = atomic_load(&xLR->right);
+	long hLRR = heightOf(xLRR);
+
+	atomic_store(&x->version, version | SHRINKING);
+	atomic_store(&xL->version, versionL | SHRINKING);
+
+	atomic_store(&x->left, xLRR);
+	if (xLRR != NULL)
+		atomic_store(&xLRR->parent, x);
+	atomic_store(&xL->right, xLRL);
+	if (xLRL != NULL)
+		atomic_store(&xLRL->parent, xL);
+	atomic_store(&xLR->left, xL);
+	atomic_store(&xL->parent, xLR);
+	atomic_store(&xLR->right, x);
+	atomic_store(&x->parent, xLR);
+	if (pL == x)
+		atomic_store(&parent->left, xLR);
+	else
+		atomic_store(&parent->right, xLR);
+	atomic_store(&xLR->parent, parent);
+
+	long hX = 1 + MAX(hLRR, hR);
+	atomic_store(&x->height, hX);
+	long hXL = 1 + MAX(hLL, hLRL);
+	atomic_store(&xL->height, hXL);
+	atomic_store(&xLR->height, 1 + MAX(hXL, hX));
+
+	atomic_store(&x->version, (version & ~SHRINKING) + SHRINK_INCR);
+	atomic_store(&xL->version, (versionL & ~SHRINKING) + SHRINK_INCR);
+
+	long balX = hLRR - hR;
+	if (balX < -1 || balX > 1)
+		return x;
+	if ((xLRR == NULL || hR == 0) && isRouting(x))
+		return x;
+	long balLR = hXL - hX;
+	if (balLR < -1 || balLR > 1)
+		return xLR;
+	return fixHeight(parent);
+}
+
+static CNode* rotateLeftOverRight(CNode* parent, CNode* x, long hL, CNode* xR,
+								  CNode* xRL, long hRR, long hRLR) {
+	unsigned long version = versionOf(x);
+	unsigned long versionR = versionOf(xR);
+	CNode *pL = atomic_load(&parent->left);
+	CNode *xRLL = atomic_load(&xRL->left);
+	CNode *xRLR = atomic_load(&xRL->right);
+	long hRLL = heightOf(xRLL);
+
+	atomic_store(&x->version, version | SHRINKING);
+	atomic_store(&xR->version, versionR | SHRINKING);
+
+	atomic_store(&x->right, xRLL);
+	if (xRLL != NULL)
+		atomic_store(&xRLL->parent, x);
+	atomic_store(&xR->left, xRLR);
+	if (xRLR != NULL)
+		atomic_store(&xRLR->parent, xR);
+	atomic_store(&xRL->right, xR);
+	atomic_store(&xR->parent, xRL);
+	atomic_store(&xRL->left, x);
+	atomic_store(&x->parent, xRL);
+	if (pL == x)
+		atomic_store(&parent->left, xRL);
+	else
+		atomic_store(&parent->right, xRL);
+	atomic_store(&xRL->parent, parent);
+
+	long hX = 1 + MAX(hL, hRLL);
+	atomic_store(&x->height, hX);
+	long hXR = 1 + MAX(hRLR, hRR);
+	atomic_store(&xR->height, hXR);
+	atomic_store(&xRL->height, 1 + MAX(hX, hXR));
+
+	atomic_store(&x->version, (version & ~SHRINKING) + SHRINK_INCR);
+	atomic_store(&xR->version, (versionR & ~SHRINKING) + SHRINK_INCR);
+
+	long balX = hRLL - hL;
+	if (balX < -1 || balX > 1)
+		return x;
+	if ((xRLL == NULL || hL == 0) && isRouting(x))
+		return x;
+	long balRL = hXR - hX;
+	if (balRL < -1 || balRL > 1)
+		return xRL;
+	return fixHeight(parent);
+}
+
+
+static CNode* rebalanceToLeft(CNode* parent, CNode* x, CNode* xR, long hL0);
+
+/* The left subtree of x is too high: lock its root and rotate
+ * (parent and x are locked)
+ */
+static CNode* rebalanceToRight(CNode* parent, CNode* x, CNode* xL, long hR0) {
+	CNode *next;
+	pthread_mutex_lock(&xL->lock);
+	long hL = heightOf(xL);
+	if (hL - hR0 <= 1) {
+		// changed meanwhile, look at x again
+		pthread_mutex_unlock(&xL->lock);
+		return x;
+	}
+	CNode *xLR = atomic_load(&xL->right);
+	long hLL0 = heightOf(atomic_load(&xL->left));
+	long hLR0 = heightOf(xLR);
+	if (hLL0 >= hLR0) {
+		next = rotateRight(parent, x, xL, hR0, hLL0, xLR, hLR0);
+		pthread_mutex_unlock(&xL->lock);
+		return next;
+	}
+
+	pthread_mutex_lock(&xLR->lock);
+	long hLR = heightOf(xLR);
+	if (hLL0 >= hLR) {
+		next = rotateRight(parent, x, xL, hR0, hLL0, xLR, hLR);
+		pthread_mutex_unlock(&xLR->lock);
+		pthread_mutex_unlock(&xL->lock);
+		return next;
+	}
+	long hLRL = heightOf(atomic_load(&xLR->left));
+	long balance = hLL0 - hLRL;
+	if (balance >= -1 && balance <= 1 &&
+		!((hLL0 == 0 || hLRL == 0) && isRouting(xL))) {
+		next = rotateRightOverLeft(parent, x, xL, hR0, hLL0, xLR, hLRL);
+		pthread_mutex_unlock(&xLR->lock);
+		pthread_mutex_unlock(&xL->lock);
+		return next;
+	}
+	pthread_mutex_unlock(&xLR->lock);
+
+	// the double rotation would leave xL unbalanced: fix xL first
+	next = rebalanceToLeft(x, xL, xLR, hLL0);
+	pthread_mutex_unlock(&xL->lock);
+	return next;
+}
+
+static CNode* rebalanceToLeft(CNode* parent, CNode* x, CNode* xR, long hL0) {
+	CNode *next;
+	pthread_mutex_lock(&xR->lock);
+	long hR = heightOf(xR);
+	if (hL0 - hR >= -1) {
+		pthread_mutex_unlock(&xR->lock);
+		return x;
+	}
+	CNode *xRL = atomic_load(&xR->left);
+	long hRL0 = heightOf(xRL);
+	long hRR0 = heightOf(atomic_load(&xR->right));
+	if (hRR0 >= hRL0) {
+		next = rotateLeft(parent, x, hL0, xR, xRL, hRL0, hRR0);
+		pthread_mutex_unlock(&xR->lock);
+		return next;
+	}
+
+	pthread_mutex_lock(&xRL->lock);
+	long hRL = heightOf(xRL);
+	if (hRR0 >= hRL) {
+		next = rotateLeft(parent, x, hL0, xR, xRL, hRL, hRR0);
+		pthread_mutex_unlock(&xRL->lock);
+		pthread_mutex_unlock(&xR->lock);
+		return next;
+	}
+	long hRLR = heightOf(atomic_load(&xRL->right));
+	long balance = hRR0 - hRLR;
+	if (balance >= -1 && balance <= 1 &&
+		!((hRR0 == 0 || hRLR == 0) && isRouting(xR))) {
+		next = rotateLeftOverRight(parent, x, hL0, xR, xRL, hRR0, hRLR);
+		pthread_mutex_unlock(&xRL->lock);
+		pthread_mutex_unlock(&xR->lock);
+		return next;
+	}
+	pthread_mutex_unlock(&xRL->lock);
+
+	next = rebalanceToRight(x, xR, xRL, hRR0);
+	pthread_mutex_unlock(&xR->lock);
+	return next;
+}
+
+
+/* Unlink, rotate or repair the height at x (parent and x are locked)
+ *
+ * return: the next node to repair or NULL
+ */
+static CNode* rebalance(CTree* tree, CNode* parent, CNode* x) {
+	CNode *left = atomic_load(&x->left);
+	CNode *right = atomic_load(&x->right);
+
+	if ((left == NULL || right == NULL) && isRouting(x)) {
+		CRetired *item = (CRetired *)malloc(sizeof(CRetired));
+		if (item == NULL)
+			return NULL;	// x stays a routing node, searches still work
+		if (!attemptUnlink(parent, x)) {
+			free(item);
+			return x;
+		}
+		retire(tree, item, x, 1);
+		return fixHeight(parent);
+	}
+
+	long hL0 = heightOf(left);
+	long hR0 = heightOf(right);
+	long balance = hL0 - hR0;
+	if (balance > 1)
+		return rebalanceToRight(parent, x, left, hR0);
+	if (balance < -1)
+		return rebalanceToLeft(parent, x, right, hL0);
+
+	long height = 1 + MAX(hL0, hR0);
+	if (height != heightOf(x)) {
+		atomic_store(&x->height, height);
+		return fixHeight(parent);
+	}
+	return NULL;
+}
+
+
+/* Walk up from x repairing heights, unlinking routing nodes and rotating;
+ * every step only locks the nodes it changes
+ */
+static void fixHeightAndRebalance(CTree* tree, CNode* x) {
+	while (x != NULL && atomic_load(&x->parent) != NULL) {
+		long c = nodeCondition(x);
+		if (c == NOTHING_REQUIRED || versionOf(x) == UNLINKED)
+			return;
+
+		CNode *next = x;
+		if (c != UNLINK_REQUIRED && c != REBALANCE_REQUIRED) {
+			pthread_mutex_lock(&x->lock);
+			next = fixHeight(x);
+			pthread_mutex_unlock(&x->lock);
+		} else {
+			CNode *parent = atomic_load(&x->parent);
+			pthread_mutex_lock(&parent->lock);
+			if (versionOf(parent) != UNLINKED && atomic_load(&x->parent) == parent) {
+				pthread_mutex_lock(&x->lock);
+				next = rebalance(tree, parent, x);
+				pthread_mutex_unlock(&x->lock);
+			}
+			pthread_mutex_unlock(&parent->lock);
+		}
+		x = next;
+	}
+}
+
+
+/* ------------------------------- Search -------------------------------- */
+
+/* Search below child dir of node, which had version nodeVersion when the
+ * search entered it
+ *
+ * return: the information, NULL if the key is missing or RETRY_INFO if
+ *         node changed and the search has to restart from its parent
+ */
+static void* attemptSearch(CTree* tree, void* elem, CNode* node, int dir,
+						   unsigned long nodeVersion) {
+	while (1) {
+		CNode *child = childOf(node, dir);
+		if (versionOf(node) != nodeVersion)
+			return RETRY_INFO;
+		if (child == NULL)
+			return NULL;
+
+		int next = tree->compare(elem, child->elem);
+		if (next == 0) {
+			CEntry *first = atomic_load(&child->first);
+			return first != NULL ? first->info : NULL;
+		}
+
+		unsigned long childVersion = versionOf(child);
+		if (childVersion & SHRINKING) {
+			waitUntilNotChanging(child);
+		} else if (childVersion != UNLINKED && child == childOf(node, dir)) {
+			// hand over hand: node did not change while child was read
+			if (versionOf(node) != nodeVersion)
+				return RETRY_INFO;
+			void *info = attemptSearch(tree, elem, child, next, childVersion);
+			if (info != RETRY_INFO)
+				return info;
+		}
+	}
+}
+
+
+/* Search an element without locking; the information stays valid until
+ * its occurrence is deleted
+ *
+ * return: the information of the first occurrence or NULL
+ */
+void* ctreeSearch(CTree* tree, void* elem) {
+	void *info;
+	int slot = enter(tree);
+	do {
+		info = attemptSearch(tree, elem, &tree->holder, 1, 0);
+	} while (info == RETRY_INFO);
+	leave(tree, slot);
+	return info;
+}
+
+
+/* ------------------------------- Insert -------------------------------- */
+
+typedef struct InsertContext{
+	void* elem;			// the searched element
+	CEntry* entry;		// the new occurrence
+	CNode* leaf;		// the new node, created the first time it is needed
+}InsertContext;
+
+
+/* Append an occurrence to x, reviving it if it was a routing node
+ *
+ * return: 0 or -1 if x left the tree meanwhile
+ */
+static int appendEntry(CNode* x, CEntry* entry) {
+	pthread_mutex_lock(&x->lock);
+	if (versionOf(x) == UNLINKED) {
+		pthread_mutex_unlock(&x->lock);
+		return -1;
+	}
+	entry->prev = x->last;
+	if (x->last != NULL)
+		atomic_store(&x->last->next, entry);
+	else
+		atomic_store(&x->first, entry);
+	x->last = entry;
+	pthread_mutex_unlock(&x->lock);
+	return 0;
+}
+
+static int attemptInsert(CTree* tree, InsertContext* ctx, CNode* node, int dir,
+						 unsigned long nodeVersion) {
+	while (1) {
+		CNode *child = childOf(node, dir);
+		if (versionOf(node) != nodeVersion)
+			return RETRY;
+
+		if (child == NULL) {
+			if (ctx->leaf == NULL) {
+				ctx->leaf = (CNode *)malloc(sizeof(CNode));
+				if (ctx->leaf == NULL) {
+					ctx->entry = NULL;
+					return DONE;
+				}
+				initNode(ctx->leaf, tree->createElement(ctx->elem), NULL);
+				atomic_init(&ctx->leaf->first, ctx->entry);
+				ctx->leaf->last = ctx->entry;
+			}
+			pthread_mutex_lock(&node->lock);
+			if (versionOf(node) != nodeVersion) {
+				pthread_mutex_unlock(&node->lock);
+				return RETRY;
+			}
+			if (childOf(node, dir) != NULL) {
+				// somebody else got there first
+				pthread_mutex_unlock(&node->lock);
+				continue;
+			}
+			atomic_store(&ctx->leaf->parent, node);
+			setChild(node, dir, ctx->leaf);
+			pthread_mutex_unlock(&node->lock);
+
+			ctx->leaf = NULL;
+			fixHeightAndRebalance(tree, node);
+			return DONE;
+		}
+
+		int next = tree->compare(ctx->elem, child->elem);
+		if (next == 0) {
+			if (appendEntry(child, ctx->entry) == 0)
+				return DONE;
+			continue;
+		}
+
+		unsigned long childVersion = versionOf(child);
+		if (childVersion & SHRINKING) {
+			waitUntilNotChanging(child);
+		} else if (childVersion != UNLINKED && child == childOf(node, dir)) {
+			if (versionOf(node) != nodeVersion)
+				return RETRY;
+			if (attemptInsert(tree, ctx, child, next, childVersion) == DONE)
+				return DONE;
+		}
+	}
+}
+
+
+/* Insert a new occurrence of an element; duplicates keep the insertion
+ * order, like insert() on a TTree
+ */
+void ctreeInsert(CTree* tree, void* elem, void* info) {
+	CEntry *entry = (CEntry *)malloc(sizeof(CEntry));
+	if (entry == NULL)
+		return;
+	entry->info = tree->createInfo(info);
+	atomic_init(&entry->next, NULL);
+	entry->prev = NULL;
+
+	InsertContext ctx = {elem, entry, NULL};
+	int slot = enter(tree);
+	while (attemptInsert(tree, &ctx, &tree->holder, 1, 0) != DONE)
+		;
+	leave(tree, slot);
+	if (ctx.entry == NULL) {
+		tree->destroyInfo(entry->info);
+		free(entry);
+		return;
+	}
+	if (ctx.leaf != NULL) {
+		// the key was found after a leaf had been prepared
+		tree->destroyElement(ctx.leaf->elem);
+		pthread_mutex_destroy(&ctx.leaf->lock);
+		free(ctx.leaf);
+	}
+	atomic_fetch_add(&tree->size, 1);
+	if (atomic_load(&tree->pending) >= RECLAIM_BATCH)
+		reclaim(tree);
+}
+
+
+/* ------------------------------- Delete -------------------------------- */
+
+typedef struct DeleteContext{
+	void* elem;			// the searched element
+	CRetired* entry;	// record for the removed occurrence
+	CRetired* node;		// record for the node, if it leaves the tree
+}DeleteContext;
+
+
+/* Detach the last occurrence of x (locked) */
+static void removeLastEntry(CTree* tree, DeleteContext* ctx, CNode* x) {
+	CEntry *last = x->last;
+	x->last = last->prev;
+	if (last->prev != NULL)
+		atomic_store(&last->prev->next, NULL);
+	else
+		atomic_store(&x->first, NULL);
+	retire(tree, ctx->entry, last, 0);
+	ctx->entry = NULL;
+	atomic_fetch_sub(&tree->size, 1);
+}
+
+static int attemptRemoveEntry(CTree* tree, DeleteContext* ctx, CNode* parent,
+							  CNode* x) {
+	if (isRouting(x))
+		return DONE;
+
+	if (atomic_load(&x->left) != NULL && atomic_load(&x->right) != NULL) {
+		// x stays in the tree even if it loses its last occurrence
+		pthread_mutex_lock(&x->lock);
+		if (versionOf(x) == UNLINKED || atomic_load(&x->left) == NULL ||
+			atomic_load(&x->right) == NULL) {
+			// a child left meanwhile: x may have to be unlinked
+			pthread_mutex_unlock(&x->lock);
+			return RETRY;
+		}
+		if (x->last != NULL)
+			removeLastEntry(tree, ctx, x);
+		pthread_mutex_unlock(&x->lock);
+		return DONE;
+	}
+
+	// x may have to leave the tree: lock its parent first
+	pthread_mutex_lock(&parent->lock);
+	if (versionOf(parent) == UNLINKED || atomic_load(&x->parent) != parent) {
+		pthread_mutex_unlock(&parent->lock);
+		return RETRY;
+	}
+	pthread_mutex_lock(&x->lock);
+	int unlinked = 0;
+	if (x->last != NULL) {
+		removeLastEntry(tree, ctx, x);
+		if (x->last == NULL)
+			unlinked = attemptUnlink(parent, x);
+	}
+	pthread_mutex_unlock(&x->lock);
+	pthread_mutex_unlock(&parent->lock);
+
+	if (unlinked) {
+		retire(tree, ctx->node, x, 1);
+		ctx->node = NULL;
+		fixHeightAndRebalance(tree, parent);
+	}
+	return DONE;
+}
+
+static int attemptDelete(CTree* tree, DeleteContext* ctx, CNode* node, int dir,
+						 unsigned long nodeVersion) {
+	while (1) {
+		CNode *child = childOf(node, dir);
+		if (versionOf(node) != nodeVersion)
+			return RETRY;
+		if (child == NULL)
+			return DONE;
+
+		int next = tree->compare(ctx->elem, child->elem);
+		if (next == 0) {
+			if (attemptRemoveEntry(tree, ctx, node, child) == DONE)
+				return DONE;
+			continue;
+		}
+
+		unsigned long childVersion = versionOf(child);
+		if (childVersion & SHRINKING) {
+			waitUntilNotChanging(child);
+		} else if (childVersion != UNLINKED && child == childOf(node, dir)) {
+			if (versionOf(node) != nodeVersion)
+				return RETRY;
+			if (attemptDelete(tree, ctx, child, next, childVersion) == DONE)
+				return DONE;
+		}
+	}
+}
+
+
+/* Delete the last occurrence of an element, like delete() on a TTree;
+ * a key left without occurrences becomes a routing node until the
+ * rebalancing can unlink it
+ *
+ * return: 0 - on success (or if the key is missing),
+ *		   -1 - otherwise (the tree is unchanged)
+ */
+int ctreeDelete(CTree* tree, void* elem) {
+	DeleteContext ctx = {elem, (CRetired *)malloc(sizeof(CRetired)),
+						 (CRetired *)malloc(sizeof(CRetired))};
+	if (ctx.entry == NULL || ctx.node == NULL) {
+		free(ctx.entry);
+		free(ctx.node);
+		return -1;
+	}
+	int slot = enter(tree);
+	while (attemptDelete(tree, &ctx, &tree->holder, 1, 0) != DONE)
+		;
+	leave(tree, slot);
+	free(ctx.entry);
+	free(ctx.node);
+	if (atomic_load(&tree->pending) >= RECLAIM_BATCH)
+		reclaim(tree);
+	return 0;
+}
+
+
+/* Number of occurrences in the tree (duplicates included) */
+long ctreeSize(CTree* tree) {
+	return atomic_load(&tree->size);
+}
+
+
+static long forEachNode(CNode* x, void (*visit)(void*, void*, void*), void* arg) {
+	if (x == NULL)
+		return 0;
+	long visited = forEachNode(atomic_load(&x->left), visit, arg);
+	for (CEntry *entry = atomic_load(&x->first); entry != NULL;
+		 entry = atomic_load(&entry->next)) {
+		visit(x->elem, entry->info, arg);
+		visited++;
+	}
+	return visited + forEachNode(atomic_load(&x->right), visit, arg);
+}
+
+
+/* Visit every occurrence in key order, duplicates in insertion order;
+ * it does not lock, so it is only exact when no writer is running
+ *
+ * return: number of visited occurrences
+ */
+long ctreeForEach(CTree* tree, void (*visit)(void*, void*, void*), void* arg) {
+	int slot = enter(tree);
+	long visited = forEachNode(atomic_load(&tree->holder.right), visit, arg);
+	leave(tree, slot);
+	return visited;
+}
+
+static void destroySubtree(CTree* tree, CNode* x) {
+	if (x == NULL)
+		return;
+	destroySubtree(tree, atomic_load(&x->left));
+	destroySubtree(tree, atomic_load(&x->right));
+	destroyNode(tree, x);
+}
+
+
+/* Free the tree and everything still retired from it; no other thread
+ * may use the tree any more
+ */
+void destroyCTree(CTree* tree) {
+	destroySubtree(tree, atomic_load(&tree->holder.right));
+	CRetired *item = atomic_load(&tree->retired);
+	while (item != NULL) {
+		CRetired *temp = item;
+		item = item->next;
+		release(tree, temp);
+	}
+	pthread_mutex_destroy(&tree->reclaimer);
+	pthread_mutex_destroy(&tree->holder.lock);
+	free(tree);
+}
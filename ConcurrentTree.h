@@ -0,0 +1,81 @@
+#ifndef CONCURRENTTREE_H_
+#define CONCURRENTTREE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Operations that can run on the tree at the same time */
+#define CTREE_READERS 64
+
+/*
+ * An occurrence of a key (the list of a node keeps the insertion order)
+ */
+typedef struct CEntry{
+	void* info;						// information of the occurrence
+	_Atomic(struct CEntry*) next;	// next occurrence of the key
+	struct CEntry* prev;			// previous occurrence (guarded by the lock)
+}CEntry;
+
+/*
+ * A node of the tree
+ * Readers never lock: they validate the version of every node they leave
+ * and retry if it was changed by a rotation meanwhile
+ */
+typedef struct CNode{
+	void* elem;						// element/key of the node
+	_Atomic(CEntry*) first;			// first occurrence of the key
+									// (NULL - a routing node, key deleted)
+	CEntry* last;					// last occurrence (guarded by the lock)
+	_Atomic(struct CNode*) parent;	// parent of the node
+	_Atomic(struct CNode*) left;	// left child
+	_Atomic(struct CNode*) right;	// right child
+	atomic_long height;				// the height of the node in the tree
+	atomic_ulong version;			// changed when the subtree shrinks
+	pthread_mutex_t lock;			// taken to change the node
+}CNode;
+
+/*
+ * Node or occurrence removed from the tree, freed once no running
+ * operation can still be on it
+ */
+typedef struct CRetired{
+	void* ptr;
+	int node;						// 1 - a CNode, 0 - a CEntry
+	unsigned long epoch;			// first epoch that cannot reach it
+	struct CRetired *next;
+}CRetired;
+
+/*
+ * Multi-dictionary with concurrent writers (relaxed-balance AVL tree
+ * with optimistic version validation, Bronson et al.)
+ */
+typedef struct CTree{
+	void* (*createElement)(void*);  // method for creating an element
+	void (*destroyElement)(void*);	// method for destroying an element
+	void* (*createInfo)(void*); 	// method for creating information
+	void (*destroyInfo)(void*); 	// method for deleting information
+	int (*compare)(void*, void*); 	// method for comparing two elements
+	CNode holder;					// its right child is the root
+	atomic_long size;				// number of entries (duplicates included)
+	atomic_ulong epoch;				// advanced by every removal
+	atomic_ulong readers[CTREE_READERS];	// epoch announced by every
+											// running operation (0 - free slot)
+	_Atomic(CRetired*) retired;		// removed nodes and occurrences
+	atomic_long pending;			// length of the retired list
+	pthread_mutex_t reclaimer;		// taken by the thread freeing them
+}CTree;
+
+
+CTree* createCTree(void* (*createElement)(void*),
+				   void (*destroyElement)(void*),
+				   void* (*createInfo)(void*),
+				   void (*destroyInfo)(void*),
+				   int compare(void*, void*));
+void* ctreeSearch(CTree* tree, void* elem);
+void ctreeInsert(CTree* tree, void* elem, void* info);
+int ctreeDelete(CTree* tree, void* elem);
+long ctreeSize(CTree* tree);
+long ctreeForEach(CTree* tree, void (*visit)(void*, void*, void*), void* arg);
+void destroyCTree(CTree* tree);
+
+#endif /* CONCURRENTTREE_H_ */
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "FrozenTree.h"
+
+/* Eytzinger indices looked ahead by the prefetch: FROZEN_LINE / 8 keys
+ * (or pointers) share a line, so the line fetched holds the descendants
+ * 3 levels down
+ */
+#define PREFETCH_STRIDE (FROZEN_LINE / sizeof(uint64_t))
+
+
+/* Allocate count objects on whole cache lines */
+static void* allocLines(long count, size_t size) {
+	size_t bytes = (count * size + FROZEN_LINE - 1) / FROZEN_LINE * FROZEN_LINE;
+	return aligned_alloc(FROZEN_LINE, bytes > 0 ? bytes : FROZEN_LINE);
+}
+
+
+/* Place the sorted keys in Eytzinger order: an in-order traversal of
+ * the implicit tree visits them in increasing order
+ *
+ * return: the next sorted key to place
+ */
+static long placeKeys(FTree* tree, uint64_t* sortedPacked, long k, long next) {
+	if (k > tree->keys)
+		return next;
+	next = placeKeys(tree, sortedPacked, 2 * k, next);
+	tree->eytzinger[k] = tree->elems[next];
+	if (tree->packed != NULL)
+		tree->packed[k] = sortedPacked[next];
+	tree->order[k] = next;
+	return placeKeys(tree, sortedPacked, 2 * k + 1, next + 1);
+}
+
+
+/* Build the read-only copy of a tree; the infos are copied byte by byte
+ * (infoSize bytes each), the keys are created with createElement
+ * (a tree packing its keys may have none)
+ *
+ * return: the frozen tree or NULL
+ */
+FTree* freezeTree(TTree* tree, size_t infoSize) {
+	if (tree == NULL || infoSize == 0)
+		return NULL;
+	FTree *frozen = (FTree *)calloc(1, sizeof(FTree));
+	if (frozen == NULL)
+		return NULL;
+	frozen->createElement = tree->createElement;
+	frozen->destroyElement = tree->destroyElement;
+	frozen->compare = tree->compare;
+	frozen->keyLength = tree->keyLength;
+	frozen->infoSize = infoSize;
+
+	// one pass of a cursor fills the columns
+	long size = tree->size;
+	frozen->elems = (void **)malloc((size + 1) * sizeof(void*));
+	frozen->start = (long *)malloc((size + 1) * sizeof(long));
+	frozen->infos = (char *)allocLines(size, infoSize);
+	uint64_t *sortedPacked = (uint64_t *)malloc((size + 1) * sizeof(uint64_t));
+	if (frozen->elems == NULL || frozen->start == NULL ||
+		frozen->infos == NULL || sortedPacked == NULL) {
+		free(sortedPacked);
+		destroyFrozenTree(frozen);
+		return NULL;
+	}
+	TreeCursor cursor = cursorAt(tree, tree->root != NULL ? minimum(tree->root) : NULL);
+	TreeNode *last = NULL;
+	for (; cursorValid(&cursor); cursorNext(&cursor)) {
+		if (last == NULL || compareNodes(tree, last, cursor.node) != 0) {
+			last = cursor.node;
+			if (tree->keyLength != 0)
+				sortedPacked[frozen->keys] = loadPackedKey((uint64_t*) last->elem);
+			frozen->start[frozen->keys] = frozen->size;
+			// packed keys may have no methods: only their bytes are kept
+			frozen->elems[frozen->keys++] = tree->createElement != NULL ?
+											tree->createElement(last->elem) : NULL;
+		}
+		memcpy(frozen->infos + frozen->size * infoSize, cursorInfo(&cursor), infoSize);
+		frozen->size++;
+	}
+	frozen->start[frozen->keys] = frozen->size;
+
+	frozen->eytzinger = (void **)allocLines(frozen->keys + 1, sizeof(void*));
+	frozen->order = (long *)malloc((frozen->keys + 1) * sizeof(long));
+	if (tree->keyLength != 0)
+		frozen->packed = (uint64_t *)allocLines(frozen->keys + 1, sizeof(uint64_t));
+	if (frozen->eytzinger == NULL || frozen->order == NULL ||
+		(tree->keyLength != 0 && frozen->packed == NULL)) {
+		free(sortedPacked);
+		destroyFrozenTree(frozen);
+		return NULL;
+	}
+	placeKeys(frozen, sortedPacked, 1, 0);
+	free(sortedPacked);
+	return frozen;
+}
+
+
+/* Go down the Eytzinger array to the first key not smaller than elem
+ * (strict: greater than elem); the comparison only chooses the next
+ * index, and the lines of the next levels are prefetched meanwhile
+ *
+ * return: its Eytzinger index or 0 if every key is smaller
+ */
+static long descend(FTree* tree, void* elem, int strict) {
+	unsigned long k = 1, n = tree->keys;
+	if (tree->packed != NULL) {
+		uint64_t key = packKey((char*) elem, tree->keyLength);
+		while (k <= n) {
+			__builtin_prefetch(tree->packed + k * PREFETCH_STRIDE);
+			uint64_t x = tree->packed[k];
+			k = 2 * k + ((x < key) | (strict & (x == key)));
+		}
+	} else {
+		while (k <= n) {
+			__builtin_prefetch(tree->eytzinger + k * PREFETCH_STRIDE);
+			int c = tree->compare(tree->eytzinger[k], elem);
+			k = 2 * k + ((c < 0) | (strict & (c == 0)));
+		}
+	}
+	// drop the right turns taken after the last left turn
+	return k >> __builtin_ffsl(~k);
+}
+
+
+/* Entry number of the first occurrence of an element (the entry of the
+ * node returned by search() on the source tree)
+ *
+ * return: the entry or -1 if the element is missing
+ */
+long frozenSearch(FTree* tree, void* elem) {
+	long k = descend(tree, elem, 0);
+	if (k == 0)
+		return -1;
+	if (tree->packed != NULL ? tree->packed[k] != packKey((char*) elem, tree->keyLength)
+							 : tree->compare(tree->eytzinger[k], elem) != 0)
+		return -1;
+	return tree->start[tree->order[k]];
+}
+
+
+/* First entry whose key is not smaller than elem (size if none) */
+long frozenLowerBound(FTree* tree, void* elem) {
+	long k = descend(tree, elem, 0);
+	return k == 0 ? tree->size : tree->start[tree->order[k]];
+}
+
+
+/* First entry whose key is greater than elem (size if none) */
+long frozenUpperBound(FTree* tree, void* elem) {
+	long k = descend(tree, elem, 1);
+	return k == 0 ? tree->size : tree->start[tree->order[k]];
+}
+
+
+/* Info of an entry (a slice of the info column) */
+void* frozenInfo(FTree* tree, long entry) {
+	if (entry < 0 || entry >= tree->size)
+		return NULL;
+	return tree->infos + entry * tree->infoSize;
+}
+
+
+void destroyFrozenTree(FTree* tree) {
+	if (tree == NULL)
+		return;
+	for (long i = 0; tree->elems != NULL && i < tree->keys; i++)
+		if (tree->elems[i] != NULL)
+			tree->destroyElement(tree->elems[i]);
+	free(tree->elems);
+	free(tree->start);
+	free(tree->infos);
+	free(tree->eytzinger);
+	free(tree->packed);
+	free(tree->order);
+	free(tree);
+}
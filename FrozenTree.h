@@ -0,0 +1,48 @@
+#ifndef FROZENTREE_H_
+#define FROZENTREE_H_
+
+#include <stdint.h>
+
+#include "TreeMap.h"
+
+/* Bytes of a cache line of the search arrays */
+#define FROZEN_LINE 64
+
+/*
+ * Read-only copy of a multi-dictionary
+ *
+ * The distinct keys are kept twice: sorted (elems) and in the order of
+ * a breadth-first traversal of a complete binary tree (Eytzinger layout,
+ * from index 1), so a search goes down with one comparison per level,
+ * without branches, and the children of a node are always 2i and 2i+1.
+ * The entries (duplicates included) are stored in key order as columns.
+ */
+typedef struct FTree{
+	void* (*createElement)(void*);  // method for creating an element
+	void (*destroyElement)(void*);	// method for destroying an element
+	int (*compare)(void*, void*); 	// method for comparing two elements
+	size_t keyLength;				// length of packed string keys
+									// (0 if the keys are not packed)
+	long keys;						// number of distinct keys
+	long size;						// number of entries
+	size_t infoSize;				// bytes of an info
+	void** elems;					// the distinct keys in order
+	long* start;					// first entry of every key
+									// (start[keys] == size)
+	char* infos;					// infos of the entries, in order
+	void** eytzinger;				// the keys in Eytzinger order
+	uint64_t* packed;				// packed keys in Eytzinger order
+									// (when the keys are packed)
+	long* order;					// index in elems of every key of
+									// the Eytzinger array
+}FTree;
+
+
+FTree* freezeTree(TTree* tree, size_t infoSize);
+long frozenSearch(FTree* tree, void* elem);
+long frozenLowerBound(FTree* tree, void* elem);
+long frozenUpperBound(FTree* tree, void* elem);
+void* frozenInfo(FTree* tree, long entry);
+void destroyFrozenTree(FTree* tree);
+
+#endif /* FROZENTREE_H_ */
@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "LoggedTree.h"
+#include "MappedTree.h"
+
+/* Byte order mark of the header */
+#define LOG_BYTE_ORDER 0x01020304u
+
+/* Room of the buffer: a full group plus the largest record */
+#define LOG_BUFFER_ROOM(infoSize) \
+	(LOG_BUFFER_BYTES + sizeof(LogRecord) + UINT16_MAX + (infoSize))
+
+
+/* FNV-1a hash of some bytes, continuing from h */
+static uint32_t hashBytes(const void *bytes, size_t n, uint32_t h) {
+	const unsigned char *p = (const unsigned char *)bytes;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+
+/* Checksum of a record followed by its payload */
+static uint32_t recordChecksum(LogRecord *record, const char *payload, size_t bytes) {
+	LogRecord copy = *record;
+	copy.checksum = 0;
+	return hashBytes(payload, bytes, hashBytes(&copy, sizeof(copy), 2166136261u));
+}
+
+
+/* Bytes of an element in a record: the characters kept by a packing
+ * tree, elemSize or a whole string, '\0' included
+ */
+static size_t elemBytes(LTree *tree, void *elem) {
+	if (tree->tree->keyLength != 0)
+		return strnlen((char *)elem, tree->tree->keyLength) + 1;
+	return tree->elemSize != 0 ? tree->elemSize : strlen((char *)elem) + 1;
+}
+
+
+/* Write a whole buffer to a file
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+static int writeAll(int fd, const char *bytes, size_t n) {
+	while (n > 0) {
+		ssize_t written = write(fd, bytes, n);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		bytes += written;
+		n -= written;
+	}
+	return 0;
+}
+
+
+/* Start an empty log (it replaces the old one atomically)
+ *
+ * return: 0 - on success, -1 - otherwise (if only the directory could not
+ *		   be flushed, the tree already writes to the new log)
+ */
+static int createLog(LTree *tree) {
+	char *temp = (char *)malloc(strlen(tree->logName) + 5);
+	if (temp == NULL)
+		return -1;
+	sprintf(temp, "%s.tmp", tree->logName);
+	LogHeader header = {0};
+	memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+	header.version = LOG_VERSION;
+	header.byteOrder = LOG_BYTE_ORDER;
+	int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0 || writeAll(fd, (char *)&header, sizeof(header)) != 0 ||
+		fsync(fd) != 0 || rename(temp, tree->logName) != 0) {
+		if (fd >= 0)
+			close(fd);
+		remove(temp);
+		free(temp);
+		return -1;
+	}
+	free(temp);
+	if (tree->fd >= 0)
+		close(tree->fd);
+	tree->fd = fd;
+	tree->logBytes = sizeof(header);
+	return syncDirectory(tree->logName);
+}
+
+
+/* Write the buffered records to the log (not flushed to the disk)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+static int writeBuffer(LTree *tree) {
+	if (tree->used == 0)
+		return 0;
+	if (writeAll(tree->fd, tree->buffer, tree->used) != 0)
+		return -1;
+	tree->logBytes += tree->used;
+	tree->used = 0;
+	return 0;
+}
+
+
+/* Append a change to the buffer of the log (it gets the next number)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+static int appendRecord(LTree *tree, uint16_t op, void *elem, void *info) {
+	size_t elem_bytes = elemBytes(tree, elem);
+	size_t info_bytes = op == LOG_INSERT ? tree->infoSize : 0;
+	if (elem_bytes > UINT16_MAX)
+		return -1;
+	if (tree->used >= LOG_BUFFER_BYTES && writeBuffer(tree) != 0)
+		return -1;
+	char *payload = tree->buffer + tree->used + sizeof(LogRecord);
+	if (tree->tree->keyLength != 0) {
+		memcpy(payload, elem, elem_bytes - 1);
+		payload[elem_bytes - 1] = '\0';
+	} else {
+		memcpy(payload, elem, elem_bytes);
+	}
+	if (info_bytes > 0)
+		memcpy(payload + elem_bytes, info, info_bytes);
+
+	LogRecord record = {tree->sequence + 1, 0, op, (uint16_t)elem_bytes};
+	record.checksum = recordChecksum(&record, payload, elem_bytes + info_bytes);
+	memcpy(tree->buffer + tree->used, &record, sizeof(record));
+	tree->used += sizeof(record) + elem_bytes + info_bytes;
+	tree->sequence++;
+	tree->pending++;
+	return 0;
+}
+
+
+/* After a change: commit the group once it is full, checkpoint once
+ * the log is long enough
+ */
+static int afterChange(LTree *tree) {
+	if (tree->pending >= tree->groupRecords && loggedSync(tree) != 0)
+		return -1;
+	if (tree->checkpointBytes != 0 && tree->logBytes >= tree->checkpointBytes)
+		return loggedCheckpoint(tree);
+	return 0;
+}
+
+
+/* Load the latest checkpoint into the (empty) tree, in linear time
+ *
+ * return: 0 - on success or if there is none, -1 - otherwise
+ */
+static int loadCheckpoint(LTree *tree) {
+	MTree *snapshot = loadTree(tree->snapName, tree->tree->compare);
+	if (snapshot == NULL)
+		return access(tree->snapName, F_OK) == 0 ? -1 : 0;
+	const MappedHeader *header = snapshot->header;
+	if (header->infoSize != tree->infoSize || header->keyLength != tree->tree->keyLength) {
+		closeMappedTree(snapshot);
+		return -1;
+	}
+	long n = header->size;
+	void **elems = (void **)malloc((n + 1) * sizeof(void*));
+	void **infos = (void **)malloc((n + 1) * sizeof(void*));
+	int result = -1;
+	if (elems != NULL && infos != NULL) {
+		for (long x = 0; x < header->keys; x++)
+			for (long i = 0, entry = snapshot->nodes[x].start; i < mappedCount(snapshot, x); i++) {
+				elems[entry + i] = mappedElem(snapshot, x);
+				infos[entry + i] = mappedInfo(snapshot, entry + i);
+			}
+		result = bulkLoadSorted(tree->tree, elems, infos, n);
+		tree->sequence = header->sequence;
+	}
+	free(elems);
+	free(infos);
+	closeMappedTree(snapshot);
+	return result;
+}
+
+
+/* Apply the changes logged after the checkpoint; the log ends at the
+ * first record that is incomplete or damaged (a group that was being
+ * written during the crash), and it is cut there
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+static int replayLog(LTree *tree) {
+	int fd = open(tree->logName, O_RDWR | O_APPEND);
+	if (fd < 0)
+		return errno == ENOENT ? createLog(tree) : -1;
+	struct stat st;
+	char *bytes = NULL;
+	size_t size = 0;
+	if (fstat(fd, &st) == 0 && (bytes = (char *)malloc(st.st_size + 1)) != NULL) {
+		ssize_t got;
+		while (size < (size_t)st.st_size &&
+			   (got = read(fd, bytes + size, st.st_size - size)) > 0)
+			size += got;
+	}
+	LogHeader header;
+	if (bytes == NULL || size < sizeof(header) ||
+		(memcpy(&header, bytes, sizeof(header)),
+		 memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) ||
+		header.version != LOG_VERSION || header.byteOrder != LOG_BYTE_ORDER) {
+		free(bytes);
+		close(fd);
+		return -1;
+	}
+
+	size_t offset = sizeof(header);
+	while (offset + sizeof(LogRecord) <= size) {
+		LogRecord record;
+		memcpy(&record, bytes + offset, sizeof(record));
+		char *payload = bytes + offset + sizeof(record);
+		size_t payload_bytes = record.elemBytes;
+		if (record.op == LOG_INSERT)
+			payload_bytes += tree->infoSize;
+		else if (record.op != LOG_DELETE)
+			break;
+		if (record.elemBytes == 0 || offset + sizeof(record) + payload_bytes > size ||
+			recordChecksum(&record, payload, payload_bytes) != record.checksum)
+			break;
+		// changes already in the checkpoint are skipped
+		// (the element and the info are first copied to aligned places)
+		if (record.sequence > tree->sequence) {
+			char *elem = tree->buffer;
+			char *info = tree->buffer + (record.elemBytes + 7) / 8 * 8;
+			memcpy(elem, payload, record.elemBytes);
+			memcpy(info, payload + record.elemBytes, payload_bytes - record.elemBytes);
+			if (record.op == LOG_INSERT)
+				insert(tree->tree, elem, info);
+			else
+				delete(tree->tree, elem);
+			tree->sequence = record.sequence;
+		}
+		offset += sizeof(record) + payload_bytes;
+	}
+	free(bytes);
+	if (offset < size && (ftruncate(fd, offset) != 0 || fsync(fd) != 0)) {
+		close(fd);
+		return -1;
+	}
+	tree->fd = fd;
+	tree->logBytes = offset;
+	return 0;
+}
+
+
+/* Open the log of an empty tree, restoring it from the files
+ * baseName.snap (checkpoint) and baseName.wal (log) if they exist
+ * The elements are logged as elemSize bytes (0 - strings), the infos
+ * as infoSize bytes
+ *
+ * return: the logged tree or NULL
+ */
+LTree* openLoggedTree(TTree* tree, char* baseName, size_t elemSize, size_t infoSize) {
+	if (tree == NULL || baseName == NULL || tree->root != NULL || infoSize == 0)
+		return NULL;
+	LTree *logged = (LTree *)calloc(1, sizeof(LTree));
+	if (logged == NULL)
+		return NULL;
+	logged->tree = tree;
+	logged->elemSize = elemSize;
+	logged->infoSize = infoSize;
+	logged->fd = -1;
+	logged->groupRecords = LOG_GROUP_RECORDS;
+	logged->checkpointBytes = LOG_CHECKPOINT_BYTES;
+	logged->snapName = (char *)malloc(strlen(baseName) + 6);
+	logged->logName = (char *)malloc(strlen(baseName) + 5);
+	logged->buffer = (char *)malloc(LOG_BUFFER_ROOM(infoSize));
+	if (logged->snapName == NULL || logged->logName == NULL || logged->buffer == NULL) {
+		closeLoggedTree(logged);
+		return NULL;
+	}
+	sprintf(logged->snapName, "%s.snap", baseName);
+	sprintf(logged->logName, "%s.wal", baseName);
+	if (loadCheckpoint(logged) != 0 || replayLog(logged) != 0) {
+		closeLoggedTree(logged);
+		return NULL;
+	}
+	return logged;
+}
+
+
+/* Insert a pair, logging it first (it is durable once its group is
+ * committed, or after loggedSync)
+ *
+ * return: 0 - on success,
+ *		   1 - applied, but its group could not be committed or the
+ *			   checkpoint failed (not durable until a loggedSync succeeds),
+ *		   -1 - if it could not be logged (the tree is unchanged)
+ */
+int loggedInsert(LTree* tree, void* elem, void* info) {
+	if (tree == NULL || appendRecord(tree, LOG_INSERT, elem, info) != 0)
+		return -1;
+	insert(tree->tree, elem, info);
+	return afterChange(tree) == 0 ? 0 : 1;
+}
+
+
+/* Delete the last occurrence of an element, logging it first
+ *
+ * return: the same as loggedInsert
+ */
+int loggedDelete(LTree* tree, void* elem) {
+	if (tree == NULL || appendRecord(tree, LOG_DELETE, elem, NULL) != 0)
+		return -1;
+	delete(tree->tree, elem);
+	return afterChange(tree) == 0 ? 0 : 1;
+}
+
+
+/* Commit the pending changes: a single write and a single flush to the
+ * disk for all of them
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int loggedSync(LTree* tree) {
+	if (tree == NULL || tree->fd < 0)
+		return -1;
+	if (tree->pending == 0 && tree->used == 0)
+		return 0;
+	if (writeBuffer(tree) != 0 || fdatasync(tree->fd) != 0)
+		return -1;
+	tree->pending = 0;
+	return 0;
+}
+
+
+/* Save the tree as the new checkpoint and start an empty log
+ * (a crash in between leaves the old log, whose changes are already
+ * in the checkpoint and are skipped)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int loggedCheckpoint(LTree* tree) {
+	if (loggedSync(tree) != 0)
+		return -1;
+	// The recovery depends on this order: saveCheckpoint returns once the
+	// new snapshot and its directory entry are on the disk, and only then
+	// is the log emptied. Swapping the log first, or without flushing the
+	// rename of the snapshot, a crash could keep the empty log next to the
+	// old snapshot and lose every change in between
+	if (saveCheckpoint(tree->tree, tree->snapName, tree->elemSize,
+					   tree->infoSize, tree->sequence) != 0)
+		return -1;
+	return createLog(tree);
+}
+
+
+/* Commit the pending changes and close the log (the tree is kept)
+ *
+ * return: 0 - if every change was committed, -1 - otherwise
+ */
+int closeLoggedTree(LTree* tree) {
+	if (tree == NULL)
+		return -1;
+	int result = tree->fd >= 0 ? loggedSync(tree) : -1;
+	if (tree->fd >= 0)
+		close(tree->fd);
+	free(tree->snapName);
+	free(tree->logName);
+	free(tree->buffer);
+	free(tree);
+	return result;
+}
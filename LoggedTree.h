@@ -0,0 +1,75 @@
+#ifndef LOGGEDTREE_H_
+#define LOGGEDTREE_H_
+
+#include <stdint.h>
+
+#include "TreeMap.h"
+
+/* First bytes and format version of a log file */
+#define LOG_MAGIC "AVLWAL"
+#define LOG_VERSION 1
+
+/* Changes written and flushed to the disk together (group commit) */
+#define LOG_GROUP_RECORDS 128
+
+/* Bytes of records buffered before they are written anyway */
+#define LOG_BUFFER_BYTES 65536
+
+/* Bytes of log after which the tree is checkpointed */
+#define LOG_CHECKPOINT_BYTES (16 << 20)
+
+/*
+ * Header of a log file
+ */
+typedef struct LogHeader{
+	char magic[8];				// LOG_MAGIC
+	uint32_t version;			// LOG_VERSION
+	uint32_t byteOrder;			// 0x01020304 written in the byte order
+								// of the machine that wrote the file
+}LogHeader;
+
+/*
+ * A change appended to the log, followed by the bytes of its element
+ * and, for an insert, the bytes of its info
+ */
+typedef struct LogRecord{
+	uint64_t sequence;			// number of the change
+	uint32_t checksum;			// of the record, with this field 0
+	uint16_t op;				// LOG_INSERT or LOG_DELETE
+	uint16_t elemBytes;			// bytes of the element
+}LogRecord;
+
+#define LOG_INSERT 1
+#define LOG_DELETE 2
+
+/*
+ * Multi-dictionary whose changes are logged before they are applied,
+ * so it can be restored after a crash: the latest checkpoint (a
+ * snapshot file, see MappedTree.h) plus the changes logged after it
+ */
+typedef struct LTree{
+	TTree *tree;				// the dictionary (owned by the caller)
+	char *snapName;				// the checkpoint file
+	char *logName;				// the log file
+	size_t elemSize;			// bytes of an element (0 - a string)
+	size_t infoSize;			// bytes of an info
+	int fd;						// the log, open for appending
+	char *buffer;				// records not written yet
+	size_t used;				// bytes in the buffer
+	long pending;				// records not flushed to the disk yet
+	uint64_t sequence;			// number of the latest change
+	size_t logBytes;			// bytes of the log
+	long groupRecords;			// records flushed together
+	size_t checkpointBytes;		// log size triggering a checkpoint
+								// (0 - only explicit checkpoints)
+}LTree;
+
+
+LTree* openLoggedTree(TTree* tree, char* baseName, size_t elemSize, size_t infoSize);
+int loggedInsert(LTree* tree, void* elem, void* info);
+int loggedDelete(LTree* tree, void* elem);
+int loggedSync(LTree* tree);
+int loggedCheckpoint(LTree* tree);
+int closeLoggedTree(LTree* tree);
+
+#endif /* LOGGEDTREE_H_ */
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedTree.h"
+
+/* Byte order mark of the header */
+#define MAPPED_BYTE_ORDER 0x01020304u
+
+/* Round a file offset up to the alignment of the sections */
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+
+/* The sections of a snapshot being built in memory */
+typedef struct SaveState{
+	TTree *tree;
+	size_t elemSize;		// bytes of a key (0 - a string)
+	size_t infoSize;		// bytes of an info
+	MappedNode *nodes;
+	char *infos;
+	char *elems;			// the keys section
+	size_t elemsUsed;
+	size_t elemsCapacity;
+	TreeNode *maxNode;		// most frequent node of the tree
+	int64_t maxIndex;		// its index in the file
+	int64_t keys;			// nodes saved so far
+	int64_t entries;		// entries saved so far
+	int failed;				// a key could not be stored
+}SaveState;
+
+
+/* Copy a key at the end of the keys section (8-byte aligned)
+ *
+ * return: its offset in the section
+ */
+static uint64_t saveElem(SaveState *s, void *elem) {
+	size_t bytes = s->elemSize != 0 ? s->elemSize : strlen((char *)elem) + 1;
+	size_t offset = ALIGN8(s->elemsUsed);
+	if (offset + bytes > s->elemsCapacity) {
+		size_t capacity = s->elemsCapacity != 0 ? s->elemsCapacity : 4096;
+		while (offset + bytes > capacity)
+			capacity *= 2;
+		char *elems = (char *)realloc(s->elems, capacity);
+		if (elems == NULL) {
+			s->failed = 1;
+			return 0;
+		}
+		memset(elems + s->elemsCapacity, 0, capacity - s->elemsCapacity);
+		s->elems = elems;
+		s->elemsCapacity = capacity;
+	}
+	memcpy(s->elems + offset, elem, bytes);
+	s->elemsUsed = offset + bytes;
+	return offset;
+}
+
+
+/* Save a subtree; the nodes are numbered in key order, so the entries
+ * of a node follow the entries of the node before it
+ *
+ * The tombstones of a lazy tree are left out: the right subtree of one
+ * is hung under the greatest saved node of its left subtree
+ *
+ * return: the index of its root (-1 - empty subtree)
+ */
+static int32_t saveNode(SaveState *s, TreeNode *x) {
+	if (x == NULL)
+		return -1;
+	int32_t left = saveNode(s, x->left);
+	if (countOf(s->tree, x) == 0) {
+		int32_t right = saveNode(s, x->right);
+		if (left == -1)
+			return right;
+		int32_t last = left;
+		while (s->nodes[last].right != -1)
+			last = s->nodes[last].right;
+		s->nodes[last].right = right;
+		return left;
+	}
+	int32_t index = (int32_t)s->keys++;
+	MappedNode *node = &s->nodes[index];
+	node->left = left;
+	node->start = s->entries;
+	if (s->tree->keyLength != 0)
+		memcpy(&node->elem, x->elem, sizeof(uint64_t));
+	else
+		node->elem = saveElem(s, x->elem);
+	if (x == s->maxNode)
+		s->maxIndex = index;
+
+	TreeCursor cursor = cursorAt(s->tree, x);
+	long count = countOf(s->tree, x);
+	for (long i = 0; i < count; i++, cursorNext(&cursor))
+		memcpy(s->infos + (s->entries + i) * s->infoSize, cursorInfo(&cursor), s->infoSize);
+	s->entries += count;
+
+	node->right = saveNode(s, x->right);
+	return index;
+}
+
+
+/* Write a section followed by the padding up to the next offset
+ *
+ * return: 1 - on success, 0 - otherwise
+ */
+static int writeSection(FILE *f, const void *data, size_t bytes, uint64_t next) {
+	static const char zeros[8];
+	if (bytes > 0 && fwrite(data, 1, bytes, f) != bytes)
+		return 0;
+	long pad = next - ftell(f);
+	return pad >= 0 && fwrite(zeros, 1, pad, f) == (size_t)pad;
+}
+
+
+/* Flush to the disk the directory that holds fileName, so that a file
+ * just renamed to fileName keeps its name after a crash
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int syncDirectory(char* fileName) {
+	if (fileName == NULL)
+		return -1;
+	char *slash = strrchr(fileName, '/');
+	size_t length = slash == NULL ? 1 : slash == fileName ? 1 : (size_t)(slash - fileName);
+	char *dir = (char *)malloc(length + 1);
+	if (dir == NULL)
+		return -1;
+	memcpy(dir, slash == NULL ? "." : slash == fileName ? "/" : fileName, length);
+	dir[length] = '\0';
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (fd < 0)
+		return -1;
+	int result = fsync(fd) == 0 ? 0 : -1;
+	close(fd);
+	return result;
+}
+
+
+/* Save a tree to a snapshot file: the nodes (in the shape of the tree),
+ * the infos of the entries copied byte by byte (infoSize bytes each) and
+ * the keys (elemSize bytes each, or up to their '\0' if elemSize is 0;
+ * packed keys are kept inside the nodes)
+ *
+ * The file is written next to fileName and renamed over it at the end,
+ * so a crash never leaves a partial snapshot behind; the directory is
+ * flushed after the rename, so the new file is on the disk once this
+ * returns 0
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int saveTree(TTree* tree, char* fileName, size_t elemSize, size_t infoSize) {
+	return saveCheckpoint(tree, fileName, elemSize, infoSize, 0);
+}
+
+
+/* The same as saveTree, recording the number of the last change of a
+ * write-ahead log that the file includes
+ */
+int saveCheckpoint(TTree* tree, char* fileName, size_t elemSize, size_t infoSize,
+				   uint64_t sequence) {
+	if (tree == NULL || fileName == NULL || infoSize == 0)
+		return -1;
+	long size = tree->size;
+	if (size > INT32_MAX)
+		return -1;
+	SaveState s = {0};
+	s.tree = tree;
+	s.elemSize = elemSize;
+	s.infoSize = infoSize;
+	s.maxNode = mostFrequent(tree);
+	s.maxIndex = -1;
+	s.nodes = (MappedNode *)calloc(size + 1, sizeof(MappedNode));
+	s.infos = (char *)malloc(size * infoSize + 1);
+	if (s.nodes == NULL || s.infos == NULL) {
+		free(s.nodes);
+		free(s.infos);
+		return -1;
+	}
+
+	MappedHeader header = {0};
+	memcpy(header.magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC));
+	header.version = MAPPED_VERSION;
+	header.byteOrder = MAPPED_BYTE_ORDER;
+	header.keyLength = tree->keyLength;
+	header.infoSize = infoSize;
+	header.root = saveNode(&s, tree->root);
+	header.keys = s.keys;
+	header.size = s.entries;
+	header.maxNode = s.maxIndex;
+	header.sequence = sequence;
+	header.nodesOffset = ALIGN8(sizeof(MappedHeader));
+	header.infosOffset = ALIGN8(header.nodesOffset + s.keys * sizeof(MappedNode));
+	header.elemsOffset = ALIGN8(header.infosOffset + s.entries * infoSize);
+	header.fileSize = header.elemsOffset + s.elemsUsed;
+
+	int result = -1;
+	char *temp = (char *)malloc(strlen(fileName) + 5);
+	FILE *f = NULL;
+	if (!s.failed && temp != NULL) {
+		sprintf(temp, "%s.tmp", fileName);
+		f = fopen(temp, "wb");
+	}
+	if (f != NULL) {
+		int ok = writeSection(f, &header, sizeof(header), header.nodesOffset) &&
+				 writeSection(f, s.nodes, s.keys * sizeof(MappedNode), header.infosOffset) &&
+				 writeSection(f, s.infos, s.entries * infoSize, header.elemsOffset) &&
+				 writeSection(f, s.elems, s.elemsUsed, header.fileSize) &&
+				 fflush(f) == 0 && fsync(fileno(f)) == 0;
+		ok &= fclose(f) == 0;
+		if (ok && rename(temp, fileName) == 0)
+			result = syncDirectory(fileName);
+		else
+			remove(temp);
+	}
+	free(temp);
+	free(s.nodes);
+	free(s.infos);
+	free(s.elems);
+	return result;
+}
+
+
+/* Check that a mapped header describes a file of this machine whose
+ * sections fit in it
+ */
+static int validHeader(const MappedHeader *h, size_t length) {
+	if (length < sizeof(MappedHeader) ||
+		memcmp(h->magic, MAPPED_MAGIC, sizeof(MAPPED_MAGIC)) != 0 ||
+		h->version != MAPPED_VERSION || h->byteOrder != MAPPED_BYTE_ORDER ||
+		h->fileSize != length || h->infoSize == 0 || h->keyLength >= sizeof(uint64_t))
+		return 0;
+	if (h->keys < 0 || h->keys > INT32_MAX || h->size < h->keys ||
+		h->root < -1 || h->root >= h->keys || h->maxNode < -1 || h->maxNode >= h->keys)
+		return 0;
+	if (h->nodesOffset % 8 != 0 || h->infosOffset % 8 != 0 || h->elemsOffset % 8 != 0)
+		return 0;
+	return h->nodesOffset >= sizeof(MappedHeader) &&
+		   h->infosOffset >= h->nodesOffset + h->keys * sizeof(MappedNode) &&
+		   h->elemsOffset >= h->infosOffset + h->size * h->infoSize &&
+		   h->fileSize >= h->elemsOffset;
+}
+
+
+/* Check the nodes section of a valid header once, so that the searches
+ * can follow it blindly: the children keep the key order of the indices
+ * (so every walk down ends), the entries of the nodes follow each other
+ * and every key lies inside the keys section
+ */
+static int validNodes(const MappedHeader *h, const MappedNode *nodes) {
+	uint64_t elemsBytes = h->fileSize - h->elemsOffset;
+	int64_t start = 0;
+	for (int64_t i = 0; i < h->keys; i++) {
+		const MappedNode *x = &nodes[i];
+		if (x->left < -1 || x->left >= i || x->right >= h->keys ||
+			(x->right != -1 && x->right <= i))
+			return 0;
+		if (x->start < start || x->start > h->size)
+			return 0;
+		start = x->start;
+		if (h->keyLength == 0 && (x->elem % 8 != 0 || x->elem >= elemsBytes))
+			return 0;
+	}
+	return 1;
+}
+
+
+/* Map a snapshot file; the searches and the queries read the mapped
+ * pages directly, so only the pages they touch are ever loaded
+ * (compare is not needed for packed keys)
+ *
+ * return: the mapped tree or NULL if the file is missing or invalid
+ */
+MTree* loadTree(char* fileName, int (*compare)(void*, void*)) {
+	if (fileName == NULL)
+		return NULL;
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MappedHeader)) {
+		close(fd);
+		return NULL;
+	}
+	void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+	const MappedHeader *header = (const MappedHeader *)base;
+	MTree *tree = NULL;
+	if (!validHeader(header, st.st_size) ||
+		!validNodes(header, (const MappedNode *)((const char *)base + header->nodesOffset)) ||
+		(header->keyLength == 0 && compare == NULL) ||
+		(tree = (MTree *)malloc(sizeof(MTree))) == NULL) {
+		munmap(base, st.st_size);
+		return NULL;
+	}
+	tree->compare = compare;
+	tree->base = base;
+	tree->length = st.st_size;
+	tree->header = header;
+	tree->nodes = (const MappedNode *)((const char *)base + header->nodesOffset);
+	tree->infos = (const char *)base + header->infosOffset;
+	tree->elems = (const char *)base + header->elemsOffset;
+	return tree;
+}
+
+
+/* Compare a prepared key with the key of a saved node
+ * -1 - key < x, 0 - equal, 1 - key > x
+ */
+static int compareMapped(MTree* tree, TreeKey* key, long x) {
+	if (tree->header->keyLength != 0) {
+		uint64_t k = loadPackedKey(&tree->nodes[x].elem);
+		return (key->packed > k) - (key->packed < k);
+	}
+	return tree->compare(key->elem, (void *)(tree->elems + tree->nodes[x].elem));
+}
+
+
+/* Go down the saved tree to the first node whose key is not smaller
+ * than elem (strict: greater than elem)
+ *
+ * return: its index or -1 if every key is smaller
+ */
+static long descend(MTree* tree, void* elem, int strict) {
+	TreeKey key = {elem, 0};
+	if (tree->header->keyLength != 0)
+		key.packed = packKey((char*) elem, tree->header->keyLength);
+	long x = tree->header->root, found = -1;
+	while (x != -1) {
+		int c = compareMapped(tree, &key, x);
+		if (c < 0 || (c == 0 && !strict)) {
+			found = x;
+			x = tree->nodes[x].left;
+		} else {
+			x = tree->nodes[x].right;
+		}
+	}
+	return found;
+}
+
+
+/* Entry number of the first occurrence of an element (the entry of the
+ * node returned by search() on the saved tree)
+ *
+ * return: the entry or -1 if the element is missing
+ */
+long mappedSearch(MTree* tree, void* elem) {
+	TreeKey key = {elem, 0};
+	if (tree->header->keyLength != 0)
+		key.packed = packKey((char*) elem, tree->header->keyLength);
+	long x = tree->header->root;
+	while (x != -1) {
+		int c = compareMapped(tree, &key, x);
+		if (c == 0)
+			return tree->nodes[x].start;
+		x = c < 0 ? tree->nodes[x].left : tree->nodes[x].right;
+	}
+	return -1;
+}
+
+
+/* First entry whose key is not smaller than elem (size if none) */
+long mappedLowerBound(MTree* tree, void* elem) {
+	long x = descend(tree, elem, 0);
+	return x == -1 ? tree->header->size : tree->nodes[x].start;
+}
+
+
+/* First entry whose key is greater than elem (size if none) */
+long mappedUpperBound(MTree* tree, void* elem) {
+	long x = descend(tree, elem, 1);
+	return x == -1 ? tree->header->size : tree->nodes[x].start;
+}
+
+
+/* Number of entries with the key of a node */
+long mappedCount(MTree* tree, long node) {
+	long end = node + 1 < tree->header->keys ? tree->nodes[node + 1].start
+											 : tree->header->size;
+	return end - tree->nodes[node].start;
+}
+
+
+/* Key of a node, inside the mapping (the bytes of a packed key) */
+void* mappedElem(MTree* tree, long node) {
+	if (node < 0 || node >= tree->header->keys)
+		return NULL;
+	if (tree->header->keyLength != 0)
+		return (void *)&tree->nodes[node].elem;
+	return (void *)(tree->elems + tree->nodes[node].elem);
+}
+
+
+/* Info of an entry, inside the mapping */
+void* mappedInfo(MTree* tree, long entry) {
+	if (entry < 0 || entry >= tree->header->size)
+		return NULL;
+	return (void *)(tree->infos + entry * tree->header->infoSize);
+}
+
+
+void closeMappedTree(MTree* tree) {
+	if (tree == NULL)
+		return;
+	munmap(tree->base, tree->length);
+	free(tree);
+}
@@ -0,0 +1,78 @@
+#ifndef MAPPEDTREE_H_
+#define MAPPEDTREE_H_
+
+#include <stdint.h>
+
+#include "TreeMap.h"
+
+/* First bytes and format version of a snapshot file */
+#define MAPPED_MAGIC "AVLSNAP"
+#define MAPPED_VERSION 2
+
+/*
+ * Header of a snapshot file
+ * The sections follow it, each one 8-byte aligned; every reference
+ * inside the file is an index or an offset, never a pointer, so the
+ * file is used as it is once mapped
+ */
+typedef struct MappedHeader{
+	char magic[8];				// MAPPED_MAGIC
+	uint32_t version;			// MAPPED_VERSION
+	uint32_t byteOrder;			// 0x01020304 written in the byte order
+								// of the machine that saved the file
+	uint32_t keyLength;			// length of packed string keys
+								// (0 if the keys are not packed)
+	uint32_t infoSize;			// bytes of an info
+	int64_t keys;				// number of nodes (distinct keys)
+	int64_t size;				// number of entries
+	int64_t root;				// index of the root node (-1 - empty tree)
+	int64_t maxNode;			// index of the most frequent key
+	uint64_t sequence;			// last change of a write-ahead log
+								// included in the file (0 - none)
+	uint64_t nodesOffset;		// offset of the nodes, in key order
+	uint64_t infosOffset;		// offset of the infos of the entries,
+								// in key order
+	uint64_t elemsOffset;		// offset of the keys (not packed)
+	uint64_t fileSize;			// bytes of the whole file
+}MappedHeader;
+
+/*
+ * A node of the saved tree (the shape of the tree is kept as it is)
+ */
+typedef struct MappedNode{
+	int32_t left;				// index of the left child (-1 - none)
+	int32_t right;				// index of the right child (-1 - none)
+	int64_t start;				// first entry with the key of the node
+	uint64_t elem;				// bytes of a packed key, or offset of
+								// the key in the keys section
+}MappedNode;
+
+/*
+ * Multi-dictionary served straight from a mapped snapshot file
+ * (read-only; nothing is copied out of the file)
+ */
+typedef struct MTree{
+	int (*compare)(void*, void*); 	// method for comparing two elements
+	void* base;						// the mapping
+	size_t length;					// bytes mapped
+	const MappedHeader* header;		// start of the file
+	const MappedNode* nodes;		// the nodes section
+	const char* infos;				// the infos section
+	const char* elems;				// the keys section
+}MTree;
+
+
+int saveTree(TTree* tree, char* fileName, size_t elemSize, size_t infoSize);
+int saveCheckpoint(TTree* tree, char* fileName, size_t elemSize, size_t infoSize,
+				   uint64_t sequence);
+int syncDirectory(char* fileName);
+MTree* loadTree(char* fileName, int (*compare)(void*, void*));
+long mappedSearch(MTree* tree, void* elem);
+long mappedLowerBound(MTree* tree, void* elem);
+long mappedUpperBound(MTree* tree, void* elem);
+long mappedCount(MTree* tree, long node);
+void* mappedElem(MTree* tree, long node);
+void* mappedInfo(MTree* tree, long entry);
+void closeMappedTree(MTree* tree);
+
+#endif /* MAPPEDTREE_H_ */
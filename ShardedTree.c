@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ShardedTree.h"
+#include "TreeSet.h"
+
+
+/* Create a tree that can be split in up to capacity shards; it starts
+ * with a single shard, rebalanceShards spreads the keys over all of them
+ *
+ * return: the created tree or NULL
+ */
+STree* createShardedTree(int capacity,
+						 void* (*createElement)(void*),
+						 void (*destroyElement)(void*),
+						 void* (*createInfo)(void*),
+						 void (*destroyInfo)(void*),
+						 int compare(void*, void*)) {
+	if (capacity <= 0)
+		return NULL;
+	STree *tree = (STree *)malloc(sizeof(STree));
+	if (tree == NULL)
+		return NULL;
+	tree->shards = (TTree **)calloc(capacity, sizeof(TTree*));
+	tree->locks = (pthread_mutex_t *)malloc(capacity * sizeof(pthread_mutex_t));
+	tree->bounds = (void **)calloc(capacity, sizeof(void*));
+	if (tree->shards == NULL || tree->locks == NULL || tree->bounds == NULL) {
+		free(tree->shards);
+		free(tree->locks);
+		free(tree->bounds);
+		free(tree);
+		return NULL;
+	}
+	tree->count = 1;
+	tree->capacity = capacity;
+	for (int i = 0; i < capacity; i++) {
+		tree->shards[i] = createTree(createElement, destroyElement,
+									 createInfo, destroyInfo, compare);
+		// the bounds are found by rank
+		treeAugment(tree->shards[i]);
+		pthread_mutex_init(&tree->locks[i], NULL);
+	}
+	pthread_rwlock_init(&tree->layout, NULL);
+	return tree;
+}
+
+
+/* The same modes as treeUsePackedKeys and treeCompactDuplicates, for
+ * every shard (the tree has to be empty)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int shardsUsePackedKeys(STree* tree, size_t keyLength) {
+	for (int i = 0; i < tree->capacity; i++)
+		if (treeUsePackedKeys(tree->shards[i], keyLength) != 0)
+			return -1;
+	return 0;
+}
+
+int shardsCompactDuplicates(STree* tree, size_t infoSize) {
+	for (int i = 0; i < tree->capacity; i++)
+		if (treeCompactDuplicates(tree->shards[i], infoSize) != 0)
+			return -1;
+	return 0;
+}
+
+
+/* Copy the key of a node into a bound (packed keys: their 8 bytes,
+ * since the shards have no createElement to call)
+ */
+static void* createBound(TTree* shard, TreeNode* x) {
+	if (shard->keyLength == 0)
+		return shard->createElement(x->elem);
+	void *bound = malloc(sizeof(uint64_t));
+	if (bound != NULL)
+		memcpy(bound, x->elem, sizeof(uint64_t));
+	return bound;
+}
+
+static void destroyBound(TTree* shard, void* bound) {
+	if (shard->keyLength == 0)
+		shard->destroyElement(bound);
+	else
+		free(bound);
+}
+
+
+/* Compare a prepared key with a bound, the way the shards compare keys
+ * -1 - key < bound, 0 - equal, 1 - key > bound
+ */
+static int compareBound(TTree* shard, TreeKey* key, void* bound) {
+	if (shard->keyLength != 0) {
+		uint64_t b = loadPackedKey((uint64_t*) bound);
+		return (key->packed > b) - (key->packed < b);
+	}
+	return shard->compare(key->elem, bound);
+}
+
+
+/* Index of the shard whose range holds elem (layout locked) */
+static int shardOf(STree* tree, void* elem) {
+	TreeKey key = makeKey(tree->shards[0], elem);
+	int lo = 0, hi = tree->count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (compareBound(tree->shards[0], &key, tree->bounds[mid]) <= 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+
+/* Lock the shard of elem; the layout stays locked for reading until
+ * releaseShard, so the bounds cannot move meanwhile
+ */
+static TTree* acquireShard(STree* tree, void* elem, int* index) {
+	pthread_rwlock_rdlock(&tree->layout);
+	*index = shardOf(tree, elem);
+	pthread_mutex_lock(&tree->locks[*index]);
+	return tree->shards[*index];
+}
+
+static void releaseShard(STree* tree, int index) {
+	pthread_mutex_unlock(&tree->locks[index]);
+	pthread_rwlock_unlock(&tree->layout);
+}
+
+
+/* Insert an element in its shard; only writers of the same shard wait
+ */
+void shardedInsert(STree* tree, void* elem, void* info) {
+	int index;
+	TTree *shard = acquireShard(tree, elem, &index);
+	insert(shard, elem, info);
+	releaseShard(tree, index);
+}
+
+
+/* Delete the last occurrence of an element from its shard
+ */
+void shardedDelete(STree* tree, void* elem) {
+	int index;
+	TTree *shard = acquireShard(tree, elem, &index);
+	delete(shard, elem);
+	releaseShard(tree, index);
+}
+
+
+/* Search an element in its shard
+ *
+ * return: the node of the element (valid until it is deleted or the
+ *         shards are rebalanced) or NULL
+ */
+TreeNode* shardedSearch(STree* tree, void* elem) {
+	int index;
+	TTree *shard = acquireShard(tree, elem, &index);
+	TreeNode *found = search(shard, shard->root, elem);
+	releaseShard(tree, index);
+	return found;
+}
+
+
+/* Number of entries in all the shards (duplicates included)
+ */
+long shardedSize(STree* tree) {
+	long size = 0;
+	pthread_rwlock_rdlock(&tree->layout);
+	for (int i = 0; i < tree->count; i++) {
+		pthread_mutex_lock(&tree->locks[i]);
+		size += tree->shards[i]->size;
+		pthread_mutex_unlock(&tree->locks[i]);
+	}
+	pthread_rwlock_unlock(&tree->layout);
+	return size;
+}
+
+
+/* Move the bounds so that every shard gets about the same number of
+ * entries
+ *
+ * The shards are joined into the first one, the new bounds are the keys
+ * found at evenly spaced ranks (selectNode, O(log n) each) and the tree
+ * is split again at them, so only O(capacity * log n) nodes are touched.
+ * All the duplicates of a key stay in the same shard.
+ * ! the shards cannot use an arena
+ *
+ * return: 0 - on success,
+ *		   -1 - if a shard uses an arena (nothing is moved) or the hash
+ *		   index of a shard could not be rebuilt (the shards are still
+ *		   rebalanced, the index is dropped)
+ */
+int rebalanceShards(STree* tree) {
+	pthread_rwlock_wrlock(&tree->layout);
+	// the arena is the only reason for a join or a split to refuse the
+	// trees; past this check they always move the entries and can only
+	// fail to rebuild an index, so the layout is always completed
+	for (int i = 0; i < tree->capacity; i++)
+		if (tree->shards[i]->arena != NULL) {
+			pthread_rwlock_unlock(&tree->layout);
+			return -1;
+		}
+
+	int result = 0;
+	TTree *all = tree->shards[0];
+	for (int i = 1; i < tree->count; i++)
+		if (treeJoin(all, tree->shards[i]) != 0)
+			result = -1;
+	for (int i = 0; i + 1 < tree->count; i++)
+		destroyBound(all, tree->bounds[i]);
+
+	int bounds = 0;
+	long size = all->size;
+	TreeNode *last = size > 0 ? maximum(all->root) : NULL;
+	for (int i = 1; i < tree->capacity && size > 0; i++) {
+		long rank = i * size / tree->capacity - 1;
+		if (rank < 0)
+			continue;
+		TreeNode *x = selectNode(all, rank);
+		if (compareNodes(all, x, last) >= 0)
+			break;	// the next shards would stay empty
+		TreeKey key = makeKey(all, x->elem);
+		if (bounds > 0 && compareBound(all, &key, tree->bounds[bounds - 1]) <= 0)
+			continue;	// a key with many duplicates spans this rank
+		void *bound = createBound(all, x);
+		if (bound == NULL)
+			break;
+		tree->bounds[bounds++] = bound;
+	}
+
+	// split from the greatest bound, every split only cuts one path
+	for (int i = bounds - 1; i >= 0; i--)
+		if (treeSplit(all, tree->bounds[i], tree->shards[i + 1]) != 0)
+			result = -1;
+	tree->count = bounds + 1;
+	pthread_rwlock_unlock(&tree->layout);
+	return result;
+}
+
+
+/* Visit in key order the shards that can hold keys strictly between lo
+ * and hi (NULL - no bound), every one under its lock; the trees are
+ * visited in place, nothing is copied
+ *
+ * return: number of visited shards
+ */
+int shardedForEach(STree* tree, void* lo, void* hi,
+				   void (*visit)(TTree*, void*), void* arg) {
+	int visited = 0;
+	pthread_rwlock_rdlock(&tree->layout);
+	TreeKey high = {0};
+	if (hi != NULL)
+		high = makeKey(tree->shards[0], hi);
+	int first = lo != NULL ? shardOf(tree, lo) : 0;
+	for (int i = first; i < tree->count; i++) {
+		if (hi != NULL && i > 0 && compareBound(tree->shards[0], &high, tree->bounds[i - 1]) <= 0)
+			break;
+		pthread_mutex_lock(&tree->locks[i]);
+		visit(tree->shards[i], arg);
+		pthread_mutex_unlock(&tree->locks[i]);
+		visited++;
+	}
+	pthread_rwlock_unlock(&tree->layout);
+	return visited;
+}
+
+
+/* Free the shards and the bounds; no other thread may use the tree
+ */
+void destroyShardedTree(STree* tree) {
+	for (int i = 0; i + 1 < tree->count; i++)
+		destroyBound(tree->shards[0], tree->bounds[i]);
+	for (int i = 0; i < tree->capacity; i++) {
+		destroyTree(tree->shards[i]);
+		pthread_mutex_destroy(&tree->locks[i]);
+	}
+	pthread_rwlock_destroy(&tree->layout);
+	free(tree->shards);
+	free(tree->locks);
+	free(tree->bounds);
+	free(tree);
+}
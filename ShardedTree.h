@@ -0,0 +1,44 @@
+#ifndef SHARDEDTREE_H_
+#define SHARDEDTREE_H_
+
+#include <pthread.h>
+
+#include "TreeMap.h"
+
+/*
+ * Multi-dictionary split by key ranges into independent trees
+ *
+ * Shard i holds the keys in (bounds[i - 1], bounds[i]] (the first and
+ * the last shard are open at one end). Every shard has its own lock, so
+ * writers of different ranges do not wait for each other; the layout
+ * lock is only taken exclusively when the bounds move.
+ */
+typedef struct STree{
+	TTree **shards;					// the trees, in key order
+	pthread_mutex_t *locks;			// lock of every shard
+	void **bounds;					// greatest key of every shard but the
+									// last one (created elements)
+	int count;						// shards in use
+	int capacity;					// shards created
+	pthread_rwlock_t layout;		// protects count and bounds
+}STree;
+
+
+STree* createShardedTree(int capacity,
+						 void* (*createElement)(void*),
+						 void (*destroyElement)(void*),
+						 void* (*createInfo)(void*),
+						 void (*destroyInfo)(void*),
+						 int compare(void*, void*));
+int shardsUsePackedKeys(STree* tree, size_t keyLength);
+int shardsCompactDuplicates(STree* tree, size_t infoSize);
+void shardedInsert(STree* tree, void* elem, void* info);
+void shardedDelete(STree* tree, void* elem);
+TreeNode* shardedSearch(STree* tree, void* elem);
+long shardedSize(STree* tree);
+int rebalanceShards(STree* tree);
+int shardedForEach(STree* tree, void* lo, void* hi,
+				   void (*visit)(TTree*, void*), void* arg);
+void destroyShardedTree(STree* tree);
+
+#endif /* SHARDEDTREE_H_ */
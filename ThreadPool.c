@@ -0,0 +1,124 @@
+#include <stdlib.h>
+
+#include "ThreadPool.h"
+
+
+/* Take the first task out of the queue
+ * ! must be called with the lock held
+ */
+static PoolTask* popTask(ThreadPool *pool) {
+	PoolTask *task = pool->head;
+	if (task != NULL) {
+		pool->head = task->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+	}
+	return task;
+}
+
+
+/* Run a task outside the lock and publish its completion
+ * ! must be called with the lock held
+ */
+static void runTask(ThreadPool *pool, PoolTask *task) {
+	pthread_mutex_unlock(&pool->lock);
+	task->run(task->arg);
+	pthread_mutex_lock(&pool->lock);
+	task->done = 1;
+	pthread_cond_broadcast(&pool->changed);
+}
+
+
+static void* workerLoop(void *arg) {
+	ThreadPool *pool = (ThreadPool *)arg;
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->stop) {
+		PoolTask *task = popTask(pool);
+		if (task != NULL)
+			runTask(pool, task);
+		else
+			pthread_cond_wait(&pool->changed, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+
+/* Create a pool with the given number of worker threads
+ *
+ * return: the created pool or NULL
+ */
+ThreadPool* createThreadPool(int threads) {
+	if (threads <= 0)
+		return NULL;
+	ThreadPool *pool = (ThreadPool *)malloc(sizeof(ThreadPool));
+	if (pool == NULL)
+		return NULL;
+	pool->workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+	if (pool->workers == NULL) {
+		free(pool);
+		return NULL;
+	}
+	pool->head = pool->tail = NULL;
+	pool->stop = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->changed, NULL);
+	pool->threads = 0;
+	while (pool->threads < threads &&
+		   pthread_create(&pool->workers[pool->threads], NULL, workerLoop, pool) == 0)
+		pool->threads++;
+	return pool;
+}
+
+
+/* Queue a task; it will be run by a worker (or by a waiting thread)
+ */
+void poolSubmit(ThreadPool *pool, PoolTask *task, void (*run)(void*), void *arg) {
+	task->run = run;
+	task->arg = arg;
+	task->done = 0;
+	task->next = NULL;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail != NULL)
+		pool->tail->next = task;
+	else
+		pool->head = task;
+	pool->tail = task;
+	pthread_cond_broadcast(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/* Wait until a submitted task has finished, running queued tasks
+ * in the meantime (possibly the awaited one itself)
+ */
+void poolWait(ThreadPool *pool, PoolTask *task) {
+	pthread_mutex_lock(&pool->lock);
+	while (!task->done) {
+		PoolTask *other = popTask(pool);
+		if (other != NULL)
+			runTask(pool, other);
+		else
+			pthread_cond_wait(&pool->changed, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/* Stop the workers and free the pool
+ * ! all the submitted tasks must have been waited for
+ */
+void destroyThreadPool(ThreadPool *pool) {
+	if (pool == NULL)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+	for (int i = 0; i < pool->threads; i++)
+		pthread_join(pool->workers[i], NULL);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->changed);
+	free(pool->workers);
+	free(pool);
+}
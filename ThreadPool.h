@@ -0,0 +1,39 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <pthread.h>
+
+/*
+ * A unit of work for the pool
+ * (usually the first field of a bigger structure holding the arguments)
+ */
+typedef struct PoolTask{
+	void (*run)(void*);			// the work to do
+	void *arg;					// argument of run
+	int done;					// set once run has returned
+	struct PoolTask *next;		// next task in the queue
+}PoolTask;
+
+/*
+ * Fixed number of worker threads sharing one queue of tasks
+ *
+ * A thread waiting for a task runs other queued tasks meanwhile,
+ * so tasks can submit and wait for subtasks (fork-join)
+ */
+typedef struct ThreadPool{
+	pthread_t *workers;			// worker threads
+	int threads;				// number of workers
+	PoolTask *head;				// first task in the queue
+	PoolTask *tail;				// last task in the queue
+	int stop;					// set when the pool is destroyed
+	pthread_mutex_t lock;		// protects the queue and the done flags
+	pthread_cond_t changed;		// signaled on new tasks and finished tasks
+}ThreadPool;
+
+
+ThreadPool* createThreadPool(int threads);
+void poolSubmit(ThreadPool *pool, PoolTask *task, void (*run)(void*), void *arg);
+void poolWait(ThreadPool *pool, PoolTask *task);
+void destroyThreadPool(ThreadPool *pool);
+
+#endif /* THREADPOOL_H_ */
@@ -1,10 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "TreeMap.h"
 
 #define MAX(a, b) (((a) >= (b))?(a):(b))
+#define ALIGN(n) (((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+_Thread_local TreeCounters treeCounters;
 
 
 /* Create a tree with a series of associated methods
@@ -23,17 +29,458 @@ TTree* createTree(void* (*createElement)(void*),
 	tree->destroyInfo = destroyInfo;
 	tree->compare = compare;
 	tree->size = 0;
+	tree->augmented = 0;
 	tree->root = NULL;
+	tree->arena = NULL;
+	tree->elemSize = tree->infoSize = 0;
+	tree->keyLength = tree->keyOffset = 0;
+	tree->dupSize = tree->chunksOffset = 0;
+	tree->lazyRatio = 0;
+	tree->maxHeight = 0;
+	tree->nodeSize = sizeof(TreeNode);
+	tree->hash = NULL;
+	tree->slots = NULL;
+	tree->slotCount = tree->slotsUsed = tree->slotsDeleted = 0;
 	return tree;
 }
 
 
+/* Place the fields the modes of an empty tree add after every node
+ * (a new arena is made for slots of the new size)
+ *
+ * return: 0 - on success, -1 - otherwise (the layout is unchanged)
+ */
+static int layoutNodes(TTree* tree) {
+	size_t size = sizeof(TreeNode), chunksOffset = 0, keyOffset = 0;
+	if (tree->augmented)
+		size += sizeof(NodeSummary);
+	if (tree->dupSize != 0) {
+		chunksOffset = size;
+		size += sizeof(InfoChunk*);
+	}
+	if (tree->keyLength != 0) {
+		keyOffset = size;
+		size += sizeof(uint64_t);
+	}
+	if (tree->arena != NULL) {
+		Arena *arena = createArena(size + ALIGN(tree->elemSize) + tree->infoSize);
+		if (arena == NULL)
+			return -1;
+		destroyArena(tree->arena);
+		tree->arena = arena;
+	}
+	tree->chunksOffset = chunksOffset;
+	tree->keyOffset = keyOffset;
+	tree->nodeSize = size;
+	return 0;
+}
+
+
+/* Make an empty tree allocate its nodes from a slab allocator
+ *
+ * elemSize: if not 0, elements are copied byte by byte inside the node slot
+ *			 (instead of being built with createElement)
+ * infoSize: if not 0, infos are copied byte by byte inside the node slot
+ *			 (instead of being built with createInfo)
+ *
+ * ! Payloads kept in the slot must not own other memory,
+ * they are released together with the node
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeUseArena(TTree* tree, size_t elemSize, size_t infoSize) {
+	if (tree == NULL || tree->root != NULL || tree->arena != NULL)
+		return -1;
+	tree->arena = createArena(tree->nodeSize + ALIGN(elemSize) + infoSize);
+	if (tree->arena == NULL)
+		return -1;
+	tree->elemSize = elemSize;
+	tree->infoSize = infoSize;
+	return 0;
+}
+
+
+/* Make an empty tree keep a summary of every subtree after its nodes:
+ * its number of entries and of tombstones, and its most frequent key
+ *
+ * rank, selectEntry, selectNode and countRange then take O(log n)
+ * instead of walking the list, mostFrequent O(1) and topFrequent
+ * O(k log n); every change updates the summaries on its path
+ * (compacted duplicates and lazy deletes need them and turn them on)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeAugment(TTree* tree) {
+	if (tree == NULL || tree->root != NULL)
+		return -1;
+	if (tree->augmented)
+		return 0;
+	tree->augmented = 1;
+	if (layoutNodes(tree) != 0) {
+		tree->augmented = 0;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Make an empty tree keep its string keys packed after its nodes
+ *
+ * keyLength: number of characters kept from every key (at most 7, so that
+ *			  the packed bytes stay a NUL-terminated string)
+ *
+ * The keys are compared as big-endian 64-bit numbers instead of going
+ * through the compare method, and no element is allocated for them
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeUsePackedKeys(TTree* tree, size_t keyLength) {
+	if (tree == NULL || tree->root != NULL)
+		return -1;
+	if (keyLength == 0 || keyLength >= sizeof(uint64_t))
+		return -1;
+	size_t old = tree->keyLength;
+	tree->keyLength = keyLength;
+	if (layoutNodes(tree) != 0) {
+		tree->keyLength = old;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Make an empty tree keep a single node per distinct key, the infos of
+ * the later occurrences being copied byte by byte into cache-line sized
+ * chunks hung after the node (instead of a full node per occurrence)
+ *
+ * infoSize: bytes of an info (the infos must not own other memory)
+ *
+ * The order of the entries is the same, but only the first occurrence
+ * of a key is a node: cursors (not the list of the nodes) have to be
+ * used to reach the other ones
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeCompactDuplicates(TTree* tree, size_t infoSize) {
+	if (tree == NULL || tree->root != NULL)
+		return -1;
+	if (infoSize == 0 || infoSize > INFO_CHUNK_BYTES - sizeof(InfoChunk))
+		return -1;
+	if (treeAugment(tree) != 0)
+		return -1;
+	size_t old = tree->dupSize;
+	tree->dupSize = infoSize;
+	if (layoutNodes(tree) != 0) {
+		tree->dupSize = old;
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Make a tree delete its keys lazily: when the last occurrence of a key
+ * is deleted, its node stays in the tree as a tombstone (count 0), so
+ * the delete only updates the counts on the path, in O(log n)
+ *
+ * maxRatio: tombstones allowed per entry; above it, every delete also
+ *			 removes LAZY_COMPACT_STEPS tombstones (compactTree can remove
+ *			 them at any other time)
+ *
+ * search, the cursors and the key queries skip the tombstones, an insert
+ * of their key revives them; minimum, maximum, successor and predecessor
+ * still see the shape of the tree, tombstones included
+ * ! the counts come from the summaries (treeAugment): a tree not keeping
+ * them yet has to be empty
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeLazyDelete(TTree* tree, double maxRatio) {
+	if (tree == NULL || maxRatio <= 0)
+		return -1;
+	if (!tree->augmented && treeAugment(tree) != 0)
+		return -1;
+	tree->lazyRatio = maxRatio;
+	return 0;
+}
+
+
+/* Append the info of a new occurrence to the chunks of a node
+ * (of a tree compacting its duplicates; the count is left to the caller)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int appendInfo(TTree* tree, TreeNode* x, void* info) {
+	long capacity = (INFO_CHUNK_BYTES - sizeof(InfoChunk)) / tree->dupSize;
+	InfoChunk **chunks = chunksOf(tree, x);
+	InfoChunk *last = *chunks != NULL ? (*chunks)->prev : NULL;
+	if (last == NULL || last->used == capacity) {
+		InfoChunk *chunk = (InfoChunk*) aligned_alloc(INFO_CHUNK_BYTES, INFO_CHUNK_BYTES);
+		if (chunk == NULL)
+			return -1;
+		chunk->next = NULL;
+		chunk->used = 0;
+		if (last == NULL) {
+			*chunks = chunk;
+		} else
+			last->next = chunk;
+		chunk->prev = last;
+		(*chunks)->prev = chunk;
+		last = chunk;
+	}
+	memcpy(last->infos + last->used * tree->dupSize, info, tree->dupSize);
+	last->used++;
+	return 0;
+}
+
+
+/* Remove the info of the last occurrence from the chunks of a node
+ */
+static void removeLastInfo(TTree* tree, TreeNode* x) {
+	InfoChunk **chunks = chunksOf(tree, x);
+	InfoChunk *last = (*chunks)->prev;
+	if (--last->used > 0)
+		return;
+	if (last == *chunks) {
+		*chunks = NULL;
+	} else {
+		(*chunks)->prev = last->prev;
+		last->prev->next = NULL;
+	}
+	free(last);
+}
+
+
+/* First chunk of a node (NULL - none, or the tree does not compact
+ * its duplicates)
+ */
+static InfoChunk* firstChunk(TTree* tree, TreeNode* x) {
+	return tree->dupSize != 0 ? *chunksOf(tree, x) : NULL;
+}
+
+
+static void destroyChunks(TTree* tree, TreeNode* x) {
+	InfoChunk *chunk = firstChunk(tree, x);
+	while (chunk != NULL) {
+		InfoChunk *temp = chunk;
+		chunk = chunk->next;
+		free(temp);
+	}
+	if (tree->dupSize != 0)
+		*chunksOf(tree, x) = NULL;
+}
+
+
+/* Prepare an element for comparisons with the nodes of a tree
+ */
+TreeKey makeKey(TTree* tree, void* elem) {
+	TreeKey key;
+	key.elem = elem;
+	key.packed = tree->keyLength != 0 ? packKey((char*) elem, tree->keyLength) : 0;
+	return key;
+}
+
+
+/* Check if a node holds entries (a tombstone of a lazy tree does not)
+ */
+static int isLive(TTree* tree, TreeNode* x) {
+	return !tree->augmented || summaryOf(x)->count > 0;
+}
+
+
+/* Check if the elements/infos of the tree are owned by the nodes
+ * and have to be released with destroyElement/destroyInfo
+ */
+static int ownsElements(TTree* tree) {
+	return tree->keyLength == 0 && (tree->arena == NULL || tree->elemSize == 0);
+}
+
+static int ownsInfos(TTree* tree) {
+	return tree->arena == NULL || tree->infoSize == 0;
+}
+
+
+/* Marks the slot of a key removed from the hash index (probes go on) */
+static TreeNode deletedSlot;
+#define HASH_DELETED (&deletedSlot)
+
+
+/* Spread the bits of a hash (finalizer of MurmurHash3), so that
+ * near keys land in distant slots
+ */
+static uint64_t mixHash(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t hashKey(TTree* tree, TreeKey* key) {
+	return mixHash(tree->keyLength != 0 ? key->packed : tree->hash(key->elem));
+}
+
+static uint64_t hashNode(TTree* tree, TreeNode* x) {
+	return mixHash(tree->keyLength != 0 ? loadPackedKey((uint64_t*) x->elem) : tree->hash(x->elem));
+}
+
+
+/* Node of a key, found through the hash index (NULL - not in the tree)
+ */
+static TreeNode* hashFind(TTree* tree, TreeKey* key) {
+	uint64_t h = hashKey(tree, key);
+	size_t mask = tree->slotCount - 1;
+	for (size_t i = h & mask; tree->slots[i].node != NULL; i = (i + 1) & mask) {
+		HashSlot *slot = &tree->slots[i];
+		if (slot->hash != h || slot->node == HASH_DELETED)
+			continue;
+		TREE_COUNT(visits, 1);
+		if (compareKey(tree, key, slot->node) == 0)
+			return slot->node;
+	}
+	return NULL;
+}
+
+
+/* Put a node whose key is not in the index yet in a free slot
+ */
+static void hashPut(TTree* tree, TreeNode* x, uint64_t h) {
+	size_t mask = tree->slotCount - 1, i = h & mask;
+	while (tree->slots[i].node != NULL && tree->slots[i].node != HASH_DELETED)
+		i = (i + 1) & mask;
+	if (tree->slots[i].node == HASH_DELETED)
+		tree->slotsDeleted--;
+	tree->slots[i].hash = h;
+	tree->slots[i].node = x;
+	tree->slotsUsed++;
+}
+
+
+/* Move the nodes of the index to slotCount new slots
+ * (the slots of removed keys are dropped)
+ *
+ * return: 0 - on success, -1 - otherwise (the index is unchanged)
+ */
+static int hashResize(TTree* tree, size_t slotCount) {
+	HashSlot *slots = (HashSlot*) calloc(slotCount, sizeof(HashSlot));
+	if (slots == NULL)
+		return -1;
+	HashSlot *old = tree->slots;
+	size_t oldCount = tree->slotCount;
+	tree->slots = slots;
+	tree->slotCount = slotCount;
+	tree->slotsUsed = tree->slotsDeleted = 0;
+	for (size_t i = 0; i < oldCount; i++)
+		if (old[i].node != NULL && old[i].node != HASH_DELETED)
+			hashPut(tree, old[i].node, old[i].hash);
+	free(old);
+	return 0;
+}
+
+
+/* Make room in the index for one more key
+ * (at most half of the slots are taken, removed keys included)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+static int hashReserve(TTree* tree) {
+	if (tree->slots == NULL || 2 * (tree->slotsUsed + tree->slotsDeleted + 1) <= tree->slotCount)
+		return 0;
+	size_t slotCount = tree->slotCount;
+	if (4 * (tree->slotsUsed + 1) > slotCount)
+		slotCount *= 2;
+	return hashResize(tree, slotCount);
+}
+
+
+/* Add the first node of a new key to the index (room was reserved)
+ */
+static void hashAdd(TTree* tree, TreeNode* x) {
+	if (tree->slots != NULL)
+		hashPut(tree, x, hashNode(tree, x));
+}
+
+
+/* Take the node of a key being removed from the tree out of the index
+ */
+static void hashRemove(TTree* tree, TreeNode* x) {
+	if (tree->slots == NULL)
+		return;
+	size_t mask = tree->slotCount - 1;
+	for (size_t i = hashNode(tree, x) & mask; tree->slots[i].node != NULL; i = (i + 1) & mask)
+		if (tree->slots[i].node == x) {
+			tree->slots[i].node = HASH_DELETED;
+			tree->slotsUsed--;
+			tree->slotsDeleted++;
+			return;
+		}
+}
+
+
+/* Make a tree keep a hash index from every key to its node, so that
+ * search, searchBatch, delete and the duplicate check of insert find a
+ * key in O(1) instead of descending the tree (the ordered operations
+ * still use the tree)
+ *
+ * hash: method hashing an element (equal elements must have equal
+ *		 hashes); NULL for a tree packing its keys, whose packed bytes
+ *		 are hashed
+ *
+ * insert and delete keep the index up to date; the index costs about
+ * 32 bytes per key (at most half of its slots are taken)
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeUseHashIndex(TTree* tree, uint64_t (*hash)(void*)) {
+	if (tree == NULL || tree->slots != NULL || (hash == NULL && tree->keyLength == 0))
+		return -1;
+	tree->hash = hash;
+	tree->slots = (HashSlot*) calloc(HASH_MIN_SLOTS, sizeof(HashSlot));
+	if (tree->slots == NULL)
+		return -1;
+	tree->slotCount = HASH_MIN_SLOTS;
+	return rebuildHashIndex(tree);
+}
+
+
+/* Index again all the keys of a tree whose nodes were linked by other
+ * means than insert and delete (bulk loads, set operations, joins and
+ * splits), in O(n)
+ *
+ * return: 0 - on success (or if the tree has no index),
+ *		   -1 - otherwise (the index is dropped, searches descend the tree)
+ */
+int rebuildHashIndex(TTree* tree) {
+	if (tree == NULL || tree->slots == NULL)
+		return 0;
+	size_t keys = 0, slotCount = HASH_MIN_SLOTS;
+	if (tree->root != NULL)
+		for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next)
+			keys += x->parent != NULL || x == tree->root;
+	while (slotCount < 4 * keys)
+		slotCount *= 2;
+	HashSlot *slots = (HashSlot*) calloc(slotCount, sizeof(HashSlot));
+	free(tree->slots);
+	tree->slots = slots;
+	tree->slotCount = slotCount;
+	tree->slotsUsed = tree->slotsDeleted = 0;
+	if (slots == NULL)
+		return -1;
+	if (tree->root == NULL)
+		return 0;
+	for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next)
+		if (x->parent != NULL || x == tree->root)
+			hashAdd(tree, x);
+	return 0;
+}
+
+
 /* Check if a tree is empty
  * 1 - if the tree is empty
  * 0 - otherwise
  */
 int isEmpty(TTree* tree) {
-	return tree->root == NULL;
+	return tree->root == NULL || (tree->augmented && summaryOf(tree->root)->weight == 0);
 }
 
 
@@ -44,17 +491,489 @@ int isEmpty(TTree* tree) {
  *
  * x: the root of the current tree (in which the search is made)
  * elem: the element to be searched for
+ *
+ * ! A single three-way comparison is made for every visited node
+ * (a tombstone is not found); a search of the whole tree goes through
+ * the hash index, if the tree has one
  */
 TreeNode* search(TTree* tree, TreeNode* x, void* elem) {
-	if (x == NULL)
+	TreeKey key = makeKey(tree, elem);
+	if (tree->slots != NULL && x == tree->root) {
+		x = hashFind(tree, &key);
+		return x != NULL && isLive(tree, x) ? x : NULL;
+	}
+	while (x != NULL) {
+		int c = compareKey(tree, &key, x);
+		TREE_COUNT(visits, 1);
+		if (c == 0)
+			return isLive(tree, x) ? x : NULL;
+		x = c < 0 ? x->left : x->right;
+	}
+	return NULL;
+}
+
+
+
+/* Search for n elements at once
+ *
+ * keys: the elements to be searched for
+ * out: out[i] receives the node found for keys[i] (or NULL)
+ *
+ * The lookups of a group advance in lockstep, one level per round, and
+ * the next node of every lookup is prefetched, so the cache misses of
+ * different lookups overlap instead of being paid one after the other
+ * (with a hash index, every lookup is a search of the index)
+ */
+void searchBatch(TTree* tree, void** keys, long n, TreeNode** out) {
+	if (tree == NULL || keys == NULL || out == NULL)
+		return;
+	if (tree->slots != NULL) {
+		for (long i = 0; i < n; i++)
+			out[i] = search(tree, tree->root, keys[i]);
+		return;
+	}
+	TreeKey key[SEARCH_BATCH_GROUP];
+	TreeNode *x[SEARCH_BATCH_GROUP];
+	for (long base = 0; base < n; base += SEARCH_BATCH_GROUP) {
+		long count = n - base < SEARCH_BATCH_GROUP ? n - base : SEARCH_BATCH_GROUP;
+		for (long i = 0; i < count; i++) {
+			key[i] = makeKey(tree, keys[base + i]);
+			x[i] = tree->root;
+			out[base + i] = NULL;
+		}
+		long active = tree->root != NULL ? count : 0;
+		while (active > 0) {
+			active = 0;
+			for (long i = 0; i < count; i++) {
+				if (x[i] == NULL)
+					continue;
+				int c = compareKey(tree, &key[i], x[i]);
+				TREE_COUNT(visits, 1);
+				if (c == 0) {
+					out[base + i] = isLive(tree, x[i]) ? x[i] : NULL;
+					x[i] = NULL;
+					continue;
+				}
+				x[i] = c < 0 ? x[i]->left : x[i]->right;
+				if (x[i] != NULL) {
+					__builtin_prefetch(x[i]);
+					active++;
+				}
+			}
+		}
+	}
+}
+
+
+
+/* Number of entries in the subtree rooted in x (of an augmented tree)
+ */
+static long weightOf(TreeNode* x) {
+	return x == NULL ? 0 : summaryOf(x)->weight;
+}
+
+
+/* Number of entries with the key of a node (the first node of its key,
+ * 0 for a tombstone), from its summary or counted along its list
+ */
+long countOf(TTree* tree, TreeNode* x) {
+	if (tree->augmented)
+		return summaryOf(x)->count;
+	long count = 1;
+	for (TreeNode *y = x; y != x->end; y = y->next)
+		count++;
+	return count;
+}
+
+
+static TreeNode* boundNode(TTree* tree, TreeKey* key, int inclusive);
+
+/* Count the entries whose key is smaller than the given key
+ * (or equal to it, if inclusive is set) in O(log n)
+ * (in O(n) through the list, if the tree keeps no summaries)
+ */
+static long countBelow(TTree* tree, TreeKey* key, int inclusive) {
+	long below = 0;
+	TreeNode *x = tree->root;
+	if (!tree->augmented) {
+		// every node is an entry: those before the bound are counted
+		TreeNode *bound = boundNode(tree, key, !inclusive);
+		if (bound == NULL)
+			return tree->size;
+		for (x = bound->prev; x != NULL; x = x->prev)
+			below++;
+		return below;
+	}
+	while (x != NULL) {
+		int c = compareKey(tree, key, x);
+		TREE_COUNT(visits, 1);
+		if (c < 0) {
+			x = x->left;
+		} else if (c > 0) {
+			below += weightOf(x->left) + summaryOf(x)->count;
+			x = x->right;
+		} else {
+			below += weightOf(x->left) + (inclusive ? summaryOf(x)->count : 0);
+			break;
+		}
+	}
+	return below;
+}
+
+
+/* Rank of an element: number of entries (duplicates included)
+ * with a smaller key
+ */
+long rank(TTree* tree, void* elem) {
+	if (tree == NULL)
+		return 0;
+	TreeKey key = makeKey(tree, elem);
+	return countBelow(tree, &key, 0);
+}
+
+
+/* Cursor on the k-th entry (from 0) in increasing order, duplicates included
+ *
+ * The node holding the key is reached in O(log n), a duplicate
+ * is then reached through the list (or the chunks) of the node
+ * (a tree keeping no summaries walks its list, in O(k))
+ */
+TreeCursor selectEntry(TTree* tree, long k) {
+	TreeCursor cursor = {tree, NULL, NULL, 0};
+	if (tree == NULL || k < 0 || k >= tree->size)
+		return cursor;
+	TreeNode *x = tree->root;
+	if (!tree->augmented) {
+		for (x = minimum(x); k > 0; k--)
+			x = x->next;
+		cursor.node = x;
+		return cursor;
+	}
+	while (x != NULL) {
+		long leftWeight = weightOf(x->left);
+		if (k < leftWeight) {
+			x = x->left;
+		} else if (k < leftWeight + summaryOf(x)->count) {
+			k -= leftWeight;
+			if (firstChunk(tree, x) != NULL && k > 0) {
+				// The first occurrence is the node, the others are chunked
+				InfoChunk *chunk = firstChunk(tree, x);
+				for (k--; k >= chunk->used; chunk = chunk->next)
+					k -= chunk->used;
+				cursor.chunk = chunk;
+				cursor.slot = k;
+			}
+			for (; k > 0 && cursor.chunk == NULL; k--)
+				x = x->next;
+			cursor.node = x;
+			return cursor;
+		} else {
+			k -= leftWeight + summaryOf(x)->count;
+			x = x->right;
+		}
+	}
+	return cursor;
+}
+
+
+/* Find the k-th entry (from 0) in increasing order, duplicates included
+ * (for a tree compacting its duplicates: the node of its key)
+ */
+TreeNode* selectNode(TTree* tree, long k) {
+	return selectEntry(tree, k).node;
+}
+
+
+/* Number of entries with a key strictly between lo and hi
+ * (the same entries as rangeKeyQuery)
+ */
+long countRange(TTree* tree, void* lo, void* hi) {
+	if (tree == NULL)
+		return 0;
+	TreeKey low = makeKey(tree, lo), high = makeKey(tree, hi);
+	long count = countBelow(tree, &high, 0) - countBelow(tree, &low, 1);
+	return count > 0 ? count : 0;
+}
+
+
+
+/* The first node (in order) among those with the most duplicates, in O(1)
+ * (in O(n), if the tree keeps no summaries)
+ */
+TreeNode* mostFrequent(TTree* tree) {
+	if (tree == NULL || tree->root == NULL)
 		return NULL;
-	else if (tree->compare(x->elem, elem) == 0) 
-		return x;
-	else if (tree->compare(x->elem, elem) == 1) {
-		return search(tree, x->left, elem);
-	} else {
-		return search(tree, x->right, elem);
+	if (tree->augmented)
+		return summaryOf(tree->root)->maxNode;
+	TreeNode *most = NULL;
+	long mostCount = 0;
+	for (TreeNode *x = minimum(tree->root); x != NULL; x = x->end->next) {
+		long count = countOf(tree, x);
+		if (count > mostCount) {
+			most = x;
+			mostCount = count;
+		}
+	}
+	return most;
+}
+
+
+/*
+ * Candidate of topFrequent: either a single node (priority: its count)
+ * or a whole subtree (priority: the greatest count inside it)
+ */
+typedef struct FrequencyItem{
+	TreeNode *node;
+	int subtree;
+}FrequencyItem;
+
+static long itemCount(FrequencyItem* item) {
+	return item->subtree ? summaryOf(item->node)->maxCount : summaryOf(item->node)->count;
+}
+
+/* Check if item a must come out of the heap before item b
+ * (greater count first, then the first key in order)
+ */
+static int itemBefore(TTree* tree, FrequencyItem* a, FrequencyItem* b) {
+	long ca = itemCount(a), cb = itemCount(b);
+	if (ca != cb)
+		return ca > cb;
+	TreeNode *na = a->subtree ? summaryOf(a->node)->maxNode : a->node;
+	TreeNode *nb = b->subtree ? summaryOf(b->node)->maxNode : b->node;
+	if (na != nb)
+		return compareNodes(tree, na, nb) < 0;
+	return !a->subtree;
+}
+
+static void heapPush(TTree* tree, FrequencyItem* heap, long* size, FrequencyItem item) {
+	long i = (*size)++;
+	while (i > 0 && itemBefore(tree, &item, &heap[(i - 1) / 2])) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = item;
+}
+
+static FrequencyItem heapPop(TTree* tree, FrequencyItem* heap, long* size) {
+	FrequencyItem top = heap[0], last = heap[--(*size)];
+	long i = 0;
+	while (2 * i + 1 < *size) {
+		long child = 2 * i + 1;
+		if (child + 1 < *size && itemBefore(tree, &heap[child + 1], &heap[child]))
+			child++;
+		if (!itemBefore(tree, &heap[child], &last))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+	return top;
+}
+
+
+/* Keep the k most frequent keys of a tree without summaries in out,
+ * every key being counted along the list: O(n k)
+ *
+ * return: the number of nodes written in out
+ */
+static long topFrequentList(TTree* tree, long k, TreeNode** out) {
+	long *counts = (long*) malloc(k * sizeof(long)), found = 0;
+	if (counts == NULL)
+		return 0;
+	for (TreeNode *x = minimum(tree->root); x != NULL; x = x->end->next) {
+		long count = countOf(tree, x), i = found < k ? found++ : k;
+		// a later key only passes the keys with fewer occurrences
+		for (; i > 0 && counts[i - 1] < count; i--)
+			if (i < k) {
+				counts[i] = counts[i - 1];
+				out[i] = out[i - 1];
+			}
+		if (i < k) {
+			counts[i] = count;
+			out[i] = x;
+		}
+	}
+	free(counts);
+	return found;
+}
+
+
+/* Find the k keys with the most duplicates (ties in increasing order)
+ *
+ * Subtrees are expanded best-first by their greatest count, so only the
+ * paths leading to the answers are visited: O(k log n) nodes
+ * (O(n k) for a tree keeping no summaries)
+ *
+ * out: receives the first node of every key, most frequent first
+ * return: the number of nodes written in out
+ */
+long topFrequent(TTree* tree, long k, TreeNode** out) {
+	if (tree == NULL || tree->root == NULL || k <= 0 || out == NULL)
+		return 0;
+	if (!tree->augmented)
+		return topFrequentList(tree, k, out);
+	long size = 0, capacity = 64, found = 0;
+	FrequencyItem *heap = (FrequencyItem*) malloc(capacity * sizeof(FrequencyItem));
+	FrequencyItem item = {tree->root, 1};
+	if (heap == NULL)
+		return 0;
+	heapPush(tree, heap, &size, item);
+	while (size > 0 && found < k) {
+		item = heapPop(tree, heap, &size);
+		if (!item.subtree) {
+			if (summaryOf(item.node)->count > 0)
+				out[found++] = item.node;
+			continue;
+		}
+		if (size + 3 > capacity) {
+			FrequencyItem *bigger = (FrequencyItem*) realloc(heap, 2 * capacity * sizeof(FrequencyItem));
+			if (bigger == NULL)
+				break;
+			heap = bigger;
+			capacity *= 2;
+		}
+		TreeNode *x = item.node;
+		FrequencyItem single = {x, 0};
+		heapPush(tree, heap, &size, single);
+		if (x->left != NULL) {
+			FrequencyItem left = {x->left, 1};
+			heapPush(tree, heap, &size, left);
+		}
+		if (x->right != NULL) {
+			FrequencyItem right = {x->right, 1};
+			heapPush(tree, heap, &size, right);
+		}
 	}
+	free(heap);
+	return found;
+}
+
+
+/* Descend towards a key, remembering the last node whose key is
+ * greater than (or, if inclusive, equal to) it
+ */
+static TreeNode* boundNode(TTree* tree, TreeKey* key, int inclusive) {
+	TreeNode *x = tree->root, *bound = NULL;
+	while (x != NULL) {
+		int c = compareKey(tree, key, x);
+		TREE_COUNT(visits, 1);
+		if (c < 0 || (c == 0 && inclusive)) {
+			bound = x;
+			if (c == 0)
+				break;
+			x = x->left;
+		} else
+			x = x->right;
+	}
+	return bound;
+}
+
+
+/* Cursor on the first entry whose key is not smaller than elem
+ */
+TreeCursor lowerBound(TTree* tree, void* elem) {
+	TreeCursor cursor = {tree, NULL, NULL, 0};
+	if (tree != NULL) {
+		TreeKey key = makeKey(tree, elem);
+		cursor = cursorAt(tree, boundNode(tree, &key, 1));
+	}
+	return cursor;
+}
+
+
+/* Cursor on the first entry whose key is greater than elem
+ */
+TreeCursor upperBound(TTree* tree, void* elem) {
+	TreeCursor cursor = {tree, NULL, NULL, 0};
+	if (tree != NULL) {
+		TreeKey key = makeKey(tree, elem);
+		cursor = cursorAt(tree, boundNode(tree, &key, 0));
+	}
+	return cursor;
+}
+
+
+/* Cursor on the first occurrence of the key of a node
+ * (or of the next key, if the node is a tombstone)
+ */
+TreeCursor cursorAt(TTree* tree, TreeNode* node) {
+	while (node != NULL && !isLive(tree, node))
+		node = node->next;
+	TreeCursor cursor = {tree, node, NULL, 0};
+	return cursor;
+}
+
+
+/* Check if a cursor is on an entry
+ */
+int cursorValid(TreeCursor* cursor) {
+	return cursor != NULL && cursor->node != NULL;
+}
+
+
+/* Move a cursor to the next/previous entry (duplicates included,
+ * tombstones skipped)
+ *
+ * return: 1 - if the cursor is still on an entry, 0 - otherwise
+ */
+int cursorNext(TreeCursor* cursor) {
+	if (!cursorValid(cursor))
+		return 0;
+	if (cursor->chunk == NULL && firstChunk(cursor->tree, cursor->node) != NULL) {
+		cursor->chunk = firstChunk(cursor->tree, cursor->node);
+		cursor->slot = 0;
+		return 1;
+	}
+	if (cursor->chunk != NULL) {
+		if (++cursor->slot < cursor->chunk->used)
+			return 1;
+		cursor->chunk = cursor->chunk->next;
+		cursor->slot = 0;
+		if (cursor->chunk != NULL)
+			return 1;
+	}
+	do
+		cursor->node = cursor->node->next;
+	while (cursor->node != NULL && !isLive(cursor->tree, cursor->node));
+	return cursor->node != NULL;
+}
+
+int cursorPrev(TreeCursor* cursor) {
+	if (!cursorValid(cursor))
+		return 0;
+	if (cursor->chunk != NULL) {
+		if (--cursor->slot >= 0)
+			return 1;
+		// The first chunk is preceded by the node itself
+		cursor->chunk = cursor->chunk == firstChunk(cursor->tree, cursor->node) ?
+						NULL : cursor->chunk->prev;
+		if (cursor->chunk != NULL)
+			cursor->slot = cursor->chunk->used - 1;
+		return 1;
+	}
+	do
+		cursor->node = cursor->node->prev;
+	while (cursor->node != NULL && !isLive(cursor->tree, cursor->node));
+	if (cursor->node != NULL && firstChunk(cursor->tree, cursor->node) != NULL) {
+		cursor->chunk = firstChunk(cursor->tree, cursor->node)->prev;
+		cursor->slot = cursor->chunk->used - 1;
+	}
+	return cursor->node != NULL;
+}
+
+
+/* Element and information of the entry under a cursor
+ */
+void* cursorElem(TreeCursor* cursor) {
+	return cursorValid(cursor) ? cursor->node->elem : NULL;
+}
+
+void* cursorInfo(TreeCursor* cursor) {
+	if (!cursorValid(cursor))
+		return NULL;
+	if (cursor->chunk != NULL)
+		return cursor->chunk->infos + cursor->slot * cursor->tree->dupSize;
+	return cursor->node->info;
 }
 
 
@@ -142,6 +1061,45 @@ void updateHeight(TreeNode* x) {
 }
 
 
+/* Updates the summary of a node from those of its children: the number
+ * of entries in its subtree, the most frequent key of the subtree (the
+ * first one in order, if there are more) and the number of tombstones
+ */
+static void updateSummary(TreeNode* x) {
+	NodeSummary *s = summaryOf(x);
+	s->weight = s->maxCount = s->count;
+	s->maxNode = x;
+	s->dead = s->count == 0;
+	if (x->left != NULL) {
+		NodeSummary *l = summaryOf(x->left);
+		s->weight += l->weight;
+		s->dead += l->dead;
+		if (l->maxCount >= s->maxCount) {
+			s->maxCount = l->maxCount;
+			s->maxNode = l->maxNode;
+		}
+	}
+	if (x->right != NULL) {
+		NodeSummary *r = summaryOf(x->right);
+		s->weight += r->weight;
+		s->dead += r->dead;
+		if (r->maxCount > s->maxCount) {
+			s->maxCount = r->maxCount;
+			s->maxNode = r->maxNode;
+		}
+	}
+}
+
+
+/* Updates the height of a node (and its summary, if the tree is augmented)
+ */
+void updateNode(TTree* tree, TreeNode* x) {
+	updateHeight(x);
+	if (x != NULL && tree->augmented)
+		updateSummary(x);
+}
+
+
 /* Function that receives the address of a tree and
  * of a node x and performs a rotation to the left
  * of the subtree whose vertex is x
@@ -174,8 +1132,8 @@ void avlRotateLeft(TTree* tree, TreeNode* x) {
 		y->parent = x->parent;
 	}
 	x->parent = y;
-	updateHeight(x);
-	updateHeight(y);
+	updateNode(tree, x);
+	updateNode(tree, y);
 }
 
 
@@ -211,8 +1169,8 @@ void avlRotateRight(TTree* tree, TreeNode* y) {
 		x->parent = y->parent;
 	}
 	y->parent = x;
-	updateHeight(x);
-	updateHeight(y);
+	updateNode(tree, x);
+	updateNode(tree, y);
 }
 
 
@@ -243,20 +1201,24 @@ int avlGetBalance(TreeNode *x) {
  */
 void avlFixUp(TTree* tree, TreeNode* y) {
 	while (y != NULL) {
-		updateHeight(y);
+		updateNode(tree, y);
 		int balance = avlGetBalance(y);
 		int balance_right = avlGetBalance(y->right);
 		int balance_left = avlGetBalance(y->left);
-		if (balance > 1 && balance_left == 1) 
+		if (balance > 1 && balance_left == 1) {
 			avlRotateRight(tree, y);
-		else if (balance < -1 && balance_right == -1)
+			TREE_COUNT(singleRotations, 1);
+		} else if (balance < -1 && balance_right == -1) {
 			avlRotateLeft(tree, y);
-		else if (balance > 1 && balance_left == -1) {
+			TREE_COUNT(singleRotations, 1);
+		} else if (balance > 1 && balance_left == -1) {
 			avlRotateLeft(tree, y->left);
 			avlRotateRight(tree, y);
+			TREE_COUNT(doubleRotations, 1);
 		} else if (balance < -1 && balance_right == 1) {
 			avlRotateRight(tree, y->right);
 			avlRotateLeft(tree, y);
+			TREE_COUNT(doubleRotations, 1);
 		}
 		y = y->parent;
 	}
@@ -274,12 +1236,39 @@ TreeNode* createTreeNode(TTree *tree, void* value, void* info) {
 	if (tree == NULL)
 		return NULL;
 
-	// Alocate memory
-	TreeNode* node = (TreeNode*) malloc(sizeof(TreeNode));
+	TreeNode* node;
+	if (tree->arena != NULL) {
+		// Node, element and info share one slot of the arena
+		node = (TreeNode*) arenaAlloc(tree->arena);
+		if (node == NULL)
+			return NULL;
+		char *payload = (char*) node + tree->nodeSize;
+
+		if (tree->keyLength != 0) {
+			node->elem = NULL;
+		} else if (tree->elemSize != 0) {
+			node->elem = memcpy(payload, value, tree->elemSize);
+		} else
+			node->elem = tree->createElement(value);
+
+		if (tree->infoSize != 0) {
+			node->info = memcpy(payload + ALIGN(tree->elemSize), info, tree->infoSize);
+		} else
+			node->info = tree->createInfo(info);
+	} else {
+		// Alocate memory
+		node = (TreeNode*) malloc(tree->nodeSize);
+
+		// Set element and info
+		node->elem = tree->keyLength == 0 ? tree->createElement(value) : NULL;
+		node->info = tree->createInfo(info);
+	}
 
-	// Set element and info
-	node->elem = tree->createElement(value);
-	node->info = tree->createInfo(info);
+	// Packed keys live right after the node
+	if (tree->keyLength != 0) {
+		node->elem = memset((char*) node + tree->keyOffset, 0, sizeof(uint64_t));
+		strncpy((char*) node->elem, (char*) value, tree->keyLength);
+	}
 
 
 	//Initialize the links in the tree
@@ -294,61 +1283,368 @@ TreeNode* createTreeNode(TTree *tree, void* value, void* info) {
     // Height of NULL is 0
 	node->height = 1;
 
+	// A single entry
+	if (tree->augmented) {
+		NodeSummary *summary = summaryOf(node);
+		summary->count = summary->weight = summary->maxCount = 1;
+		summary->maxNode = node;
+		summary->dead = 0;
+	}
+	if (tree->dupSize != 0)
+		*chunksOf(tree, node) = NULL;
+
 	return node;
 }
 
+/* Add delta entries to the key of a node and update the summaries on
+ * the path to the root (the shape does not change; nothing to do if the
+ * tree keeps no summaries)
+ */
+static void addEntries(TTree* tree, TreeNode* x, long delta) {
+	if (!tree->augmented)
+		return;
+	summaryOf(x)->count += delta;
+	for (; x != NULL; x = x->parent)
+		updateSummary(x);
+}
+
+
+/* Remember the height of the tree, if it is the greatest so far
+ */
+static void noteHeight(TTree* tree) {
+	if (tree->root != NULL && tree->root->height > tree->maxHeight)
+		tree->maxHeight = tree->root->height;
+}
+
+
 /* Inserting a new node in the multi-dictionary
  * ! After the addition, the tree must be balanced
  *
+ * The descent makes one three-way comparison per level and stops on the
+ * first node with the same key, so duplicates need no second search
+ * (with a hash index, the node of a known key is found without descent)
  */
 void insert(TTree* tree, void* elem, void* info) {
+	TreeKey key = makeKey(tree, elem);
 	TreeNode *x = tree->root;
-	TreeNode *y = NULL;
-	TreeNode *newNode = createTreeNode(tree, elem, info);
+	TreeNode *y = tree->slots != NULL ? hashFind(tree, &key) : NULL;
+	int c = 0;
+	if (y != NULL)
+		x = NULL;
 	while (x != NULL) {
 		y = x;
-		if (tree->compare(elem, x->elem) == -1) 
-			x = x->left;
-		else if (tree->compare(elem, x->elem) == 1)
-			x = x->right;
-		else 
+		c = compareKey(tree, &key, x);
+		TREE_COUNT(visits, 1);
+		if (c == 0)
 			break;
+		x = c < 0 ? x->left : x->right;
+	}
+	if (y != NULL && c == 0 && !isLive(tree, y)) {
+		// Tombstone of the key: it takes the info and lives again
+		if (ownsInfos(tree)) {
+			tree->destroyInfo(y->info);
+			y->info = tree->createInfo(info);
+		} else
+			memcpy(y->info, info, tree->infoSize);
+		tree->size++;
+		addEntries(tree, y, 1);
+		return;
+	}
+	if (y != NULL && c == 0 && tree->dupSize != 0) {
+		// Duplicate of a compacting tree: only its info is kept
+		if (appendInfo(tree, y, info) != 0)
+			return;
+		tree->size++;
+		addEntries(tree, y, 1);
+		return;
 	}
+	int fresh = y == NULL || c != 0;
+	if (fresh && hashReserve(tree) != 0)
+		return;
+	TreeNode *newNode = createTreeNode(tree, elem, info);
+	if (newNode == NULL)
+		return;
+	if (fresh)
+		hashAdd(tree, newNode);
 	tree->size++;
-	if (tree->root == NULL) {
+	if (y == NULL) {
 		tree->root = newNode;
 		newNode->end = newNode;
+		return;
+	}
+	if (c == 0) {
+		// Duplicate: appended to the list of y, the shape does not change
+		TreeNode *current_end = y->end;
+		newNode->prev = current_end;
+		newNode->next = current_end->next;
+		current_end->next = newNode;
+		if (newNode->next != NULL)
+			newNode->next->prev = newNode;
+		y->end = newNode;
+		addEntries(tree, y, 1);
+		return;
+	}
+	newNode->parent = y;
+	newNode->end = newNode;
+	if (c > 0) {
+		y->right = newNode;
+		newNode->prev = y->end;
+		newNode->next = y->end->next;
+		y->end->next = newNode;
+		if (newNode->next != NULL)
+			newNode->next->prev = newNode;
 	} else {
-		TreeNode *duplicate_node = search(tree, tree->root, elem);
-		if (tree->compare(elem, y->elem) == 1) {
-			newNode->parent = y;
-			y->right = newNode;
-			newNode->prev = y->end;
-			newNode->next = y->end->next;
-			y->end->next = newNode;
-			newNode->end = newNode;
-			if (newNode->next != NULL)
-				newNode->next->prev = newNode;
-		} else if (tree->compare(elem, y->elem) == -1) {
-			newNode->parent = y;
-			y->left = newNode;
-			newNode->next = y;
-			newNode->prev = y->prev;
-			y->prev = newNode;
-			newNode->end = newNode;
-			if (newNode->prev != NULL)
-				newNode->prev->next = newNode;
-		} else if (duplicate_node != NULL) {
-			TreeNode *current_end = duplicate_node->end;
-			newNode->prev = current_end;
-			newNode->next = current_end->next;
-			current_end->next = newNode;
-			if (newNode->next != NULL)
-				newNode->next->prev = newNode;
-			duplicate_node->end = newNode;
-		}
+		y->left = newNode;
+		newNode->next = y;
+		newNode->prev = y->prev;
+		y->prev = newNode;
+		if (newNode->prev != NULL)
+			newNode->prev->next = newNode;
 	}
 	avlFixUp(tree, y);
+	noteHeight(tree);
+}
+
+
+/* Link the heads[lo..hi] (already threaded in order) into a perfectly
+ * balanced subtree
+ *
+ * return: the root of the subtree
+ */
+static TreeNode* buildBalanced(TTree* tree, TreeNode** heads, long lo, long hi, TreeNode* parent) {
+	if (lo > hi)
+		return NULL;
+	long mid = lo + (hi - lo) / 2;
+	TreeNode *x = heads[mid];
+	x->parent = parent;
+	x->left = buildBalanced(tree, heads, lo, mid - 1, x);
+	x->right = buildBalanced(tree, heads, mid + 1, hi, x);
+	updateNode(tree, x);
+	return x;
+}
+
+
+/* Build the tree from n pairs sorted by element, in O(n) and
+ * without rotations
+ *
+ * Equal elements must be consecutive, they form the list of duplicates
+ * of their first occurrence (in the given order)
+ * ! If the tree is not empty, the pairs are inserted one by one
+ *
+ * return: 0 - on success, -1 - if the elements are not sorted
+ */
+int bulkLoadSorted(TTree* tree, void** elems, void** infos, long n) {
+	if (tree == NULL || (n > 0 && (elems == NULL || infos == NULL)))
+		return -1;
+	if (tree->root != NULL) {
+		for (long i = 0; i < n; i++)
+			insert(tree, elems[i], infos[i]);
+		return 0;
+	}
+	if (n == 0)
+		return 0;
+	TreeNode **heads = (TreeNode**) malloc(n * sizeof(TreeNode*));
+	if (heads == NULL)
+		return -1;
+
+	// One sequential pass: create the nodes, thread them and
+	// remember the first node of every distinct element
+	TreeNode *prev = NULL, *head = NULL;
+	long distinct = 0, i;
+	for (i = 0; i < n; i++) {
+		TreeKey key = makeKey(tree, elems[i]);
+		int c = head != NULL ? -compareKey(tree, &key, head) : -1;
+		if (c > 0)
+			break;
+		if (c == 0 && tree->dupSize != 0) {
+			if (appendInfo(tree, head, infos[i]) != 0)
+				break;
+			summaryOf(head)->count++;
+			continue;
+		}
+		TreeNode *node = createTreeNode(tree, elems[i], infos[i]);
+		if (node == NULL)
+			break;
+		node->prev = prev;
+		if (prev != NULL)
+			prev->next = node;
+		if (c < 0) {
+			head = heads[distinct++] = node;
+			node->end = node;
+		} else {
+			head->end = node;
+			if (tree->augmented)
+				summaryOf(head)->count++;
+		}
+		prev = node;
+	}
+	if (i < n) {
+		// Unsorted input (or out of memory): nothing is kept
+		while (prev != NULL) {
+			TreeNode *temp = prev;
+			prev = prev->prev;
+			destroyTreeNode(tree, temp);
+		}
+		free(heads);
+		return -1;
+	}
+
+	tree->root = buildBalanced(tree, heads, 0, distinct - 1, NULL);
+	tree->size += n;
+	noteHeight(tree);
+	free(heads);
+	return rebuildHashIndex(tree);
+}
+
+
+/* Stable order of a batch of elements: LSD radix sort on the packed
+ * keys (only on the bytes they use), merge sort with compare otherwise
+ *
+ * return: the indices of the elements in order or NULL
+ */
+static long* sortBatch(TTree* tree, void** elems, long n) {
+	long *order = (long*) malloc(n * sizeof(long));
+	long *temp = (long*) malloc(n * sizeof(long));
+	uint64_t *keys = tree->keyLength != 0 ? (uint64_t*) malloc(n * sizeof(uint64_t)) : NULL;
+	if (order == NULL || temp == NULL || (tree->keyLength != 0 && keys == NULL)) {
+		free(order);
+		free(temp);
+		free(keys);
+		return NULL;
+	}
+	for (long i = 0; i < n; i++)
+		order[i] = i;
+	if (tree->keyLength != 0) {
+		for (long i = 0; i < n; i++)
+			keys[i] = packKey((char*) elems[i], tree->keyLength);
+		// the characters are the most significant bytes of a packed key
+		for (int shift = 64 - 8 * tree->keyLength; shift < 64; shift += 8) {
+			long count[257] = {0};
+			for (long i = 0; i < n; i++)
+				count[((keys[order[i]] >> shift) & 0xff) + 1]++;
+			for (int b = 0; b < 256; b++)
+				count[b + 1] += count[b];
+			for (long i = 0; i < n; i++)
+				temp[count[(keys[order[i]] >> shift) & 0xff]++] = order[i];
+			long *swap = order;
+			order = temp;
+			temp = swap;
+		}
+	} else {
+		for (long width = 1; width < n; width *= 2) {
+			for (long lo = 0; lo < n; lo += 2 * width) {
+				long mid = lo + width < n ? lo + width : n;
+				long hi = lo + 2 * width < n ? lo + 2 * width : n;
+				long a = lo, b = mid, k = lo;
+				while (a < mid && b < hi)
+					temp[k++] = tree->compare(elems[order[a]], elems[order[b]]) <= 0 ?
+								order[a++] : order[b++];
+				while (a < mid)
+					temp[k++] = order[a++];
+				while (b < hi)
+					temp[k++] = order[b++];
+			}
+			long *swap = order;
+			order = temp;
+			temp = swap;
+		}
+	}
+	free(temp);
+	free(keys);
+	return order;
+}
+
+
+/* Insert n pairs at once (the batch does not have to be sorted)
+ *
+ * The batch is sorted, then merged with the list of the tree in a single
+ * pass that reuses the nodes of the tree (and drops its tombstones), and
+ * the tree is rebuilt perfectly balanced, in O(size + n) and without
+ * rotations; a batch that is small next to the tree is inserted in key
+ * order instead
+ *
+ * Equal elements keep their order: the duplicates of a key come after
+ * its occurrences already in the tree, as after n calls to insert
+ *
+ * return: 0 - on success, -1 - if some pairs could not be inserted
+ */
+int insertBatch(TTree* tree, void** elems, void** infos, long n) {
+	if (tree == NULL || (n > 0 && (elems == NULL || infos == NULL)))
+		return -1;
+	if (n == 0)
+		return 0;
+	long *order = sortBatch(tree, elems, n);
+	if (order == NULL)
+		return -1;
+	long size = tree->size;
+	if (n * (64 - __builtin_clzl(size + 1)) < size) {
+		for (long i = 0; i < n; i++)
+			insert(tree, elems[order[i]], infos[order[i]]);
+		free(order);
+		return 0;
+	}
+	long dead = tree->augmented && tree->root != NULL ? summaryOf(tree->root)->dead : 0;
+	long capacity = size + dead + n;
+	TreeNode **heads = (TreeNode**) malloc(capacity * sizeof(TreeNode*));
+	if (heads == NULL) {
+		free(order);
+		return -1;
+	}
+
+	TreeNode *x = tree->root != NULL ? minimum(tree->root) : NULL;
+	TreeNode *prev = NULL, *head = NULL;
+	long i = 0, distinct = 0, added = 0;
+	TreeKey next = makeKey(tree, elems[order[0]]);
+	while (x != NULL || i < n) {
+		TreeNode *node;
+		int fresh = x == NULL || (i < n && compareKey(tree, &next, x) < 0);
+		if (!fresh) {
+			// The occurrences already in the tree come first
+			node = x;
+			x = x->next;
+			if (!isLive(tree, node)) {
+				destroyTreeNode(tree, node);
+				continue;
+			}
+		} else {
+			TreeKey key = next;
+			void *info = infos[order[i++]];
+			if (i < n)
+				next = makeKey(tree, elems[order[i]]);
+			if (head != NULL && tree->dupSize != 0 && compareKey(tree, &key, head) == 0) {
+				if (appendInfo(tree, head, info) == 0) {
+					summaryOf(head)->count++;
+					added++;
+				}
+				continue;
+			}
+			node = createTreeNode(tree, key.elem, info);
+			if (node == NULL)
+				continue;
+			added++;
+		}
+		node->prev = prev;
+		if (prev != NULL)
+			prev->next = node;
+		prev = node;
+		if (head != NULL && compareNodes(tree, head, node) == 0) {
+			head->end = node;
+			if (tree->augmented)
+				summaryOf(head)->count += fresh;
+		} else {
+			head = heads[distinct++] = node;
+			node->end = node;
+		}
+	}
+	if (prev != NULL)
+		prev->next = NULL;
+
+	tree->root = buildBalanced(tree, heads, 0, distinct - 1, NULL);
+	tree->size += added;
+	noteHeight(tree);
+	free(heads);
+	free(order);
+	return rebuildHashIndex(tree) == 0 && added == n ? 0 : -1;
 }
 
 
@@ -362,129 +1658,168 @@ void destroyTreeNode(TTree *tree, TreeNode* node){
 	// check if the tree or the node is NULL
 	if(tree == NULL || node == NULL) return;
 
+	destroyChunks(tree, node);
+
+	if (tree->arena != NULL) {
+		// Only the payloads that live outside the slot are destroyed
+		if (ownsElements(tree))
+			tree->destroyElement(node->elem);
+		if (ownsInfos(tree))
+			tree->destroyInfo(node->info);
+		arenaFree(tree->arena, node);
+		return;
+	}
 
     // Using tree methods
     // to deallocate node fields
-	tree->destroyElement(node->elem);
+	if (ownsElements(tree))
+		tree->destroyElement(node->elem);
 	tree->destroyInfo(node->info);
 
 	// free memory
 	free(node);
 }
 
+/* Function for rebalancing an AVL tree after a deletion
+ * (the children of an unbalanced node may be perfectly balanced,
+ * in which case a single rotation is enough)
+ */
 void avlDeleteFixUp(TTree* tree, TreeNode* y) {
 	while (y != NULL) { 
-		updateHeight(y);
+		updateNode(tree, y);
 		int balance = avlGetBalance(y);
 		int balance_right = avlGetBalance(y->right);
 		int balance_left = avlGetBalance(y->left);
-		if (balance > 1 && balance_left >= 0) 
+		if (balance > 1 && balance_left >= 0) {
 			avlRotateRight(tree, y);
-		else if (balance < -1 && balance_right <= 0)
+			TREE_COUNT(singleRotations, 1);
+		} else if (balance < -1 && balance_right <= 0) {
 			avlRotateLeft(tree, y);
-		else if (balance > 1 && balance_left < 0) {
+			TREE_COUNT(singleRotations, 1);
+		} else if (balance > 1 && balance_left < 0) {
 			avlRotateLeft(tree, y->left);
 			avlRotateRight(tree, y);
+			TREE_COUNT(doubleRotations, 1);
 		} else if (balance < -1 && balance_right > 0) {
 			avlRotateRight(tree, y->right);
 			avlRotateLeft(tree, y);
+			TREE_COUNT(doubleRotations, 1);
 		}
 		y = y->parent;
 	}
 }
 
+/* Put the subtree rooted in y in the place of the subtree rooted in x
+ */
+static void replaceSubtree(TTree* tree, TreeNode* x, TreeNode* y) {
+	if (x->parent == NULL)
+		tree->root = y;
+	else if (x->parent->left == x)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	if (y != NULL)
+		y->parent = x->parent;
+}
+
+
+/* Unlink a node without duplicates from the list and from the tree,
+ * then rebalance the tree
+ */
+static void removeNode(TTree* tree, TreeNode* current) {
+	TreeNode *fix;
+
+	// Unlink the node from the list
+	if (current->prev != NULL)
+		current->prev->next = current->next;
+	if (current->next != NULL)
+		current->next->prev = current->prev;
+
+	if (current->left == NULL || current->right == NULL) {
+		fix = current->parent;
+		replaceSubtree(tree, current, current->left != NULL ? current->left : current->right);
+	} else {
+		// Splice the successor in the place of the node
+		TreeNode *succ = minimum(current->right);
+		if (succ->parent != current) {
+			fix = succ->parent;
+			replaceSubtree(tree, succ, succ->right);
+			succ->right = current->right;
+			succ->right->parent = succ;
+		} else
+			fix = succ;
+		replaceSubtree(tree, current, succ);
+		succ->left = current->left;
+		succ->left->parent = succ;
+	}
+	hashRemove(tree, current);
+	destroyTreeNode(tree, current);
+	avlDeleteFixUp(tree, fix);
+}
+
+
+/* Remove at most budget tombstones (all of them, if budget < 0) from the
+ * tree; each one is found in O(log n) by following the subtrees that
+ * still have tombstones, then unlinked and rebalanced like a delete
+ *
+ * Run between the deletes of a lazy tree (e.g. by a background job
+ * holding the lock of the writers), it keeps their latency flat
+ *
+ * return: the number of tombstones removed
+ */
+long compactTree(TTree* tree, long budget) {
+	long removed = 0;
+	while (tree != NULL && tree->augmented && tree->root != NULL &&
+		   summaryOf(tree->root)->dead > 0 && (budget < 0 || removed < budget)) {
+		TreeNode *x = tree->root;
+		while (summaryOf(x)->count != 0)
+			x = x->left != NULL && summaryOf(x->left)->dead > 0 ? x->left : x->right;
+		removeNode(tree, x);
+		removed++;
+	}
+	return removed;
+}
+
+
 /* Remove a node from the tree
  *
  * elem: the key of the node to be deleted
  * ! If there are duplicate keys
  * the last node in the list of duplicates will be deleted
+ * (in a lazy tree, the last occurrence of a key leaves a tombstone)
  */
 void delete(TTree* tree, void* elem) {
 	if (tree == NULL || tree->root == NULL) 
 		return;
-	if (tree->root->left == NULL && tree->root->right == NULL) {
-		destroyTreeNode(tree, tree->root);
-		tree->root = NULL;
-		tree->size--;
+	TreeNode *current = search(tree, tree->root, elem);
+	if (current == NULL)
 		return;
-	}
-	TreeNode *current = search(tree, tree->root, elem), *prev_curr = NULL;
-	if (current)
-		prev_curr = current->parent;
-	else
+	tree->size--;
+	if (firstChunk(tree, current) != NULL) {
+		removeLastInfo(tree, current);
+		addEntries(tree, current, -1);
 		return;
-	if (current->next != NULL && tree->compare(current->elem, current->next->elem) == 0) {
+	}
+	if (current->next != NULL && compareNodes(tree, current, current->next) == 0) {
 		TreeNode *current_end = current->end;
 		if (current_end->next != NULL) 
 			current_end->next->prev = current_end->prev;
 		current_end->prev->next = current_end->next;
 		current->end = current_end->prev;
 		destroyTreeNode(tree, current_end);
-	} else if (current->left == NULL && current->right == NULL) {
-		if (current == prev_curr->left) {
-			prev_curr->left = NULL;
-			prev_curr->prev = current->prev;
-			if (current->prev != NULL) 
-				current->prev->next = prev_curr;
-		} else if (prev_curr->right == current) {
-			prev_curr->right  = NULL;
-			prev_curr->next = current->next;
-			if (current->next != NULL) 
-				current->next->prev = prev_curr;
-		}
-		destroyTreeNode(tree, current);
-	} else if (current->left == NULL && current->right != NULL) {
-		TreeNode *new_current = NULL;
-		new_current = current->right;
-		new_current->parent = prev_curr;
-		new_current->prev = current->prev;
-		if (current->prev != NULL) 
-			current->prev->next = new_current;
-		if (prev_curr == NULL)
-			tree->root = new_current;
-		if (current == prev_curr->left)
-			prev_curr->left = new_current;
-		else
-			prev_curr->right = new_current;
-		destroyTreeNode(tree, current);
-	} else if (current->left != NULL && current->right == NULL) {
-		TreeNode *new_current = NULL;
-		new_current = current->left;
-		new_current->parent = prev_curr;
-		new_current->end->next = current->next;
-		if (current->next != NULL)
-			current->next->prev = new_current->end;
-		if (prev_curr == NULL)
-			tree->root = new_current;
-		if (current == prev_curr->left)
-			prev_curr->left = new_current;
-		else
-			prev_curr->right = new_current;
-		destroyTreeNode(tree, current);
-	} else {
-		TreeNode *succ = successor(current);
-		TreeNode *prev_succ = succ->parent;
-		if (succ == prev_succ->right)
-			prev_succ->right = succ->right;
-		else 
-			prev_succ->left = succ->left;
-		if (current == tree->root)
-			tree->root = succ;
-		if (current->left != NULL)
-			current->left->parent = succ;
-		if (current->right != NULL)
-			current->right->parent = succ;
-		succ->parent = current->parent;
-		succ->left = current->left;
-		succ->right = current->right;
-		if (current->prev != NULL)
-			current->prev->next = succ;
-		succ->prev = current->prev;
-		destroyTreeNode(tree, current);
+
+		// The shape does not change, only the counts on the path
+		addEntries(tree, current, -1);
+		return;
 	}
-	tree->size--;
-	if (prev_curr != NULL)
-		avlDeleteFixUp(tree, prev_curr);
+
+	if (tree->lazyRatio == 0) {
+		removeNode(tree, current);
+		return;
+	}
+	addEntries(tree, current, -1);
+	if (summaryOf(tree->root)->dead > tree->lazyRatio * tree->size)
+		compactTree(tree, LAZY_COMPACT_STEPS);
 }
 
 
@@ -496,8 +1831,31 @@ void destroyTree(TTree* tree){
     /* Doubly linked list can be used
     * to release memory
     */
-	if (tree == NULL || tree->root == NULL)
+	if (tree == NULL)
+		return;
+	if (tree->arena != NULL) {
+		// The nodes only have to be visited if they own payloads
+		if (tree->root != NULL && (ownsElements(tree) || ownsInfos(tree) || tree->dupSize != 0)) {
+			TreeNode *node = minimum(tree->root);
+			while (node != NULL) {
+				destroyChunks(tree, node);
+				if (ownsElements(tree))
+					tree->destroyElement(node->elem);
+				if (ownsInfos(tree))
+					tree->destroyInfo(node->info);
+				node = node->next;
+			}
+		}
+		destroyArena(tree->arena);
+		free(tree->slots);
+		free(tree);
 		return;
+	}
+	free(tree->slots);
+	if (tree->root == NULL) {
+		free(tree);
+		return;
+	}
 	TreeNode *node = minimum(tree->root);
 	while(node != NULL) {	
 		TreeNode *temp = node;
@@ -508,4 +1866,68 @@ void destroyTree(TTree* tree){
 	if (tree) 
 		free(tree);
 	return;
-}
\ No newline at end of file
+}
+
+
+/* Bytes of a block from malloc (0 - none): those malloc reserved for
+ * it with glibc, the requested ones elsewhere
+ */
+static size_t blockBytes(void* block, size_t requested) {
+	if (block == NULL)
+		return 0;
+#ifdef __GLIBC__
+	(void) requested;
+	return malloc_usable_size(block);
+#else
+	return requested;
+#endif
+}
+
+
+/* Shape and memory of a tree, in O(n) (every node is visited), with
+ * the operation counters of the calling thread
+ *
+ * ! The bytes of the payloads are those malloc reserved for them,
+ * so createElement and createInfo are expected to use malloc (without
+ * glibc only the sizes known to the tree are counted)
+ */
+TreeStats getTreeStats(TTree* tree) {
+	TreeStats stats;
+	memset(&stats, 0, sizeof(TreeStats));
+	stats.counters = treeCounters;
+	if (tree == NULL)
+		return stats;
+	stats.entries = tree->size;
+	if (tree->arena != NULL)
+		stats.nodeBytes = arenaBytes(tree->arena);
+	stats.indexBytes = tree->slotCount * sizeof(HashSlot);
+	if (tree->root == NULL)
+		return stats;
+	stats.height = tree->root->height;
+	stats.maxHeight = MAX(tree->maxHeight, stats.height);
+	for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next) {
+		if (tree->arena == NULL)
+			stats.nodeBytes += blockBytes(x, tree->nodeSize);
+		if (ownsElements(tree))
+			stats.elemBytes += blockBytes(x->elem, tree->elemSize);
+		if (ownsInfos(tree))
+			stats.infoBytes += blockBytes(x->info, tree->infoSize);
+		if (x->parent != NULL || x == tree->root) {
+			long count = countOf(tree, x);
+			stats.keys += count > 0;
+			stats.tombstones += count == 0;
+			stats.longestChain = MAX(stats.longestChain, count);
+		}
+		for (InfoChunk *chunk = firstChunk(tree, x); chunk != NULL; chunk = chunk->next)
+			stats.infoBytes += blockBytes(chunk, INFO_CHUNK_BYTES);
+	}
+	stats.meanChain = stats.keys > 0 ? (double) stats.entries / stats.keys : 0;
+	return stats;
+}
+
+
+/* Start the operation counters of the calling thread again from 0
+ */
+void resetTreeCounters(void) {
+	memset(&treeCounters, 0, sizeof(TreeCounters));
+}
@@ -2,6 +2,82 @@
 #define TREEMAP_H_
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Arena.h"
+
+/* Number of lookups advanced together by searchBatch */
+#define SEARCH_BATCH_GROUP 16
+
+/* Tombstones removed by a delete once a lazy tree has too many */
+#define LAZY_COMPACT_STEPS 2
+
+/* Slots of a new hash index (always a power of 2) */
+#define HASH_MIN_SLOTS 16
+
+/* Bytes of a chunk of duplicate infos (one cache line) */
+#define INFO_CHUNK_BYTES 64
+
+/* Operation counters of getTreeStats (-DTREE_STATS=0 compiles them out) */
+#ifndef TREE_STATS
+#define TREE_STATS 1
+#endif
+
+/*
+ * Operations counted by the calling thread, over all its trees
+ * (every thread has its own counters, so counting takes no lock
+ * and shares no cache line)
+ */
+typedef struct TreeCounters{
+	unsigned long compares;			// key comparisons
+	unsigned long visits;			// nodes visited by the descents of
+									// search, insert, delete and the bounds
+	unsigned long singleRotations;	// made by avlFixUp and avlDeleteFixUp
+	unsigned long doubleRotations;	// made by avlFixUp and avlDeleteFixUp
+	size_t rangeBytes;				// bytes of the Range buffers built, at
+									// their final capacity
+}TreeCounters;
+
+extern _Thread_local TreeCounters treeCounters;
+
+#if TREE_STATS
+#define TREE_COUNT(counter, n) (treeCounters.counter += (n))
+#else
+#define TREE_COUNT(counter, n) ((void) 0)
+#endif
+
+/*
+ * Shape and memory of a tree, with the counters of the calling thread
+ */
+typedef struct TreeStats{
+	TreeCounters counters;		// operations of the calling thread
+	long height;				// current height of the tree
+	long maxHeight;				// greatest height the tree reached
+	long keys;					// distinct keys (tombstones excluded)
+	long entries;				// entries (duplicates included)
+	long tombstones;			// keys deleted lazily, not removed yet
+	long longestChain;			// most occurrences of one key
+	double meanChain;			// mean occurrences of a key
+	size_t nodeBytes;			// bytes of the nodes (the whole arena,
+								// payloads included, for an arena tree)
+	size_t elemBytes;			// bytes of the elements outside the nodes
+	size_t infoBytes;			// bytes of the infos outside the nodes
+								// (chunks of duplicates included)
+	size_t indexBytes;			// bytes of the hash index
+}TreeStats;
+
+/*
+ * Infos of the later occurrences of a key, when the tree compacts
+ * its duplicates (the first occurrence is the node itself)
+ */
+typedef struct InfoChunk{
+	struct InfoChunk *next;		// chunk with the following occurrences
+	struct InfoChunk *prev;		// chunk with the preceding occurrences
+								// (the first chunk points to the last one)
+	long used;					// number of infos in the chunk
+	char infos[];				// the infos, copied byte by byte
+}InfoChunk;
 
 /*
  * A node in the tree
@@ -19,6 +95,35 @@ typedef struct node{
 	long height;			// the height of the node in the tree
 }TreeNode;
 
+/*
+ * Summary of the subtree of a node, kept right after the node
+ * when the tree is augmented (treeAugment)
+ */
+typedef struct NodeSummary{
+	long count;				// number of entries with the key of the node
+							// (the node and its duplicates)
+	long weight;			// number of entries in the subtree of the node
+							// (duplicates included)
+	long maxCount;			// greatest count in the subtree of the node
+	TreeNode* maxNode;		// first node (in order) of the subtree
+							// having maxCount entries
+	long dead;				// number of tombstones in the subtree of the
+							// node (a tombstone is a key with count 0)
+}NodeSummary;
+
+static inline NodeSummary* summaryOf(TreeNode* x) {
+	return (NodeSummary*) (x + 1);
+}
+
+/*
+ * Slot of the hash index of a tree (open addressing, linear probing)
+ */
+typedef struct HashSlot{
+	uint64_t hash;			// hash of the key of node
+	TreeNode* node;			// first node of a key (NULL - empty slot,
+							// HASH_DELETED - the key was removed)
+}HashSlot;
+
 /*
  * Representation of a multi-dictionary
  */
@@ -30,8 +135,108 @@ typedef struct TTree{
 	void (*destroyInfo)(void*); 	// method for deleting information
 	int (*compare)(void*, void*); 	// method for comparing two elements
 	long size;						// numebr of nodes in the tree
+	int augmented;					// the nodes keep a NodeSummary
+	Arena *arena;					// slab for nodes and payloads (optional)
+	size_t elemSize;				// bytes of an element stored in the arena
+	size_t infoSize;				// bytes of an info stored in the arena
+	size_t keyLength;				// length of packed string keys
+									// (0 if the keys are not packed)
+	size_t keyOffset;				// offset of the packed key from the
+									// start of a node (elem points there)
+	size_t dupSize;					// bytes of an info kept in a chunk
+									// (0 - duplicates are full nodes)
+	size_t chunksOffset;			// offset of the pointer to the chunks
+									// from the start of a node
+	double lazyRatio;				// tombstones allowed per entry before
+									// delete starts removing them
+									// (0 - keys are removed at once)
+	long maxHeight;					// greatest height reached by the tree
+	size_t nodeSize;				// bytes of a node, with the fields
+									// its modes add after the TreeNode
+	uint64_t (*hash)(void*);		// method hashing an element (for the
+									// hash index of a tree not packing keys)
+	HashSlot* slots;				// hash index of the keys, to their node
+									// (NULL - searches descend the tree)
+	size_t slotCount;				// slots of the index (a power of 2)
+	size_t slotsUsed;				// slots holding a node
+	size_t slotsDeleted;			// slots left by removed keys
 }TTree;
 
+/* Chunks of the later occurrences of the key of a node, in a tree
+ * compacting its duplicates (NULL - none)
+ */
+static inline InfoChunk** chunksOf(TTree* tree, TreeNode* x) {
+	return (InfoChunk**) ((char*) x + tree->chunksOffset);
+}
+
+
+/*
+ * Position of an entry in the increasing order of a tree
+ * (moves through the list of duplicates)
+ */
+typedef struct TreeCursor{
+	TTree* tree;		// the tree being traversed
+	TreeNode* node;		// current entry (NULL - outside the tree)
+	InfoChunk* chunk;	// chunk of the current occurrence of node->elem
+						// (NULL - the node itself)
+	long slot;			// position of the occurrence in the chunk
+}TreeCursor;
+
+/*
+ * A key prepared once for repeated comparisons with the nodes of a tree
+ */
+typedef struct TreeKey{
+	void* elem;			// the element
+	uint64_t packed;	// its packed form (when the tree packs its keys)
+}TreeKey;
+
+
+/* Read the bytes of a packed key as a big-endian number,
+ * so that integer order is the same as strncmp order
+ */
+static inline uint64_t loadPackedKey(const uint64_t* bytes) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return __builtin_bswap64(*bytes);
+#else
+	return *bytes;
+#endif
+}
+
+
+/* Pack the first keyLength characters of a string key (the bytes after
+ * its end are 0), the way a tree packing its keys stores them
+ */
+static inline uint64_t packKey(const char* key, size_t keyLength) {
+	uint64_t bytes = 0;
+	memcpy(&bytes, key, strnlen(key, keyLength));
+	return loadPackedKey(&bytes);
+}
+
+
+/* Compare a prepared key with the key of a node
+ * -1 - key < x, 0 - equal, 1 - key > x
+ */
+static inline int compareKey(TTree* tree, TreeKey* key, TreeNode* x) {
+	TREE_COUNT(compares, 1);
+	if (tree->keyLength != 0) {
+		uint64_t k = loadPackedKey((uint64_t*) x->elem);
+		return (key->packed > k) - (key->packed < k);
+	}
+	return tree->compare(key->elem, x->elem);
+}
+
+
+/* Compare the keys of two nodes of the same tree
+ */
+static inline int compareNodes(TTree* tree, TreeNode* a, TreeNode* b) {
+	TREE_COUNT(compares, 1);
+	if (tree->keyLength != 0) {
+		uint64_t ka = loadPackedKey((uint64_t*) a->elem), kb = loadPackedKey((uint64_t*) b->elem);
+		return (ka > kb) - (ka < kb);
+	}
+	return tree->compare(a->elem, b->elem);
+}
+
 
 TTree* createTree(void* (*createElement)(void*),
 				  void (*destroyElement)(void*),
@@ -39,22 +244,54 @@ TTree* createTree(void* (*createElement)(void*),
 				  void (*destroyInfo)(void*),
 				  int compare(void*, void*));
 
+int treeUseArena(TTree* tree, size_t elemSize, size_t infoSize);
+int treeAugment(TTree* tree);
+int treeUsePackedKeys(TTree* tree, size_t keyLength);
+int treeCompactDuplicates(TTree* tree, size_t infoSize);
+int treeLazyDelete(TTree* tree, double maxRatio);
+int treeUseHashIndex(TTree* tree, uint64_t (*hash)(void*));
+int rebuildHashIndex(TTree* tree);
+TreeKey makeKey(TTree* tree, void* elem);
 int isEmpty(TTree* tree);
 TreeNode* search(TTree* tree, TreeNode* x, void* elem);
+void searchBatch(TTree* tree, void** keys, long n, TreeNode** out);
 TreeNode* minimum(TreeNode* x);
 TreeNode* maximum(TreeNode* x);
 TreeNode* successor(TreeNode* x);
 TreeNode* predecessor(TreeNode* x);
 void updateHeight(TreeNode* x);
+void updateNode(TTree* tree, TreeNode* x);
 void avlRotateLeft(TTree* tree, TreeNode* x);
 void avlRotateRight(TTree* tree, TreeNode* y);
 int avlGetBalance(TreeNode *x);
 void avlFixUp(TTree* tree, TreeNode* y);
+void avlDeleteFixUp(TTree* tree, TreeNode* y);
 TreeNode* createTreeNode(TTree *tree, void* value, void* info);
+int appendInfo(TTree* tree, TreeNode* x, void* info);
 void destroyTreeNode(TTree *tree, TreeNode* node);
+long countOf(TTree* tree, TreeNode* x);
+long rank(TTree* tree, void* elem);
+TreeNode* selectNode(TTree* tree, long k);
+TreeCursor selectEntry(TTree* tree, long k);
+long countRange(TTree* tree, void* lo, void* hi);
+TreeNode* mostFrequent(TTree* tree);
+long topFrequent(TTree* tree, long k, TreeNode** out);
+TreeCursor lowerBound(TTree* tree, void* elem);
+TreeCursor upperBound(TTree* tree, void* elem);
+TreeCursor cursorAt(TTree* tree, TreeNode* node);
+int cursorValid(TreeCursor* cursor);
+int cursorNext(TreeCursor* cursor);
+int cursorPrev(TreeCursor* cursor);
+void* cursorElem(TreeCursor* cursor);
+void* cursorInfo(TreeCursor* cursor);
 void insert(TTree* tree, void* elem, void* info);
+int bulkLoadSorted(TTree* tree, void** elems, void** infos, long n);
+int insertBatch(TTree* tree, void** elems, void** infos, long n);
 void delete(TTree* tree, void* elem);
+long compactTree(TTree* tree, long budget);
 void destroyTree(TTree* tree);
 void printList(TTree *tree);
+TreeStats getTreeStats(TTree* tree);
+void resetTreeCounters(void);
 
 #endif /* TREEMAP_H_ */
\ No newline at end of file
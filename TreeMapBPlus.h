@@ -0,0 +1,681 @@
+/*
+ * Compile-time specialized multi-dictionary stored as a B+ tree
+ *
+ * The same duplicates as TreeMapTemplate.h (insertion order, the last
+ * one is deleted first), but a node holds TM_BPLUS_KEYS keys instead of
+ * one, so a search misses the cache once per level of a much lower tree.
+ * The entries are kept in the leaves, which are linked to each other in
+ * key order (they replace the threaded list of the AVL trees); the inner
+ * nodes only hold separators.
+ *
+ * Usage: the same macros as TreeMapTemplate.h (TM_NAME, TM_KEY, TM_INFO,
+ * TM_COMPARE and the optional TM_KEY_INIT, TM_INFO_INIT, TM_KEY_DESTROY,
+ * TM_INFO_DESTROY), but the header is TreeMapBPlus.h. The separators are
+ * plain copies of keys, so the keys have to be values.
+ *
+ * Optional: TM_BPLUS_PAD, the greatest value of a 64-bit integer TM_KEY.
+ * The free slots of a node are filled with it and a node is searched by
+ * comparing 4 keys at a time with vector instructions (SSE or AVX2,
+ * depending on the target flags), without branches, instead of calling
+ * TM_COMPARE for every key.
+ *
+ * Generated: struct TM_NAME (the tree), struct TM_NAME_leaf, _inner,
+ * _dup, _pos and TM_NAME_create, _isEmpty, _search, _minimum, _maximum,
+ * _successor, _predecessor, _insert, _delete, _destroy.
+ *
+ * Entries are identified by a position {leaf, slot} (leaf NULL - none):
+ * pos.leaf->keys[pos.slot] is the key, pos.leaf->infos[pos.slot] the info
+ * of its first occurrence and pos.leaf->dups[pos.slot] the list of the
+ * later ones. A position is only valid until the next insert or delete.
+ */
+
+#if !defined(TM_NAME) || !defined(TM_KEY) || !defined(TM_INFO) || !defined(TM_COMPARE)
+#error "TM_NAME, TM_KEY, TM_INFO and TM_COMPARE must be defined"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef TM_KEY_INIT
+#define TM_KEY_INIT(dst, src) ((dst) = (src))
+#endif
+#ifndef TM_INFO_INIT
+#define TM_INFO_INIT(dst, src) ((dst) = (src))
+#endif
+#ifndef TM_KEY_DESTROY
+#define TM_KEY_DESTROY(k) ((void)0)
+#endif
+#ifndef TM_INFO_DESTROY
+#define TM_INFO_DESTROY(i) ((void)0)
+#endif
+
+/* Keys of a node (a multiple of 4); a leaf of long keys and infos fills
+ * 6 cache lines
+ */
+#ifndef TM_BPLUS_KEYS
+#define TM_BPLUS_KEYS 16
+#endif
+
+/* Fewest keys of a node other than the root */
+#ifndef TM_BPLUS_MIN
+#define TM_BPLUS_MIN (TM_BPLUS_KEYS / 2)
+#endif
+
+/* Most inner levels (every inner node has at least TM_BPLUS_MIN + 1
+ * children, so 2^63 keys need less than 22 levels)
+ */
+#ifndef TM_BPLUS_MAX_DEPTH
+#define TM_BPLUS_MAX_DEPTH 24
+#endif
+
+/* Alignment of the nodes */
+#ifndef TM_BPLUS_LINE
+#define TM_BPLUS_LINE 64
+#endif
+
+#define TM_CONCAT_(a, b) a##_##b
+#define TM_CONCAT(a, b) TM_CONCAT_(a, b)
+#define TM_FN(name) TM_CONCAT(TM_NAME, name)
+#define TM_LEAF struct TM_FN(leaf)
+#define TM_INNER struct TM_FN(inner)
+#define TM_DUP struct TM_FN(dup)
+#define TM_POS struct TM_FN(pos)
+#define TM_TREE struct TM_NAME
+
+/*
+ * A later occurrence of a key (the first one's prev is the last one)
+ */
+TM_DUP {
+	TM_INFO info;			// information of the occurrence
+	TM_DUP *next;			// next occurrence
+	TM_DUP *prev;			// previous occurrence
+};
+
+/*
+ * A leaf: the entries of a range of keys
+ */
+TM_LEAF {
+	TM_KEY keys[TM_BPLUS_KEYS];		// the keys, in increasing order
+	TM_INFO infos[TM_BPLUS_KEYS];	// first occurrence of every key
+	TM_DUP *dups[TM_BPLUS_KEYS];	// later occurrences (NULL - none)
+	TM_LEAF *next;					// next leaf in key order
+	TM_LEAF *prev;					// previous leaf in key order
+	int used;						// number of keys
+};
+
+/*
+ * An inner node: child i holds the keys from keys[i - 1] (included)
+ * to keys[i] (excluded)
+ */
+TM_INNER {
+	TM_KEY keys[TM_BPLUS_KEYS];		// separators, in increasing order
+	void *children[TM_BPLUS_KEYS + 1];	// inner nodes or leaves
+	int used;						// number of separators
+};
+
+/*
+ * Position of a key
+ */
+TM_POS {
+	TM_LEAF *leaf;			// leaf of the key (NULL - no key)
+	int slot;				// index of the key in the leaf
+};
+
+/*
+ * Representation of a multi-dictionary
+ */
+TM_TREE {
+	void *root;				// root (a leaf if height is 0)
+	int height;				// inner levels above the leaves
+	TM_LEAF *first;			// leaf of the smallest keys
+	TM_LEAF *last;			// leaf of the greatest keys
+	long size;				// number of entries (duplicates included)
+};
+
+
+/* Allocate a node on whole cache lines */
+static inline void* TM_FN(allocNode)(size_t size) {
+	return aligned_alloc(TM_BPLUS_LINE, (size + TM_BPLUS_LINE - 1) / TM_BPLUS_LINE * TM_BPLUS_LINE);
+}
+
+
+/* Fill the free slots of a node (read by the vector search) */
+static inline void TM_FN(pad)(TM_KEY *keys, int used) {
+#ifdef TM_BPLUS_PAD
+	for (int i = used; i < TM_BPLUS_KEYS; i++)
+		keys[i] = TM_BPLUS_PAD;
+#else
+	(void)keys;
+	(void)used;
+#endif
+}
+
+
+static inline TM_LEAF* TM_FN(createLeaf)(void) {
+	TM_LEAF *leaf = (TM_LEAF *)TM_FN(allocNode)(sizeof(TM_LEAF));
+	if (leaf == NULL)
+		return NULL;
+	leaf->next = leaf->prev = NULL;
+	leaf->used = 0;
+	TM_FN(pad)(leaf->keys, 0);
+	return leaf;
+}
+
+static inline TM_INNER* TM_FN(createInner)(void) {
+	TM_INNER *inner = (TM_INNER *)TM_FN(allocNode)(sizeof(TM_INNER));
+	if (inner == NULL)
+		return NULL;
+	inner->used = 0;
+	TM_FN(pad)(inner->keys, 0);
+	return inner;
+}
+
+
+/* Create an empty tree
+ */
+static inline TM_TREE* TM_FN(create)(void) {
+	TM_TREE *tree = (TM_TREE *)malloc(sizeof(TM_TREE));
+	if (tree == NULL)
+		return NULL;
+	tree->root = NULL;
+	tree->height = 0;
+	tree->first = tree->last = NULL;
+	tree->size = 0;
+	return tree;
+}
+
+
+static inline int TM_FN(isEmpty)(TM_TREE *tree) {
+	return tree->root == NULL;
+}
+
+
+/* Number of keys of a node smaller than elem (orEqual: not greater)
+ */
+static inline int TM_FN(countBelow)(const TM_KEY *keys, int used, TM_KEY elem, int orEqual) {
+#ifdef TM_BPLUS_PAD
+	// every slot is compared, the padding is cut off at the end
+	typedef TM_KEY lanes __attribute__((vector_size(4 * sizeof(TM_KEY))));
+	typedef long counts __attribute__((vector_size(4 * sizeof(long))));
+	lanes key = {elem, elem, elem, elem};
+	counts total = {0, 0, 0, 0};
+	for (int i = 0; i < TM_BPLUS_KEYS; i += 4) {
+		lanes v;
+		memcpy(&v, keys + i, sizeof(v));
+		total += (counts)(orEqual ? v <= key : v < key);
+	}
+	int count = (int)-(total[0] + total[1] + total[2] + total[3]);
+	return count < used ? count : used;
+#else
+	int i = 0;
+	while (i < used && TM_COMPARE(keys[i], elem) < orEqual)
+		i++;
+	return i;
+#endif
+}
+
+
+/* Search for a key
+ *
+ * return: the position of the key ({NULL, 0} if it is missing)
+ */
+static inline TM_POS TM_FN(search)(TM_TREE *tree, TM_KEY elem) {
+	TM_POS pos = {NULL, 0};
+	void *x = tree->root;
+	if (x == NULL)
+		return pos;
+	for (int depth = 0; depth < tree->height; depth++) {
+		TM_INNER *inner = (TM_INNER *)x;
+		x = inner->children[TM_FN(countBelow)(inner->keys, inner->used, elem, 1)];
+	}
+	TM_LEAF *leaf = (TM_LEAF *)x;
+	int slot = TM_FN(countBelow)(leaf->keys, leaf->used, elem, 0);
+	if (slot < leaf->used && TM_COMPARE(leaf->keys[slot], elem) == 0) {
+		pos.leaf = leaf;
+		pos.slot = slot;
+	}
+	return pos;
+}
+
+
+/* The smallest and the greatest key, through the end leaves
+ */
+static inline TM_POS TM_FN(minimum)(TM_TREE *tree) {
+	TM_POS pos = {tree->first, 0};
+	return pos;
+}
+
+static inline TM_POS TM_FN(maximum)(TM_TREE *tree) {
+	TM_POS pos = {tree->last, tree->last != NULL ? tree->last->used - 1 : 0};
+	return pos;
+}
+
+
+/* The next and the previous key, through the links of the leaves
+ */
+static inline TM_POS TM_FN(successor)(TM_TREE *tree, TM_POS pos) {
+	(void)tree;
+	if (pos.leaf == NULL)
+		return pos;
+	if (++pos.slot == pos.leaf->used) {
+		pos.leaf = pos.leaf->next;
+		pos.slot = 0;
+	}
+	return pos;
+}
+
+static inline TM_POS TM_FN(predecessor)(TM_TREE *tree, TM_POS pos) {
+	(void)tree;
+	if (pos.leaf == NULL)
+		return pos;
+	if (pos.slot-- == 0) {
+		pos.leaf = pos.leaf->prev;
+		pos.slot = pos.leaf != NULL ? pos.leaf->used - 1 : 0;
+	}
+	return pos;
+}
+
+
+/* Move the entry of slot from of a leaf to slot to of another one
+ * (the payloads change owner, they are not copied)
+ */
+static inline void TM_FN(moveEntry)(TM_LEAF *dst, int to, TM_LEAF *src, int from) {
+	dst->keys[to] = src->keys[from];
+	dst->infos[to] = src->infos[from];
+	dst->dups[to] = src->dups[from];
+}
+
+/* Open slot at in a leaf (the leaf has a free slot) */
+static inline void TM_FN(openSlot)(TM_LEAF *leaf, int at) {
+	for (int i = leaf->used; i > at; i--)
+		TM_FN(moveEntry)(leaf, i, leaf, i - 1);
+	leaf->used++;
+}
+
+/* Close slot at of a leaf */
+static inline void TM_FN(closeSlot)(TM_LEAF *leaf, int at) {
+	for (int i = at; i + 1 < leaf->used; i++)
+		TM_FN(moveEntry)(leaf, i, leaf, i + 1);
+	leaf->used--;
+	TM_FN(pad)(leaf->keys, leaf->used);
+}
+
+
+/* Put separator key and child right after child at of an inner node
+ * that has a free slot
+ */
+static inline void TM_FN(openInner)(TM_INNER *inner, int at, TM_KEY key, void *right) {
+	for (int i = inner->used; i > at; i--) {
+		inner->keys[i] = inner->keys[i - 1];
+		inner->children[i + 1] = inner->children[i];
+	}
+	inner->keys[at] = key;
+	inner->children[at + 1] = right;
+	inner->used++;
+}
+
+/* Remove separator key and child child of an inner node */
+static inline void TM_FN(closeInner)(TM_INNER *inner, int key, int child) {
+	for (int i = key; i + 1 < inner->used; i++)
+		inner->keys[i] = inner->keys[i + 1];
+	for (int i = child; i < inner->used; i++)
+		inner->children[i] = inner->children[i + 1];
+	inner->used--;
+	TM_FN(pad)(inner->keys, inner->used);
+}
+
+
+/* Split a full inner node that receives separator key and child right
+ * after child at; the empty node sibling gets the right half
+ *
+ * return: sibling (*key becomes the separator that goes up)
+ */
+static inline TM_INNER* TM_FN(splitInner)(TM_INNER *inner, TM_INNER *sibling, int at,
+										  TM_KEY *key, void *right) {
+	TM_KEY keys[TM_BPLUS_KEYS + 1];
+	void *children[TM_BPLUS_KEYS + 2];
+	for (int i = 0, j = 0; i <= TM_BPLUS_KEYS; i++)
+		keys[i] = i == at ? *key : inner->keys[j++];
+	for (int i = 0, j = 0; i <= TM_BPLUS_KEYS + 1; i++)
+		children[i] = i == at + 1 ? right : inner->children[j++];
+
+	int half = (TM_BPLUS_KEYS + 1) / 2;
+	inner->used = half;
+	for (int i = 0; i < half; i++)
+		inner->keys[i] = keys[i];
+	for (int i = 0; i <= half; i++)
+		inner->children[i] = children[i];
+	TM_FN(pad)(inner->keys, half);
+	sibling->used = TM_BPLUS_KEYS - half;
+	for (int i = 0; i < sibling->used; i++)
+		sibling->keys[i] = keys[half + 1 + i];
+	for (int i = 0; i <= sibling->used; i++)
+		sibling->children[i] = children[half + 1 + i];
+	TM_FN(pad)(sibling->keys, sibling->used);
+	*key = keys[half];
+	return sibling;
+}
+
+
+/* Insert a pair in the multi-dictionary
+ * (a duplicate key is appended to the occurrences of its slot)
+ */
+static inline void TM_FN(insert)(TM_TREE *tree, TM_KEY elem, TM_INFO info) {
+	if (tree->root == NULL) {
+		TM_LEAF *leaf = TM_FN(createLeaf)();
+		if (leaf == NULL)
+			return;
+		tree->root = tree->first = tree->last = leaf;
+	}
+
+	TM_INNER *path[TM_BPLUS_MAX_DEPTH];
+	int index[TM_BPLUS_MAX_DEPTH];
+	void *x = tree->root;
+	for (int depth = 0; depth < tree->height; depth++) {
+		path[depth] = (TM_INNER *)x;
+		index[depth] = TM_FN(countBelow)(path[depth]->keys, path[depth]->used, elem, 1);
+		x = path[depth]->children[index[depth]];
+	}
+	TM_LEAF *leaf = (TM_LEAF *)x;
+	int slot = TM_FN(countBelow)(leaf->keys, leaf->used, elem, 0);
+
+	if (slot < leaf->used && TM_COMPARE(leaf->keys[slot], elem) == 0) {
+		TM_DUP *dup = (TM_DUP *)malloc(sizeof(TM_DUP));
+		if (dup == NULL)
+			return;
+		TM_INFO_INIT(dup->info, info);
+		dup->next = NULL;
+		TM_DUP *first = leaf->dups[slot];
+		if (first == NULL) {
+			dup->prev = dup;
+			leaf->dups[slot] = dup;
+		} else {
+			dup->prev = first->prev;
+			first->prev->next = dup;
+			first->prev = dup;
+		}
+		tree->size++;
+		return;
+	}
+
+	// Every node a split needs is allocated before anything moves, so
+	// running out of memory leaves the tree unchanged: a new leaf, one
+	// inner node for every full parent and a root if they all are full
+	TM_LEAF *sibling = NULL;
+	TM_INNER *spare[TM_BPLUS_MAX_DEPTH + 1];
+	int spares = 0;
+	if (leaf->used == TM_BPLUS_KEYS) {
+		int full = 0;
+		while (full < tree->height && path[tree->height - 1 - full]->used == TM_BPLUS_KEYS)
+			full++;
+		int needed = full + (full == tree->height);
+		sibling = TM_FN(createLeaf)();
+		while (sibling != NULL && spares < needed &&
+			   (spare[spares] = TM_FN(createInner)()) != NULL)
+			spares++;
+		if (sibling == NULL || spares < needed) {
+			free(sibling);
+			while (spares > 0)
+				free(spare[--spares]);
+			return;
+		}
+	}
+
+	// A full leaf gives its upper half to the new leaf first
+	void *right = NULL;
+	TM_KEY separator = elem;
+	if (sibling != NULL) {
+		int half = TM_BPLUS_KEYS / 2;
+		for (int i = half; i < TM_BPLUS_KEYS; i++)
+			TM_FN(moveEntry)(sibling, i - half, leaf, i);
+		sibling->used = TM_BPLUS_KEYS - half;
+		leaf->used = half;
+		TM_FN(pad)(leaf->keys, half);
+		sibling->prev = leaf;
+		sibling->next = leaf->next;
+		if (leaf->next != NULL)
+			leaf->next->prev = sibling;
+		else
+			tree->last = sibling;
+		leaf->next = sibling;
+		separator = sibling->keys[0];
+		right = sibling;
+		if (slot > half) {
+			leaf = sibling;
+			slot -= half;
+		}
+	}
+	TM_FN(openSlot)(leaf, slot);
+	TM_KEY_INIT(leaf->keys[slot], elem);
+	TM_INFO_INIT(leaf->infos[slot], info);
+	leaf->dups[slot] = NULL;
+	tree->size++;
+
+	// The split climbs while the parents are full
+	for (int depth = tree->height - 1; right != NULL && depth >= 0; depth--) {
+		TM_INNER *inner = path[depth];
+		if (inner->used < TM_BPLUS_KEYS) {
+			TM_FN(openInner)(inner, index[depth], separator, right);
+			return;
+		}
+		right = TM_FN(splitInner)(inner, spare[--spares], index[depth], &separator, right);
+	}
+	if (right != NULL) {
+		TM_INNER *root = spare[--spares];
+		root->keys[0] = separator;
+		root->children[0] = tree->root;
+		root->children[1] = right;
+		root->used = 1;
+		TM_FN(pad)(root->keys, 1);
+		tree->root = root;
+		tree->height++;
+	}
+}
+
+
+/* Refill leaf at of parent, which has less than TM_BPLUS_MIN keys:
+ * borrow a key from a sibling or merge with it
+ */
+static inline void TM_FN(fixLeaf)(TM_TREE *tree, TM_INNER *parent, int at) {
+	TM_LEAF *leaf = (TM_LEAF *)parent->children[at];
+	TM_LEAF *left = at > 0 ? (TM_LEAF *)parent->children[at - 1] : NULL;
+	TM_LEAF *right = at < parent->used ? (TM_LEAF *)parent->children[at + 1] : NULL;
+
+	if (left != NULL && left->used > TM_BPLUS_MIN) {
+		TM_FN(openSlot)(leaf, 0);
+		TM_FN(moveEntry)(leaf, 0, left, left->used - 1);
+		left->used--;
+		TM_FN(pad)(left->keys, left->used);
+		parent->keys[at - 1] = leaf->keys[0];
+		return;
+	}
+	if (right != NULL && right->used > TM_BPLUS_MIN) {
+		TM_FN(moveEntry)(leaf, leaf->used++, right, 0);
+		TM_FN(closeSlot)(right, 0);
+		parent->keys[at] = right->keys[0];
+		return;
+	}
+
+	// merge into the left one of the pair
+	if (left == NULL) {
+		left = leaf;
+		leaf = right;
+		at++;
+	}
+	for (int i = 0; i < leaf->used; i++)
+		TM_FN(moveEntry)(left, left->used++, leaf, i);
+	left->next = leaf->next;
+	if (leaf->next != NULL)
+		leaf->next->prev = left;
+	else
+		tree->last = left;
+	free(leaf);
+	TM_FN(closeInner)(parent, at - 1, at);
+}
+
+
+/* Refill inner node at of parent, which has less than TM_BPLUS_MIN
+ * separators: rotate one through the parent or merge with a sibling
+ */
+static inline void TM_FN(fixInner)(TM_INNER *parent, int at) {
+	TM_INNER *inner = (TM_INNER *)parent->children[at];
+	TM_INNER *left = at > 0 ? (TM_INNER *)parent->children[at - 1] : NULL;
+	TM_INNER *right = at < parent->used ? (TM_INNER *)parent->children[at + 1] : NULL;
+
+	if (left != NULL && left->used > TM_BPLUS_MIN) {
+		for (int i = inner->used; i > 0; i--)
+			inner->keys[i] = inner->keys[i - 1];
+		for (int i = inner->used + 1; i > 0; i--)
+			inner->children[i] = inner->children[i - 1];
+		inner->keys[0] = parent->keys[at - 1];
+		inner->children[0] = left->children[left->used];
+		inner->used++;
+		parent->keys[at - 1] = left->keys[left->used - 1];
+		left->used--;
+		TM_FN(pad)(left->keys, left->used);
+		return;
+	}
+	if (right != NULL && right->used > TM_BPLUS_MIN) {
+		inner->keys[inner->used] = parent->keys[at];
+		inner->children[inner->used + 1] = right->children[0];
+		inner->used++;
+		parent->keys[at] = right->keys[0];
+		TM_FN(closeInner)(right, 0, 0);
+		return;
+	}
+
+	if (left == NULL) {
+		left = inner;
+		inner = right;
+		at++;
+	}
+	// the separator between the pair comes down between their keys
+	left->keys[left->used] = parent->keys[at - 1];
+	for (int i = 0; i < inner->used; i++)
+		left->keys[left->used + 1 + i] = inner->keys[i];
+	for (int i = 0; i <= inner->used; i++)
+		left->children[left->used + 1 + i] = inner->children[i];
+	left->used += 1 + inner->used;
+	free(inner);
+	TM_FN(closeInner)(parent, at - 1, at);
+}
+
+
+/* Remove a key from the tree
+ * ! If there are duplicates, the last one is removed
+ */
+static inline void TM_FN(delete)(TM_TREE *tree, TM_KEY elem) {
+	if (tree->root == NULL)
+		return;
+	TM_INNER *path[TM_BPLUS_MAX_DEPTH];
+	int index[TM_BPLUS_MAX_DEPTH];
+	void *x = tree->root;
+	for (int depth = 0; depth < tree->height; depth++) {
+		path[depth] = (TM_INNER *)x;
+		index[depth] = TM_FN(countBelow)(path[depth]->keys, path[depth]->used, elem, 1);
+		x = path[depth]->children[index[depth]];
+	}
+	TM_LEAF *leaf = (TM_LEAF *)x;
+	int slot = TM_FN(countBelow)(leaf->keys, leaf->used, elem, 0);
+	if (slot == leaf->used || TM_COMPARE(leaf->keys[slot], elem) != 0)
+		return;
+	tree->size--;
+
+	TM_DUP *first = leaf->dups[slot];
+	if (first != NULL) {
+		TM_DUP *last = first->prev;
+		if (last == first) {
+			leaf->dups[slot] = NULL;
+		} else {
+			first->prev = last->prev;
+			last->prev->next = NULL;
+		}
+		TM_INFO_DESTROY(last->info);
+		free(last);
+		return;
+	}
+
+	TM_KEY_DESTROY(leaf->keys[slot]);
+	TM_INFO_DESTROY(leaf->infos[slot]);
+	TM_FN(closeSlot)(leaf, slot);
+
+	// Refill the nodes left too small, from the leaf up
+	int small = leaf->used < TM_BPLUS_MIN;
+	for (int depth = tree->height - 1; small && depth >= 0; depth--) {
+		if (depth == tree->height - 1)
+			TM_FN(fixLeaf)(tree, path[depth], index[depth]);
+		else
+			TM_FN(fixInner)(path[depth], index[depth]);
+		small = path[depth]->used < TM_BPLUS_MIN;
+	}
+
+	if (tree->height == 0) {
+		if (leaf->used == 0) {
+			free(leaf);
+			tree->root = tree->first = tree->last = NULL;
+		}
+	} else if (((TM_INNER *)tree->root)->used == 0) {
+		// the root lost its last separator: its only child replaces it
+		TM_INNER *root = (TM_INNER *)tree->root;
+		tree->root = root->children[0];
+		tree->height--;
+		free(root);
+	}
+}
+
+
+static inline void TM_FN(destroyInner)(void *x, int height) {
+	if (height == 0)
+		return;
+	TM_INNER *inner = (TM_INNER *)x;
+	for (int i = 0; i <= inner->used; i++)
+		TM_FN(destroyInner)(inner->children[i], height - 1);
+	free(inner);
+}
+
+
+/* Free the tree, walking the leaves for the payloads
+ */
+static inline void TM_FN(destroy)(TM_TREE *tree) {
+	if (tree == NULL)
+		return;
+	if (tree->root != NULL)
+		TM_FN(destroyInner)(tree->root, tree->height);
+	TM_LEAF *leaf = tree->first;
+	while (leaf != NULL) {
+		TM_LEAF *next = leaf->next;
+		for (int i = 0; i < leaf->used; i++) {
+			TM_KEY_DESTROY(leaf->keys[i]);
+			TM_INFO_DESTROY(leaf->infos[i]);
+			TM_DUP *dup = leaf->dups[i];
+			while (dup != NULL) {
+				TM_DUP *temp = dup;
+				dup = dup->next;
+				TM_INFO_DESTROY(temp->info);
+				free(temp);
+			}
+		}
+		free(leaf);
+		leaf = next;
+	}
+	free(tree);
+}
+
+
+#undef TM_NAME
+#undef TM_KEY
+#undef TM_INFO
+#undef TM_COMPARE
+#undef TM_KEY_INIT
+#undef TM_INFO_INIT
+#undef TM_KEY_DESTROY
+#undef TM_INFO_DESTROY
+#undef TM_BPLUS_PAD
+#undef TM_CONCAT_
+#undef TM_CONCAT
+#undef TM_FN
+#undef TM_LEAF
+#undef TM_INNER
+#undef TM_DUP
+#undef TM_POS
+#undef TM_TREE
@@ -0,0 +1,456 @@
+/*
+ * Compile-time specialized multi-dictionary with a compact node layout
+ *
+ * The same algorithms and duplicates as TreeMapTemplate.h, but the nodes
+ * live in a pool and refer to each other through 32-bit indices (0 - no
+ * node). Every node is split in two parts, kept in separate arrays:
+ *	- hot: the key, the children and an 8-bit height (all a descent reads)
+ *	- cold: the info and the links of the list of duplicates
+ * so a cache line holds several hot parts instead of less than one node.
+ *
+ * There are no parent links: insert and delete remember their descent in
+ * a stack and climb it back only while the height of a subtree changes.
+ *
+ * Usage: the same macros as TreeMapTemplate.h (TM_NAME, TM_KEY, TM_INFO,
+ * TM_COMPARE and the optional TM_KEY_INIT, TM_INFO_INIT, TM_KEY_DESTROY,
+ * TM_INFO_DESTROY), but the header is TreeMapPool.h.
+ *
+ * Generated: struct TM_NAME (the tree), struct TM_NAME_hot,
+ * struct TM_NAME_cold and TM_NAME_create, _isEmpty, _search, _minimum,
+ * _maximum, _successor, _predecessor, _insert, _delete, _destroy.
+ *
+ * Nodes are identified by their index: tree->hot[x].elem is the key of
+ * node x and tree->cold[x].info its info. Indices stay valid when the
+ * pool grows (pointers into the arrays do not).
+ */
+
+#if !defined(TM_NAME) || !defined(TM_KEY) || !defined(TM_INFO) || !defined(TM_COMPARE)
+#error "TM_NAME, TM_KEY, TM_INFO and TM_COMPARE must be defined"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifndef TM_KEY_INIT
+#define TM_KEY_INIT(dst, src) ((dst) = (src))
+#endif
+#ifndef TM_INFO_INIT
+#define TM_INFO_INIT(dst, src) ((dst) = (src))
+#endif
+#ifndef TM_KEY_DESTROY
+#define TM_KEY_DESTROY(k) ((void)0)
+#endif
+#ifndef TM_INFO_DESTROY
+#define TM_INFO_DESTROY(i) ((void)0)
+#endif
+
+/* Index of no node (slot 0 of the pool is never handed out) */
+#ifndef TM_NIL
+#define TM_NIL 0u
+#endif
+
+/* Initial number of slots of the pool */
+#ifndef TM_POOL_MIN_SLOTS
+#define TM_POOL_MIN_SLOTS 64u
+#endif
+
+/* Longest descent (an AVL tree of 2^32 nodes is less than 47 levels high) */
+#ifndef TM_MAX_HEIGHT
+#define TM_MAX_HEIGHT 48
+#endif
+
+#define TM_CONCAT_(a, b) a##_##b
+#define TM_CONCAT(a, b) TM_CONCAT_(a, b)
+#define TM_FN(name) TM_CONCAT(TM_NAME, name)
+#define TM_HOT struct TM_FN(hot)
+#define TM_COLD struct TM_FN(cold)
+#define TM_TREE struct TM_NAME
+#define TM_H(x) (tree->hot[x])
+#define TM_C(x) (tree->cold[x])
+
+/*
+ * The part of a node read while descending the tree
+ */
+TM_HOT {
+	TM_KEY elem;			// element/key of the node
+	uint32_t left;			// left child
+	uint32_t right;			// right child
+	int8_t height;			// the height of the node in the tree
+};
+
+/*
+ * The rest of a node
+ */
+TM_COLD {
+	TM_INFO info;			// information of the node
+	uint32_t next;			// next node in the list of duplicates
+							// (next free slot, for a free slot)
+	uint32_t prev;			// previous node in the list of duplicates
+	uint32_t end;			// end of the list of duplicates for current node
+};
+
+/*
+ * Representation of a multi-dictionary
+ */
+TM_TREE {
+	TM_HOT *hot;			// hot parts of the nodes (slot 0: no node)
+	TM_COLD *cold;			// cold parts of the nodes
+	uint32_t root;			// root of the tree
+	uint32_t capacity;		// number of slots of the pool
+	uint32_t used;			// slots handed out at least once
+	uint32_t freeList;		// first released slot
+	long size;				// number of nodes in the tree
+};
+
+
+/* Create an empty tree
+ */
+static inline TM_TREE* TM_FN(create)(void) {
+	TM_TREE *tree = (TM_TREE *)malloc(sizeof(TM_TREE));
+	if (tree == NULL)
+		return NULL;
+	tree->hot = (TM_HOT *)malloc(TM_POOL_MIN_SLOTS * sizeof(TM_HOT));
+	tree->cold = (TM_COLD *)malloc(TM_POOL_MIN_SLOTS * sizeof(TM_COLD));
+	if (tree->hot == NULL || tree->cold == NULL) {
+		free(tree->hot);
+		free(tree->cold);
+		free(tree);
+		return NULL;
+	}
+	// Slot 0 stands for the missing children: height 0, no links
+	tree->hot[TM_NIL].left = tree->hot[TM_NIL].right = TM_NIL;
+	tree->hot[TM_NIL].height = 0;
+	tree->capacity = TM_POOL_MIN_SLOTS;
+	tree->used = 1;
+	tree->freeList = TM_NIL;
+	tree->root = TM_NIL;
+	tree->size = 0;
+	return tree;
+}
+
+
+static inline int TM_FN(isEmpty)(TM_TREE *tree) {
+	return tree->root == TM_NIL;
+}
+
+
+/* Take a slot from the pool (growing it if needed)
+ *
+ * return: the index of the slot or TM_NIL
+ */
+static inline uint32_t TM_FN(allocNode)(TM_TREE *tree) {
+	uint32_t x = tree->freeList;
+	if (x != TM_NIL) {
+		tree->freeList = TM_C(x).next;
+		return x;
+	}
+	if (tree->used == tree->capacity) {
+		if (tree->capacity > UINT32_MAX / 2)
+			return TM_NIL;
+		uint32_t capacity = tree->capacity * 2;
+		TM_HOT *hot = (TM_HOT *)realloc(tree->hot, capacity * sizeof(TM_HOT));
+		if (hot == NULL)
+			return TM_NIL;
+		tree->hot = hot;
+		TM_COLD *cold = (TM_COLD *)realloc(tree->cold, capacity * sizeof(TM_COLD));
+		if (cold == NULL)
+			return TM_NIL;
+		tree->cold = cold;
+		tree->capacity = capacity;
+	}
+	return tree->used++;
+}
+
+
+/* Search for the first node with the given key
+ */
+static inline uint32_t TM_FN(search)(TM_TREE *tree, TM_KEY elem) {
+	uint32_t x = tree->root;
+	while (x != TM_NIL) {
+		int c = TM_COMPARE(elem, TM_H(x).elem);
+		if (c == 0)
+			return x;
+		x = c < 0 ? TM_H(x).left : TM_H(x).right;
+	}
+	return TM_NIL;
+}
+
+
+static inline uint32_t TM_FN(minimum)(TM_TREE *tree, uint32_t x) {
+	while (TM_H(x).left != TM_NIL)
+		x = TM_H(x).left;
+	return x;
+}
+
+
+static inline uint32_t TM_FN(maximum)(TM_TREE *tree, uint32_t x) {
+	while (TM_H(x).right != TM_NIL)
+		x = TM_H(x).right;
+	return x;
+}
+
+
+/* The node of the next key: the list of duplicates continues with it
+ */
+static inline uint32_t TM_FN(successor)(TM_TREE *tree, uint32_t x) {
+	if (x == TM_NIL)
+		return TM_NIL;
+	return TM_C(TM_C(x).end).next;
+}
+
+
+/* The node of the previous key: the list only leads to its last
+ * duplicate, so the node is found by searching that key
+ */
+static inline uint32_t TM_FN(predecessor)(TM_TREE *tree, uint32_t x) {
+	if (x == TM_NIL || TM_C(x).prev == TM_NIL)
+		return TM_NIL;
+	return TM_FN(search)(tree, TM_H(TM_C(x).prev).elem);
+}
+
+
+/* Slot 0 has height 0, so no child has to be checked for TM_NIL
+ */
+static inline void TM_FN(updateHeight)(TM_TREE *tree, uint32_t x) {
+	int8_t l = TM_H(TM_H(x).left).height, r = TM_H(TM_H(x).right).height;
+	TM_H(x).height = (l >= r ? l : r) + 1;
+}
+
+
+static inline int TM_FN(balance)(TM_TREE *tree, uint32_t x) {
+	return TM_H(TM_H(x).left).height - TM_H(TM_H(x).right).height;
+}
+
+
+/* Rotations return the new root of the subtree
+ */
+static inline uint32_t TM_FN(rotateLeft)(TM_TREE *tree, uint32_t x) {
+	uint32_t y = TM_H(x).right;
+	TM_H(x).right = TM_H(y).left;
+	TM_H(y).left = x;
+	TM_FN(updateHeight)(tree, x);
+	TM_FN(updateHeight)(tree, y);
+	return y;
+}
+
+
+static inline uint32_t TM_FN(rotateRight)(TM_TREE *tree, uint32_t y) {
+	uint32_t x = TM_H(y).left;
+	TM_H(y).left = TM_H(x).right;
+	TM_H(x).right = y;
+	TM_FN(updateHeight)(tree, y);
+	TM_FN(updateHeight)(tree, x);
+	return x;
+}
+
+
+/* Rebalance the subtree rooted in y (single or double rotation)
+ *
+ * return: the new root of the subtree
+ */
+static inline uint32_t TM_FN(rebalance)(TM_TREE *tree, uint32_t y) {
+	TM_FN(updateHeight)(tree, y);
+	int balance = TM_FN(balance)(tree, y);
+	if (balance > 1) {
+		if (TM_FN(balance)(tree, TM_H(y).left) < 0)
+			TM_H(y).left = TM_FN(rotateLeft)(tree, TM_H(y).left);
+		return TM_FN(rotateRight)(tree, y);
+	}
+	if (balance < -1) {
+		if (TM_FN(balance)(tree, TM_H(y).right) > 0)
+			TM_H(y).right = TM_FN(rotateRight)(tree, TM_H(y).right);
+		return TM_FN(rotateLeft)(tree, y);
+	}
+	return y;
+}
+
+
+/* Put node y in the place of x, a child of parent (TM_NIL - the root)
+ */
+static inline void TM_FN(replace)(TM_TREE *tree, uint32_t parent, uint32_t x, uint32_t y) {
+	if (parent == TM_NIL)
+		tree->root = y;
+	else if (TM_H(parent).left == x)
+		TM_H(parent).left = y;
+	else
+		TM_H(parent).right = y;
+}
+
+
+/* Rebalance the nodes path[top], path[top - 1], ... (a descent from the
+ * root), stopping at the first subtree whose height does not change
+ */
+static inline void TM_FN(fixUp)(TM_TREE *tree, uint32_t *path, int top) {
+	for (int i = top; i >= 0; i--) {
+		uint32_t y = path[i];
+		int8_t height = TM_H(y).height;
+		uint32_t root = TM_FN(rebalance)(tree, y);
+		if (root != y)
+			TM_FN(replace)(tree, i > 0 ? path[i - 1] : TM_NIL, y, root);
+		if (TM_H(root).height == height)
+			break;
+	}
+}
+
+
+/* Insert a pair in the multi-dictionary
+ * (a duplicate key is appended to the list of its first node)
+ */
+static inline void TM_FN(insert)(TM_TREE *tree, TM_KEY elem, TM_INFO info) {
+	// The slot is taken first: growing the pool moves the arrays
+	uint32_t node = TM_FN(allocNode)(tree);
+	if (node == TM_NIL)
+		return;
+	TM_KEY_INIT(TM_H(node).elem, elem);
+	TM_INFO_INIT(TM_C(node).info, info);
+	TM_H(node).left = TM_H(node).right = TM_NIL;
+	TM_H(node).height = 1;
+	TM_C(node).next = TM_C(node).prev = TM_NIL;
+	TM_C(node).end = node;
+	tree->size++;
+
+	uint32_t path[TM_MAX_HEIGHT];
+	uint32_t x = tree->root, y = TM_NIL;
+	int depth = 0, c = 0;
+	while (x != TM_NIL) {
+		y = path[depth++] = x;
+		c = TM_COMPARE(elem, TM_H(x).elem);
+		if (c == 0)
+			break;
+		x = c < 0 ? TM_H(x).left : TM_H(x).right;
+	}
+
+	if (y == TM_NIL) {
+		tree->root = node;
+		return;
+	}
+	if (c < 0) {
+		TM_H(y).left = node;
+		TM_C(node).next = y;
+		TM_C(node).prev = TM_C(y).prev;
+		TM_C(y).prev = node;
+		if (TM_C(node).prev != TM_NIL)
+			TM_C(TM_C(node).prev).next = node;
+	} else {
+		// Goes after the end of the list of y (as a duplicate or a child)
+		uint32_t end = TM_C(y).end;
+		TM_C(node).prev = end;
+		TM_C(node).next = TM_C(end).next;
+		TM_C(end).next = node;
+		if (TM_C(node).next != TM_NIL)
+			TM_C(TM_C(node).next).prev = node;
+		if (c == 0) {
+			TM_C(y).end = node;
+			return;
+		}
+		TM_H(y).right = node;
+	}
+	TM_FN(fixUp)(tree, path, depth - 1);
+}
+
+
+/* Release the payloads and the slot of a node
+ */
+static inline void TM_FN(destroyNode)(TM_TREE *tree, uint32_t x) {
+	TM_KEY_DESTROY(TM_H(x).elem);
+	TM_INFO_DESTROY(TM_C(x).info);
+	TM_C(x).next = tree->freeList;
+	tree->freeList = x;
+}
+
+
+/* Remove a key from the tree
+ * ! If there are duplicates, the last one in the list is removed
+ */
+static inline void TM_FN(delete)(TM_TREE *tree, TM_KEY elem) {
+	uint32_t path[TM_MAX_HEIGHT];
+	uint32_t x = tree->root;
+	int depth = 0;
+	while (x != TM_NIL) {
+		path[depth++] = x;
+		int c = TM_COMPARE(elem, TM_H(x).elem);
+		if (c == 0)
+			break;
+		x = c < 0 ? TM_H(x).left : TM_H(x).right;
+	}
+	if (x == TM_NIL)
+		return;
+	tree->size--;
+
+	if (TM_C(x).end != x) {
+		uint32_t last = TM_C(x).end;
+		TM_C(x).end = TM_C(last).prev;
+		TM_C(TM_C(last).prev).next = TM_C(last).next;
+		if (TM_C(last).next != TM_NIL)
+			TM_C(TM_C(last).next).prev = TM_C(last).prev;
+		TM_FN(destroyNode)(tree, last);
+		return;
+	}
+
+	// Unlink x from the list
+	if (TM_C(x).prev != TM_NIL)
+		TM_C(TM_C(x).prev).next = TM_C(x).next;
+	if (TM_C(x).next != TM_NIL)
+		TM_C(TM_C(x).next).prev = TM_C(x).prev;
+
+	int at = depth - 1;
+	uint32_t parent = at > 0 ? path[at - 1] : TM_NIL;
+	if (TM_H(x).left == TM_NIL || TM_H(x).right == TM_NIL) {
+		TM_FN(replace)(tree, parent, x, TM_H(x).left != TM_NIL ? TM_H(x).left : TM_H(x).right);
+		depth--;
+	} else {
+		// Splice the successor in the place of x
+		uint32_t succ = TM_H(x).right;
+		path[depth++] = succ;
+		while (TM_H(succ).left != TM_NIL)
+			succ = path[depth++] = TM_H(succ).left;
+		if (depth - 2 != at) {
+			TM_H(path[depth - 2]).left = TM_H(succ).right;
+			TM_H(succ).right = TM_H(x).right;
+		}
+		// succ takes the height of x too, the climb may stop below it
+		TM_H(succ).left = TM_H(x).left;
+		TM_H(succ).height = TM_H(x).height;
+		TM_FN(replace)(tree, parent, x, succ);
+		path[at] = succ;
+		depth--;
+	}
+	TM_FN(destroyNode)(tree, x);
+	TM_FN(fixUp)(tree, path, depth - 1);
+}
+
+
+/* Free the tree, walking the list of duplicates for the payloads
+ */
+static inline void TM_FN(destroy)(TM_TREE *tree) {
+	if (tree == NULL)
+		return;
+	uint32_t x = tree->root != TM_NIL ? TM_FN(minimum)(tree, tree->root) : TM_NIL;
+	while (x != TM_NIL) {
+		uint32_t next = TM_C(x).next;
+		TM_KEY_DESTROY(TM_H(x).elem);
+		TM_INFO_DESTROY(TM_C(x).info);
+		x = next;
+	}
+	free(tree->hot);
+	free(tree->cold);
+	free(tree);
+}
+
+
+#undef TM_NAME
+#undef TM_KEY
+#undef TM_INFO
+#undef TM_COMPARE
+#undef TM_KEY_INIT
+#undef TM_INFO_INIT
+#undef TM_KEY_DESTROY
+#undef TM_INFO_DESTROY
+#undef TM_CONCAT_
+#undef TM_CONCAT
+#undef TM_FN
+#undef TM_HOT
+#undef TM_COLD
+#undef TM_TREE
+#undef TM_H
+#undef TM_C
@@ -0,0 +1,359 @@
+/*
+ * Compile-time specialized multi-dictionary
+ *
+ * The same AVL algorithms as TreeMap.c (including the threaded list of
+ * duplicates), but the key and info types, the comparison and the copies
+ * are fixed when the header is included, so the compiler can inline them
+ * instead of calling through the function pointers of TTree.
+ *
+ * Usage (the header can be included several times, once per variant):
+ *
+ *	#define TM_NAME avl_long					// prefix of the generated names
+ *	#define TM_KEY long							// type of the keys
+ *	#define TM_INFO long						// type of the infos
+ *	#define TM_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))	// three-way compare
+ *	#include "TreeMapTemplate.h"
+ *
+ * Optional: TM_KEY_INIT(dst, src) / TM_INFO_INIT(dst, src) to build the
+ * stored copies (plain assignment by default) and TM_KEY_DESTROY(k) /
+ * TM_INFO_DESTROY(i) to release them (nothing by default).
+ *
+ * Generated: struct TM_NAME (the tree), struct TM_NAME_node and
+ * TM_NAME_create, _isEmpty, _search, _minimum, _maximum, _successor,
+ * _predecessor, _insert, _delete, _destroy.
+ */
+
+#if !defined(TM_NAME) || !defined(TM_KEY) || !defined(TM_INFO) || !defined(TM_COMPARE)
+#error "TM_NAME, TM_KEY, TM_INFO and TM_COMPARE must be defined"
+#endif
+
+#include <stdlib.h>
+
+#ifndef TM_KEY_INIT
+#define TM_KEY_INIT(dst, src) ((dst) = (src))
+#endif
+#ifndef TM_INFO_INIT
+#define TM_INFO_INIT(dst, src) ((dst) = (src))
+#endif
+#ifndef TM_KEY_DESTROY
+#define TM_KEY_DESTROY(k) ((void)0)
+#endif
+#ifndef TM_INFO_DESTROY
+#define TM_INFO_DESTROY(i) ((void)0)
+#endif
+
+#define TM_CONCAT_(a, b) a##_##b
+#define TM_CONCAT(a, b) TM_CONCAT_(a, b)
+#define TM_FN(name) TM_CONCAT(TM_NAME, name)
+#define TM_NODE struct TM_FN(node)
+#define TM_TREE struct TM_NAME
+
+/*
+ * A node in the tree
+ */
+TM_NODE {
+	TM_KEY elem;			// element/key of the node
+	TM_INFO info;			// information of the node
+	TM_NODE *parent;		// parent of the node
+	TM_NODE *left;			// left child
+	TM_NODE *right;			// right child
+	TM_NODE *next;			// next node in the list of duplicates
+	TM_NODE *prev;			// previous node in the list of duplicates
+	TM_NODE *end;			// end of the list of duplicates for current node
+	long height;			// the height of the node in the tree
+};
+
+/*
+ * Representation of a multi-dictionary
+ */
+TM_TREE {
+	TM_NODE *root;			// root of the tree
+	long size;				// number of nodes in the tree
+};
+
+
+/* Create an empty tree
+ */
+static inline TM_TREE* TM_FN(create)(void) {
+	TM_TREE *tree = (TM_TREE *)malloc(sizeof(TM_TREE));
+	if (tree == NULL)
+		return NULL;
+	tree->root = NULL;
+	tree->size = 0;
+	return tree;
+}
+
+
+static inline int TM_FN(isEmpty)(TM_TREE *tree) {
+	return tree->root == NULL;
+}
+
+
+/* Search for the first node with the given key
+ */
+static inline TM_NODE* TM_FN(search)(TM_TREE *tree, TM_KEY elem) {
+	TM_NODE *x = tree->root;
+	while (x != NULL) {
+		int c = TM_COMPARE(elem, x->elem);
+		if (c == 0)
+			return x;
+		x = c < 0 ? x->left : x->right;
+	}
+	return NULL;
+}
+
+
+static inline TM_NODE* TM_FN(minimum)(TM_NODE *x) {
+	while (x->left != NULL)
+		x = x->left;
+	return x;
+}
+
+
+static inline TM_NODE* TM_FN(maximum)(TM_NODE *x) {
+	while (x->right != NULL)
+		x = x->right;
+	return x;
+}
+
+
+static inline TM_NODE* TM_FN(successor)(TM_NODE *x) {
+	if (x == NULL)
+		return NULL;
+	if (x->right != NULL)
+		return TM_FN(minimum)(x->right);
+	while (x->parent != NULL && x != x->parent->left)
+		x = x->parent;
+	return x->parent;
+}
+
+
+static inline TM_NODE* TM_FN(predecessor)(TM_NODE *x) {
+	if (x == NULL)
+		return NULL;
+	if (x->left != NULL)
+		return TM_FN(maximum)(x->left);
+	while (x->parent != NULL && x != x->parent->right)
+		x = x->parent;
+	return x->parent;
+}
+
+
+static inline long TM_FN(heightOf)(TM_NODE *x) {
+	return x == NULL ? 0 : x->height;
+}
+
+
+static inline void TM_FN(updateHeight)(TM_NODE *x) {
+	long l = TM_FN(heightOf)(x->left), r = TM_FN(heightOf)(x->right);
+	x->height = (l >= r ? l : r) + 1;
+}
+
+
+static inline int TM_FN(balance)(TM_NODE *x) {
+	return x == NULL ? 0 : TM_FN(heightOf)(x->left) - TM_FN(heightOf)(x->right);
+}
+
+
+/* Put node y in the place of the subtree rooted in x
+ */
+static inline void TM_FN(replace)(TM_TREE *tree, TM_NODE *x, TM_NODE *y) {
+	if (x->parent == NULL)
+		tree->root = y;
+	else if (x->parent->left == x)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	if (y != NULL)
+		y->parent = x->parent;
+}
+
+
+static inline void TM_FN(rotateLeft)(TM_TREE *tree, TM_NODE *x) {
+	TM_NODE *y = x->right;
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	TM_FN(replace)(tree, x, y);
+	y->left = x;
+	x->parent = y;
+	TM_FN(updateHeight)(x);
+	TM_FN(updateHeight)(y);
+}
+
+
+static inline void TM_FN(rotateRight)(TM_TREE *tree, TM_NODE *y) {
+	TM_NODE *x = y->left;
+	y->left = x->right;
+	if (x->right != NULL)
+		x->right->parent = y;
+	TM_FN(replace)(tree, y, x);
+	x->right = y;
+	y->parent = x;
+	TM_FN(updateHeight)(y);
+	TM_FN(updateHeight)(x);
+}
+
+
+/* Rebalance from y up to the root (single or double rotations)
+ */
+static inline void TM_FN(fixUp)(TM_TREE *tree, TM_NODE *y) {
+	while (y != NULL) {
+		TM_FN(updateHeight)(y);
+		int balance = TM_FN(balance)(y);
+		if (balance > 1) {
+			if (TM_FN(balance)(y->left) < 0)
+				TM_FN(rotateLeft)(tree, y->left);
+			TM_FN(rotateRight)(tree, y);
+			y = y->parent;
+		} else if (balance < -1) {
+			if (TM_FN(balance)(y->right) > 0)
+				TM_FN(rotateRight)(tree, y->right);
+			TM_FN(rotateLeft)(tree, y);
+			y = y->parent;
+		}
+		y = y->parent;
+	}
+}
+
+
+/* Insert a pair in the multi-dictionary
+ * (a duplicate key is appended to the list of its first node)
+ */
+static inline void TM_FN(insert)(TM_TREE *tree, TM_KEY elem, TM_INFO info) {
+	TM_NODE *node = (TM_NODE *)malloc(sizeof(TM_NODE));
+	if (node == NULL)
+		return;
+	TM_KEY_INIT(node->elem, elem);
+	TM_INFO_INIT(node->info, info);
+	node->parent = node->left = node->right = NULL;
+	node->next = node->prev = NULL;
+	node->end = node;
+	node->height = 1;
+	tree->size++;
+
+	TM_NODE *x = tree->root, *y = NULL;
+	int c = 0;
+	while (x != NULL) {
+		y = x;
+		c = TM_COMPARE(elem, x->elem);
+		if (c == 0)
+			break;
+		x = c < 0 ? x->left : x->right;
+	}
+
+	if (y == NULL) {
+		tree->root = node;
+	} else if (c == 0) {
+		// Duplicate: goes after the end of the list of y
+		node->prev = y->end;
+		node->next = y->end->next;
+		y->end->next = node;
+		if (node->next != NULL)
+			node->next->prev = node;
+		y->end = node;
+		return;
+	} else if (c > 0) {
+		node->parent = y;
+		y->right = node;
+		node->prev = y->end;
+		node->next = y->end->next;
+		y->end->next = node;
+		if (node->next != NULL)
+			node->next->prev = node;
+	} else {
+		node->parent = y;
+		y->left = node;
+		node->next = y;
+		node->prev = y->prev;
+		y->prev = node;
+		if (node->prev != NULL)
+			node->prev->next = node;
+	}
+	TM_FN(fixUp)(tree, y);
+}
+
+
+static inline void TM_FN(destroyNode)(TM_NODE *node) {
+	TM_KEY_DESTROY(node->elem);
+	TM_INFO_DESTROY(node->info);
+	free(node);
+}
+
+
+/* Remove a key from the tree
+ * ! If there are duplicates, the last one in the list is removed
+ */
+static inline void TM_FN(delete)(TM_TREE *tree, TM_KEY elem) {
+	TM_NODE *x = TM_FN(search)(tree, elem);
+	if (x == NULL)
+		return;
+	tree->size--;
+
+	if (x->end != x) {
+		TM_NODE *last = x->end;
+		x->end = last->prev;
+		last->prev->next = last->next;
+		if (last->next != NULL)
+			last->next->prev = last->prev;
+		TM_FN(destroyNode)(last);
+		return;
+	}
+
+	// Unlink x from the list
+	if (x->prev != NULL)
+		x->prev->next = x->next;
+	if (x->next != NULL)
+		x->next->prev = x->prev;
+
+	TM_NODE *fix;
+	if (x->left == NULL || x->right == NULL) {
+		fix = x->parent;
+		TM_FN(replace)(tree, x, x->left != NULL ? x->left : x->right);
+	} else {
+		// Splice the successor in the place of x
+		TM_NODE *succ = TM_FN(minimum)(x->right);
+		if (succ->parent != x) {
+			fix = succ->parent;
+			TM_FN(replace)(tree, succ, succ->right);
+			succ->right = x->right;
+			succ->right->parent = succ;
+		} else
+			fix = succ;
+		TM_FN(replace)(tree, x, succ);
+		succ->left = x->left;
+		succ->left->parent = succ;
+	}
+	TM_FN(destroyNode)(x);
+	TM_FN(fixUp)(tree, fix);
+}
+
+
+/* Free the tree, walking the list of duplicates
+ */
+static inline void TM_FN(destroy)(TM_TREE *tree) {
+	if (tree == NULL)
+		return;
+	TM_NODE *node = tree->root != NULL ? TM_FN(minimum)(tree->root) : NULL;
+	while (node != NULL) {
+		TM_NODE *temp = node;
+		node = node->next;
+		TM_FN(destroyNode)(temp);
+	}
+	free(tree);
+}
+
+
+#undef TM_NAME
+#undef TM_KEY
+#undef TM_INFO
+#undef TM_COMPARE
+#undef TM_KEY_INIT
+#undef TM_INFO_INIT
+#undef TM_KEY_DESTROY
+#undef TM_INFO_DESTROY
+#undef TM_CONCAT_
+#undef TM_CONCAT
+#undef TM_FN
+#undef TM_NODE
+#undef TM_TREE
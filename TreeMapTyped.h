@@ -0,0 +1,62 @@
+#ifndef TREEMAPTYPED_H_
+#define TREEMAPTYPED_H_
+
+#include <limits.h>
+#include <string.h>
+
+#include "Cipher.h"
+
+/*
+ * Specialized multi-dictionaries generated from TreeMapTemplate.h
+ * (and TreeMapPool.h, TreeMapBPlus.h)
+ */
+
+/* Keys and infos of type long (like createLong/compareLong) */
+#define TM_NAME avl_long
+#define TM_KEY long
+#define TM_INFO long
+#define TM_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+#include "TreeMapTemplate.h"
+
+/* The same, with the compact layout of TreeMapPool.h */
+#define TM_NAME avl_long_pool
+#define TM_KEY long
+#define TM_INFO long
+#define TM_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+#include "TreeMapPool.h"
+
+/* Words truncated to ELEMENT_TREE_LENGTH characters, packed as big-endian
+ * numbers by packKey (same order as compareStr), with their offset in the text
+ */
+#define TM_NAME avl_str5
+#define TM_KEY uint64_t
+#define TM_INFO int
+#define TM_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+#include "TreeMapTemplate.h"
+
+/* The same two key types in B+ trees, searched with vector compares */
+#define TM_NAME bpt_long
+#define TM_KEY long
+#define TM_INFO long
+#define TM_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+#define TM_BPLUS_PAD LONG_MAX
+#include "TreeMapBPlus.h"
+
+#define TM_NAME bpt_str5
+#define TM_KEY uint64_t
+#define TM_INFO int
+#define TM_COMPARE(a, b) (((a) > (b)) - ((a) < (b)))
+#define TM_BPLUS_PAD UINT64_MAX
+#include "TreeMapBPlus.h"
+
+
+/* Unpack an avl_str5 key into a string of ELEMENT_TREE_LENGTH characters
+ */
+static inline char* avl_str5_word(uint64_t key, char word[sizeof(uint64_t)]) {
+	uint64_t bytes = loadPackedKey(&key);
+	memcpy(word, &bytes, sizeof(uint64_t));
+	word[ELEMENT_TREE_LENGTH] = '\0';
+	return word;
+}
+
+#endif /* TREEMAPTYPED_H_ */
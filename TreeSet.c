@@ -0,0 +1,453 @@
+#include <stdlib.h>
+
+#include "TreeSet.h"
+
+/* Operations between two trees */
+#define SET_UNION 0
+#define SET_INTERSECT 1
+#define SET_DIFFERENCE 2
+
+/*
+ * A subtree detached from its tree, with its own list of duplicates
+ * (first->prev and last->next are NULL)
+ */
+typedef struct Span{
+	TreeNode *root;		// root of the subtree (parent is NULL)
+	TreeNode *first;	// first node of the list
+	TreeNode *last;		// last node of the list
+}Span;
+
+/*
+ * What the recursion needs to know about the two trees
+ */
+typedef struct SetContext{
+	TTree *tree;		// owner of the nodes of the first tree
+	TTree *owner;		// owner of the nodes of the second tree
+	ThreadPool *pool;	// workers for the independent subtrees (or NULL)
+	int op;				// SET_UNION, SET_INTERSECT or SET_DIFFERENCE
+}SetContext;
+
+/*
+ * Half of a recursion step, handed to another thread
+ */
+typedef struct SetTask{
+	PoolTask task;
+	SetContext *ctx;
+	Span a, b;			// the subtrees to merge
+	Span result;		// the merged subtree
+}SetTask;
+
+
+static const Span emptySpan = {NULL, NULL, NULL};
+
+
+static long heightOf(TreeNode* x) {
+	return x == NULL ? 0 : x->height;
+}
+
+
+/* Span covering a whole tree
+ */
+static Span spanOf(TreeNode* root) {
+	Span t = emptySpan;
+	if (root != NULL) {
+		t.root = root;
+		t.first = minimum(root);
+		t.last = maximum(root)->end;
+	}
+	return t;
+}
+
+
+/* Take a span apart into its left subtree, its root and its right
+ * subtree (the list is cut at the root and the root is left alone,
+ * keeping only its duplicates)
+ */
+static void expose(TTree* tree, Span t, Span* l, TreeNode** k, Span* r) {
+	TreeNode *x = t.root;
+	*l = *r = emptySpan;
+	if (x->left != NULL) {
+		l->root = x->left;
+		l->first = t.first;
+		l->last = x->prev;
+		l->last->next = NULL;
+		l->root->parent = NULL;
+	}
+	if (x->right != NULL) {
+		r->root = x->right;
+		r->first = x->end->next;
+		r->last = t.last;
+		r->first->prev = NULL;
+		r->root->parent = NULL;
+	}
+	x->prev = NULL;
+	x->end->next = NULL;
+	x->left = x->right = NULL;
+	updateNode(tree, x);
+	*k = x;
+}
+
+
+/* Join two AVL subtrees through a middle node (l < k < r)
+ * The taller subtree is descended along its spine until the heights
+ * match, k is hung there and the spine is rebalanced on the way up
+ *
+ * return: the root of the joined subtree
+ */
+static TreeNode* joinNodes(TTree* tree, TreeNode* l, TreeNode* k, TreeNode* r) {
+	TTree scratch = *tree;	// the rotations only use the root of the tree
+							// (and its node layout)
+	long hl = heightOf(l), hr = heightOf(r);
+	TreeNode *c, *p = NULL;
+
+	k->parent = NULL;
+	if (hl > hr + 1) {
+		for (c = l; heightOf(c) > hr + 1; c = c->right)
+			p = c;
+		k->left = c;
+		k->right = r;
+		p->right = k;
+	} else if (hr > hl + 1) {
+		for (c = r; heightOf(c) > hl + 1; c = c->left)
+			p = c;
+		k->left = l;
+		k->right = c;
+		p->left = k;
+	} else {
+		k->left = l;
+		k->right = r;
+	}
+	if (k->left != NULL)
+		k->left->parent = k;
+	if (k->right != NULL)
+		k->right->parent = k;
+	updateNode(tree, k);
+	if (p == NULL)
+		return k;
+
+	k->parent = p;
+	scratch.root = hl > hr ? l : r;
+	avlDeleteFixUp(&scratch, p);
+	return scratch.root;
+}
+
+
+/* Join two spans through a middle node, linking the lists
+ */
+static Span join(TTree* tree, Span l, TreeNode* k, Span r) {
+	Span t;
+	k->prev = l.last;
+	if (l.last != NULL)
+		l.last->next = k;
+	k->end->next = r.first;
+	if (r.first != NULL)
+		r.first->prev = k->end;
+	t.root = joinNodes(tree, l.root, k, r.root);
+	t.first = l.root != NULL ? l.first : k;
+	t.last = r.root != NULL ? r.last : k->end;
+	return t;
+}
+
+
+/* Split a span into the nodes smaller than the key, the node with the
+ * key (or NULL) and the nodes greater than the key
+ */
+static void split(TTree* tree, Span t, TreeKey* key, Span* l, TreeNode** found, Span* r) {
+	if (t.root == NULL) {
+		*l = *r = emptySpan;
+		*found = NULL;
+		return;
+	}
+	Span tl, tr, mid;
+	TreeNode *k;
+	int c = compareKey(tree, key, t.root);
+	expose(tree, t, &tl, &k, &tr);
+	if (c == 0) {
+		*l = tl;
+		*found = k;
+		*r = tr;
+	} else if (c < 0) {
+		split(tree, tl, key, l, found, &mid);
+		*r = join(tree, mid, k, tr);
+	} else {
+		split(tree, tr, key, &mid, found, r);
+		*l = join(tree, tl, k, mid);
+	}
+}
+
+
+/* Remove the greatest node of a non-empty span
+ */
+static void splitLast(TTree* tree, Span t, Span* rest, TreeNode** k) {
+	Span tl, tr;
+	TreeNode *x;
+	expose(tree, t, &tl, &x, &tr);
+	if (tr.root == NULL) {
+		*rest = tl;
+		*k = x;
+	} else {
+		splitLast(tree, tr, &tr, k);
+		*rest = join(tree, tl, x, tr);
+	}
+}
+
+
+/* Join two spans (l < r) without a middle node
+ */
+static Span join2(TTree* tree, Span l, Span r) {
+	TreeNode *k;
+	if (l.root == NULL)
+		return r;
+	if (r.root == NULL)
+		return l;
+	splitLast(tree, l, &l, &k);
+	return join(tree, l, k, r);
+}
+
+
+/* Number of entries of a span, from the summary of its root or counted
+ * along its list
+ */
+static long spanEntries(TTree* tree, Span t) {
+	long entries = 0;
+	if (t.root != NULL && tree->augmented)
+		return summaryOf(t.root)->weight;
+	for (TreeNode *x = t.first; x != NULL; x = x->next)
+		entries++;
+	return entries;
+}
+
+
+/* Destroy the nodes of a list (up to its NULL end)
+ */
+static void dropList(TTree* tree, TreeNode* node) {
+	while (node != NULL) {
+		TreeNode *temp = node;
+		node = node->next;
+		destroyTreeNode(tree, temp);
+	}
+}
+
+
+/* Move the occurrences of found after those of k
+ * (compacting trees: the node found becomes a chunk entry of k and
+ * its own chunks are linked after those of k)
+ */
+static void mergeDuplicates(SetContext* ctx, TreeNode* k, TreeNode* found) {
+	if (ctx->tree->dupSize == 0) {
+		k->end->next = found;
+		found->prev = k->end;
+		k->end = found->end;
+		if (ctx->tree->augmented)
+			summaryOf(k)->count += summaryOf(found)->count;
+		found->end = NULL;
+		return;
+	}
+	if (appendInfo(ctx->tree, k, found->info) == 0) {
+		InfoChunk **chunks = chunksOf(ctx->tree, k), **more = chunksOf(ctx->owner, found);
+		summaryOf(k)->count++;
+		if (*more != NULL) {
+			InfoChunk *last = (*more)->prev;
+			(*chunks)->prev->next = *more;
+			(*more)->prev = (*chunks)->prev;
+			(*chunks)->prev = last;
+			summaryOf(k)->count += summaryOf(found)->count - 1;
+			*more = NULL;
+		}
+	}
+	dropList(ctx->owner, found);
+}
+
+
+static Span setOp(SetContext* ctx, Span a, Span b);
+
+static void runSetTask(void* arg) {
+	SetTask *t = (SetTask *)arg;
+	t->result = setOp(t->ctx, t->a, t->b);
+}
+
+
+/* Merge two spans: the root of a splits b, the two halves are merged
+ * independently (in parallel for tall subtrees) and joined back
+ */
+static Span setOp(SetContext* ctx, Span a, Span b) {
+	if (a.root == NULL) {
+		if (ctx->op == SET_UNION)
+			return b;
+		dropList(ctx->owner, b.first);
+		return emptySpan;
+	}
+	if (b.root == NULL) {
+		if (ctx->op != SET_INTERSECT)
+			return a;
+		dropList(ctx->tree, a.first);
+		return emptySpan;
+	}
+
+	Span al, ar, bl, br, l, r;
+	TreeNode *k, *found;
+	expose(ctx->tree, a, &al, &k, &ar);
+	TreeKey key = makeKey(ctx->tree, k->elem);
+	split(ctx->tree, b, &key, &bl, &found, &br);
+
+	if (ctx->pool != NULL && heightOf(al.root) >= SET_PARALLEL_HEIGHT) {
+		SetTask left;
+		left.ctx = ctx;
+		left.a = al;
+		left.b = bl;
+		poolSubmit(ctx->pool, &left.task, runSetTask, &left);
+		r = setOp(ctx, ar, br);
+		poolWait(ctx->pool, &left.task);
+		l = left.result;
+	} else {
+		l = setOp(ctx, al, bl);
+		r = setOp(ctx, ar, br);
+	}
+
+	if (ctx->op == SET_UNION) {
+		// The duplicates of the second tree follow those of the first
+		if (found != NULL)
+			mergeDuplicates(ctx, k, found);
+		return join(ctx->tree, l, k, r);
+	}
+	if (found != NULL)
+		dropList(ctx->owner, found);
+	if ((ctx->op == SET_INTERSECT) == (found != NULL))
+		return join(ctx->tree, l, k, r);
+	dropList(ctx->tree, k);
+	return join2(ctx->tree, l, r);
+}
+
+
+/* Check that two trees order their keys in the same way
+ */
+static int compatible(TTree* tree, TTree* other) {
+	return tree != NULL && other != NULL && tree != other &&
+		   tree->compare == other->compare && tree->keyLength == other->keyLength &&
+		   tree->dupSize == other->dupSize && tree->augmented == other->augmented;
+}
+
+
+/* Rebuild the nodes of other with the allocator of tree
+ * (needed when one of them takes its nodes from an arena)
+ *
+ * return: the root of the rebuilt nodes
+ */
+static TreeNode* rehome(TTree* tree, TTree* other) {
+	TTree copy = *tree;		// same methods and allocator, no nodes
+	copy.slots = NULL;		// nor the hash index of tree
+	void **elems = (void **)malloc(other->size * sizeof(void *));
+	void **infos = (void **)malloc(other->size * sizeof(void *));
+	long n = 0;
+	copy.root = NULL;
+	copy.size = 0;
+	if (elems != NULL && infos != NULL) {
+		TreeCursor cursor = cursorAt(other, minimum(other->root));
+		for (; cursorValid(&cursor); cursorNext(&cursor), n++) {
+			elems[n] = cursorElem(&cursor);
+			infos[n] = cursorInfo(&cursor);
+		}
+		bulkLoadSorted(&copy, elems, infos, n);
+	}
+	free(elems);
+	free(infos);
+	return copy.root;
+}
+
+
+static int setOperation(TTree* tree, TTree* other, ThreadPool* pool, int op) {
+	if (!compatible(tree, other))
+		return -1;
+	// keys are merged by their counts: tombstones go first
+	compactTree(tree, -1);
+	compactTree(other, -1);
+	SetContext ctx;
+	ctx.tree = tree;
+	ctx.owner = other;
+	ctx.pool = tree->arena != NULL ? NULL : pool;
+	ctx.op = op;
+
+	Span b = spanOf(other->root);
+	if (other->root != NULL && (tree->arena != NULL || other->arena != NULL)) {
+		TreeNode *root = rehome(tree, other);
+		if (root == NULL)
+			return -1;
+		dropList(other, b.first);
+		b = spanOf(root);
+		ctx.owner = tree;
+	}
+
+	Span t = setOp(&ctx, spanOf(tree->root), b);
+	tree->root = t.root;
+	tree->size = spanEntries(tree, t);
+	other->root = NULL;
+	other->size = 0;
+	rebuildHashIndex(other);
+	return rebuildHashIndex(tree);
+}
+
+
+/* Keep in tree the entries of both trees
+ * (duplicates of tree come before those of other)
+ */
+int treeUnion(TTree* tree, TTree* other, ThreadPool* pool) {
+	return setOperation(tree, other, pool, SET_UNION);
+}
+
+
+/* Keep in tree its entries whose key is also in other
+ */
+int treeIntersect(TTree* tree, TTree* other, ThreadPool* pool) {
+	return setOperation(tree, other, pool, SET_INTERSECT);
+}
+
+
+/* Keep in tree its entries whose key is not in other
+ */
+int treeDifference(TTree* tree, TTree* other, ThreadPool* pool) {
+	return setOperation(tree, other, pool, SET_DIFFERENCE);
+}
+
+
+/* Append other to tree, in O(log n) (O(n) if a tree has a hash index,
+ * which is rebuilt)
+ * ! every key of other must be greater than the keys of tree
+ * and neither tree can use an arena
+ */
+int treeJoin(TTree* tree, TTree* other) {
+	if (!compatible(tree, other) || tree->arena != NULL || other->arena != NULL)
+		return -1;
+	if (tree->root != NULL && other->root != NULL &&
+		compareNodes(tree, maximum(tree->root), minimum(other->root)) >= 0)
+		return -1;
+	tree->root = join2(tree, spanOf(tree->root), spanOf(other->root)).root;
+	tree->size += other->size;
+	other->root = NULL;
+	other->size = 0;
+	rebuildHashIndex(other);
+	return rebuildHashIndex(tree);
+}
+
+
+/* Move the entries greater than elem from tree to the empty tree greater
+ * (the entries equal to elem stay in tree; the hash indexes of the trees
+ * are rebuilt)
+ * ! neither tree can use an arena
+ */
+int treeSplit(TTree* tree, void* elem, TTree* greater) {
+	if (!compatible(tree, greater) || greater->root != NULL ||
+		tree->arena != NULL || greater->arena != NULL)
+		return -1;
+	Span l, r;
+	TreeNode *found;
+	TreeKey key = makeKey(tree, elem);
+	split(tree, spanOf(tree->root), &key, &l, &found, &r);
+	if (found != NULL)
+		l = join(tree, l, found, emptySpan);
+	tree->root = l.root;
+	greater->root = r.root;
+	greater->size = spanEntries(tree, r);
+	tree->size -= greater->size;
+	int indexed = rebuildHashIndex(greater) == 0;
+	return rebuildHashIndex(tree) == 0 && indexed ? 0 : -1;
+}
@@ -0,0 +1,30 @@
+#ifndef TREESET_H_
+#define TREESET_H_
+
+#include "TreeMap.h"
+#include "ThreadPool.h"
+
+/* Subtrees lower than this are merged by a single thread */
+#define SET_PARALLEL_HEIGHT 12
+
+/*
+ * Join-based operations between multi-dictionaries
+ *
+ * Both trees must have been created with the same methods (and the
+ * same packed key length, compacted duplicates and summaries). The result is left in `tree' and `other'
+ * is emptied (its nodes are either moved into `tree' or destroyed),
+ * so it only has to be released with destroyTree.
+ *
+ * pool: worker threads for the independent subtrees (NULL - sequential)
+ * ! Trees using an arena are always merged sequentially
+ *
+ * return: 0 - on success, -1 - otherwise
+ */
+int treeUnion(TTree* tree, TTree* other, ThreadPool* pool);
+int treeIntersect(TTree* tree, TTree* other, ThreadPool* pool);
+int treeDifference(TTree* tree, TTree* other, ThreadPool* pool);
+
+int treeJoin(TTree* tree, TTree* other);
+int treeSplit(TTree* tree, void* elem, TTree* greater);
+
+#endif /* TREESET_H_ */
@@ -0,0 +1,484 @@
+#include <stdlib.h>
+
+#include "VersionedTree.h"
+
+#define MAX(a, b) (((a) >= (b))?(a):(b))
+
+/* Kinds of retired objects */
+#define RETIRED_NODE 0		// a node copied by a write (payloads still used)
+#define RETIRED_ENTRY 1		// a deleted node (payloads released with it)
+#define RETIRED_VERSION 2	// a replaced version
+
+
+/* Create an empty tree with a series of associated methods
+ *
+ * return: the created tree or NULL
+ */
+VTree* createVTree(void* (*createElement)(void*),
+				   void (*destroyElement)(void*),
+				   void* (*createInfo)(void*),
+				   void (*destroyInfo)(void*),
+				   int compare(void*, void*)) {
+	VTree *tree = (VTree *)malloc(sizeof(VTree));
+	VVersion *version = (VVersion *)malloc(sizeof(VVersion));
+	if (tree == NULL || version == NULL) {
+		free(tree);
+		free(version);
+		return NULL;
+	}
+	tree->createElement = createElement;
+	tree->destroyElement = destroyElement;
+	tree->createInfo = createInfo;
+	tree->destroyInfo = destroyInfo;
+	tree->compare = compare;
+	version->root = NULL;
+	version->size = 0;
+	version->number = 1;
+	atomic_init(&tree->current, version);
+	atomic_init(&tree->epoch, 1);
+	for (int i = 0; i < VTREE_READERS; i++)
+		atomic_init(&tree->readers[i], 0);
+	pthread_mutex_init(&tree->writer, NULL);
+	tree->seq = 0;
+	tree->retired = NULL;
+	tree->failed = 0;
+	return tree;
+}
+
+
+/* Release a retired object
+ */
+static void release(VTree* tree, VRetired* item) {
+	if (item->kind == RETIRED_ENTRY) {
+		VNode *x = (VNode *)item->ptr;
+		tree->destroyElement(x->elem);
+		tree->destroyInfo(x->info);
+	}
+	free(item->ptr);
+	free(item);
+}
+
+
+/* Queue an object replaced by the version being written
+ *
+ * return: 0 - on success, -1 - otherwise (the write has failed)
+ */
+static int retire(VTree* tree, void* ptr, int kind, unsigned long epoch) {
+	VRetired *item = (VRetired *)malloc(sizeof(VRetired));
+	if (item == NULL) {
+		tree->failed = 1;
+		return -1;
+	}
+	item->ptr = ptr;
+	item->kind = kind;
+	item->epoch = epoch;
+	item->copy = NULL;
+	item->next = tree->retired;
+	tree->retired = item;
+	return 0;
+}
+
+
+/* Drop a write that ran out of memory: free the copies it made and keep
+ * the objects it meant to replace (the current version still uses them)
+ *
+ * Its objects are the first ones queued, the only ones retired by version
+ */
+static void undoWrite(VTree* tree, unsigned long version) {
+	while (tree->retired != NULL && tree->retired->epoch == version) {
+		VRetired *temp = tree->retired;
+		tree->retired = temp->next;
+		free(temp->copy);
+		free(temp);
+	}
+	tree->failed = 0;
+}
+
+
+/* Free the retired objects no reader can reach any more: a reader that
+ * announced epoch e only uses versions >= e, which cannot reach the
+ * objects retired by versions <= e
+ */
+static void reclaim(VTree* tree) {
+	unsigned long oldest = atomic_load(&tree->epoch) + 1;
+	for (int i = 0; i < VTREE_READERS; i++) {
+		unsigned long e = atomic_load(&tree->readers[i]);
+		if (e != 0 && e < oldest)
+			oldest = e;
+	}
+	VRetired **item = &tree->retired;
+	while (*item != NULL) {
+		if ((*item)->epoch <= oldest) {
+			VRetired *temp = *item;
+			*item = temp->next;
+			release(tree, temp);
+		} else
+			item = &(*item)->next;
+	}
+}
+
+
+/* Compare two nodes by element, then by insertion
+ */
+static int compareNodes(VTree* tree, VNode* a, VNode* b) {
+	int c = tree->compare(a->elem, b->elem);
+	if (c != 0)
+		return c;
+	return (a->seq > b->seq) - (a->seq < b->seq);
+}
+
+
+static long heightOf(VNode* x) {
+	return x == NULL ? 0 : x->height;
+}
+
+
+static void updateHeight(VNode* x) {
+	x->height = MAX(heightOf(x->left), heightOf(x->right)) + 1;
+}
+
+
+static long balanceOf(VNode* x) {
+	return x == NULL ? 0 : heightOf(x->left) - heightOf(x->right);
+}
+
+
+/* Get a node that the version being written can change: the node itself
+ * if the version created it, a copy otherwise (the original is retired)
+ *
+ * return: the node, or NULL if memory ran out (the write has failed)
+ */
+static VNode* own(VTree* tree, VNode* x, unsigned long version) {
+	if (x->version == version)
+		return x;
+	VNode *copy = (VNode *)malloc(sizeof(VNode));
+	if (copy == NULL) {
+		tree->failed = 1;
+		return NULL;
+	}
+	if (retire(tree, x, RETIRED_NODE, version) != 0) {
+		free(copy);
+		return NULL;
+	}
+	*copy = *x;
+	copy->version = version;
+	tree->retired->copy = copy;
+	return copy;
+}
+
+
+/* Rotations on nodes owned by the version (the child is copied too)
+ * return: the new root of the subtree (NULL - the write has failed)
+ */
+static VNode* rotateLeft(VTree* tree, VNode* x, unsigned long version) {
+	VNode *y = own(tree, x->right, version);
+	if (y == NULL)
+		return NULL;
+	x->right = y->left;
+	y->left = x;
+	updateHeight(x);
+	updateHeight(y);
+	return y;
+}
+
+static VNode* rotateRight(VTree* tree, VNode* y, unsigned long version) {
+	VNode *x = own(tree, y->left, version);
+	if (x == NULL)
+		return NULL;
+	y->left = x->right;
+	x->right = y;
+	updateHeight(y);
+	updateHeight(x);
+	return x;
+}
+
+
+/* Rebalance a node owned by the version (single or double rotations)
+ * return: the new root of the subtree (NULL - the write has failed)
+ */
+static VNode* rebalance(VTree* tree, VNode* x, unsigned long version) {
+	if (tree->failed)
+		return NULL;
+	updateHeight(x);
+	long balance = balanceOf(x);
+	if (balance > 1) {
+		if (balanceOf(x->left) < 0) {
+			VNode *left = own(tree, x->left, version);
+			if (left == NULL || (x->left = rotateLeft(tree, left, version)) == NULL)
+				return NULL;
+		}
+		return rotateRight(tree, x, version);
+	}
+	if (balance < -1) {
+		if (balanceOf(x->right) > 0) {
+			VNode *right = own(tree, x->right, version);
+			if (right == NULL || (x->right = rotateRight(tree, right, version)) == NULL)
+				return NULL;
+		}
+		return rotateLeft(tree, x, version);
+	}
+	return x;
+}
+
+
+static VNode* insertNode(VTree* tree, VNode* x, VNode* node, unsigned long version) {
+	if (x == NULL)
+		return node;
+	x = own(tree, x, version);
+	if (x == NULL)
+		return NULL;
+	if (compareNodes(tree, node, x) < 0)
+		x->left = insertNode(tree, x->left, node, version);
+	else
+		x->right = insertNode(tree, x->right, node, version);
+	return rebalance(tree, x, version);
+}
+
+
+/* Detach the smallest node of a subtree
+ * return: the new root of the subtree
+ */
+static VNode* deleteMin(VTree* tree, VNode* x, VNode** min, unsigned long version) {
+	if (x->left == NULL) {
+		*min = x;
+		return x->right;
+	}
+	x = own(tree, x, version);
+	if (x == NULL)
+		return NULL;
+	x->left = deleteMin(tree, x->left, min, version);
+	return rebalance(tree, x, version);
+}
+
+
+static VNode* deleteNode(VTree* tree, VNode* x, VNode* target, unsigned long version) {
+	int c = compareNodes(tree, target, x);
+	if (c == 0) {
+		if (retire(tree, x, RETIRED_ENTRY, version) != 0)
+			return NULL;
+		if (x->left == NULL)
+			return x->right;
+		if (x->right == NULL)
+			return x->left;
+		// The successor takes the place of the node
+		VNode *min, *right = deleteMin(tree, x->right, &min, version);
+		if (tree->failed || (min = own(tree, min, version)) == NULL)
+			return NULL;
+		min->left = x->left;
+		min->right = right;
+		return rebalance(tree, min, version);
+	}
+	x = own(tree, x, version);
+	if (x == NULL)
+		return NULL;
+	if (c < 0)
+		x->left = deleteNode(tree, x->left, target, version);
+	else
+		x->right = deleteNode(tree, x->right, target, version);
+	return rebalance(tree, x, version);
+}
+
+
+/* Make a new version visible to the readers and free what they
+ * cannot reach any more (unless the write has failed)
+ *
+ * return: 0 - on success, -1 - otherwise (the write is dropped)
+ */
+static int publish(VTree* tree, VNode* root, long size, unsigned long number) {
+	VVersion *old = atomic_load(&tree->current);
+	VVersion *version = tree->failed ? NULL : (VVersion *)malloc(sizeof(VVersion));
+	if (version == NULL || retire(tree, old, RETIRED_VERSION, number) != 0) {
+		free(version);
+		undoWrite(tree, number);
+		return -1;
+	}
+	version->root = root;
+	version->size = size;
+	version->number = number;
+	atomic_store(&tree->current, version);
+	atomic_store(&tree->epoch, number);
+	reclaim(tree);
+	return 0;
+}
+
+
+/* Insert a pair, publishing a new version
+ * (a duplicate key goes after the previous occurrences)
+ *
+ * return: 0 - on success, -1 - otherwise (the tree is unchanged)
+ */
+int vtreeInsert(VTree* tree, void* elem, void* info) {
+	if (tree == NULL)
+		return -1;
+	VNode *node = (VNode *)malloc(sizeof(VNode));
+	if (node == NULL)
+		return -1;
+	node->elem = tree->createElement(elem);
+	node->info = tree->createInfo(info);
+	node->left = node->right = NULL;
+	node->height = 1;
+
+	pthread_mutex_lock(&tree->writer);
+	VVersion *current = atomic_load(&tree->current);
+	unsigned long version = current->number + 1;
+	node->seq = ++tree->seq;
+	node->version = version;
+	VNode *root = insertNode(tree, current->root, node, version);
+	int result = publish(tree, root, current->size + 1, version);
+	if (result != 0) {
+		tree->seq--;
+		tree->destroyElement(node->elem);
+		tree->destroyInfo(node->info);
+		free(node);
+	}
+	pthread_mutex_unlock(&tree->writer);
+	return result;
+}
+
+
+/* Remove the last occurrence of a key, publishing a new version
+ *
+ * return: 0 - on success (or if the key is missing),
+ *		   -1 - otherwise (the tree is unchanged)
+ */
+int vtreeDelete(VTree* tree, void* elem) {
+	if (tree == NULL)
+		return -1;
+	int result = 0;
+	pthread_mutex_lock(&tree->writer);
+	VVersion *current = atomic_load(&tree->current);
+	VNode *x = current->root, *last = NULL;
+	while (x != NULL) {
+		int c = tree->compare(elem, x->elem);
+		if (c == 0)
+			last = x;
+		x = c < 0 ? x->left : x->right;
+	}
+	if (last != NULL) {
+		unsigned long version = current->number + 1;
+		VNode *root = deleteNode(tree, current->root, last, version);
+		result = publish(tree, root, current->size - 1, version);
+	}
+	pthread_mutex_unlock(&tree->writer);
+	return result;
+}
+
+
+static void destroyNodes(VTree* tree, VNode* x) {
+	if (x == NULL)
+		return;
+	destroyNodes(tree, x->left);
+	destroyNodes(tree, x->right);
+	tree->destroyElement(x->elem);
+	tree->destroyInfo(x->info);
+	free(x);
+}
+
+
+/* Free the tree
+ * ! no snapshot can be open and no write can be running
+ */
+void destroyVTree(VTree* tree) {
+	if (tree == NULL)
+		return;
+	VVersion *current = atomic_load(&tree->current);
+	while (tree->retired != NULL) {
+		VRetired *temp = tree->retired;
+		tree->retired = temp->next;
+		release(tree, temp);
+	}
+	destroyNodes(tree, current->root);
+	free(current);
+	pthread_mutex_destroy(&tree->writer);
+	free(tree);
+}
+
+
+/* Pin the latest version of the tree, without blocking the writers
+ *
+ * The epoch is announced before the version is read, so the writers
+ * keep every object the read version can reach
+ *
+ * return: 0 - on success, -1 - if all the reader slots are taken
+ */
+int snapshotOpen(VTree* tree, VSnapshot* snapshot) {
+	if (tree == NULL || snapshot == NULL)
+		return -1;
+	for (int i = 0; i < VTREE_READERS; i++) {
+		unsigned long free_slot = 0;
+		unsigned long epoch = atomic_load(&tree->epoch);
+		if (atomic_compare_exchange_strong(&tree->readers[i], &free_slot, epoch)) {
+			snapshot->tree = tree;
+			snapshot->version = atomic_load(&tree->current);
+			snapshot->slot = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+
+/* Unpin a version (its nodes may be freed by the next write)
+ */
+void snapshotClose(VSnapshot* snapshot) {
+	if (snapshot == NULL || snapshot->tree == NULL)
+		return;
+	atomic_store(&snapshot->tree->readers[snapshot->slot], 0);
+	snapshot->tree = NULL;
+	snapshot->version = NULL;
+}
+
+
+/* Number of entries of a snapshot (duplicates included)
+ */
+long snapshotSize(VSnapshot* snapshot) {
+	return snapshot->version->size;
+}
+
+
+/* Search for the first occurrence of an element in a snapshot
+ */
+VNode* snapshotSearch(VSnapshot* snapshot, void* elem) {
+	VTree *tree = snapshot->tree;
+	VNode *x = snapshot->version->root, *found = NULL;
+	while (x != NULL) {
+		int c = tree->compare(elem, x->elem);
+		if (c == 0)
+			found = x;
+		x = c <= 0 ? x->left : x->right;
+	}
+	return found;
+}
+
+
+static long forEach(VTree* tree, VNode* x, void* lo, void* hi,
+					void (*visit)(VNode*, void*), void* arg) {
+	if (x == NULL)
+		return 0;
+	long count = 0;
+	int aboveLo = lo == NULL || tree->compare(x->elem, lo) > 0;
+	int belowHi = hi == NULL || tree->compare(x->elem, hi) < 0;
+	if (aboveLo)
+		count += forEach(tree, x->left, lo, hi, visit, arg);
+	if (aboveLo && belowHi) {
+		visit(x, arg);
+		count++;
+	}
+	if (belowHi)
+		count += forEach(tree, x->right, lo, hi, visit, arg);
+	return count;
+}
+
+
+/* Visit in increasing order (duplicates in insertion order) the entries
+ * of a snapshot with a key strictly between lo and hi
+ * (NULL - no lower/upper limit)
+ *
+ * return: the number of visited entries
+ */
+long snapshotForEach(VSnapshot* snapshot, void* lo, void* hi,
+					 void (*visit)(VNode*, void*), void* arg) {
+	if (snapshot == NULL || snapshot->version == NULL || visit == NULL)
+		return 0;
+	return forEach(snapshot->tree, snapshot->version->root, lo, hi, visit, arg);
+}
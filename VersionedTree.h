@@ -0,0 +1,94 @@
+#ifndef VERSIONEDTREE_H_
+#define VERSIONEDTREE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Readers that can hold a snapshot at the same time */
+#define VTREE_READERS 64
+
+/*
+ * A node of a version of the tree
+ * Once published a node is never changed: a write copies the path from
+ * the root to the nodes it changes and the old nodes stay valid for the
+ * snapshots still using them
+ */
+typedef struct VNode{
+	void* elem;					// element/key of the node
+	void* info;					// information of the node
+	unsigned long seq;			// insertion number (orders the duplicates)
+	unsigned long version;		// version that created the node
+	struct VNode *left;			// left child
+	struct VNode *right;		// right child
+	long height;				// the height of the node in the tree
+}VNode;
+
+/*
+ * A published state of the tree
+ */
+typedef struct VVersion{
+	VNode *root;				// root of this version
+	long size;					// number of entries (duplicates included)
+	unsigned long number;		// increases with every write
+}VVersion;
+
+/*
+ * Something replaced by a write, freed once no reader can reach it
+ */
+typedef struct VRetired{
+	void *ptr;					// the node or the version
+	int kind;					// what ptr is and what it owns
+	unsigned long epoch;		// first version that cannot reach it
+	void *copy;					// copy of the node made by the write
+								// (freed if the write is dropped)
+	struct VRetired *next;
+}VRetired;
+
+/*
+ * Multi-dictionary with snapshots: writers are serialized and publish a
+ * new version atomically, readers traverse a version without locks
+ */
+typedef struct VTree{
+	void* (*createElement)(void*);  // method for creating an element
+	void (*destroyElement)(void*);	// method for destroying an element
+	void* (*createInfo)(void*); 	// method for creating information
+	void (*destroyInfo)(void*); 	// method for deleting information
+	int (*compare)(void*, void*); 	// method for comparing two elements
+	_Atomic(VVersion*) current;		// the latest version
+	atomic_ulong epoch;				// number of the latest version
+	atomic_ulong readers[VTREE_READERS];	// epoch announced by every
+											// reader (0 - free slot)
+	pthread_mutex_t writer;			// serializes insert and delete
+	unsigned long seq;				// insertions made so far
+	VRetired *retired;				// waiting to be freed (writer only)
+	int failed;						// the write in progress ran out of
+									// memory (writer only)
+}VTree;
+
+/*
+ * A version pinned by a reader
+ */
+typedef struct VSnapshot{
+	VTree *tree;				// the tree of the version
+	VVersion *version;			// the pinned version
+	int slot;					// reader slot of the snapshot
+}VSnapshot;
+
+
+VTree* createVTree(void* (*createElement)(void*),
+				   void (*destroyElement)(void*),
+				   void* (*createInfo)(void*),
+				   void (*destroyInfo)(void*),
+				   int compare(void*, void*));
+int vtreeInsert(VTree* tree, void* elem, void* info);
+int vtreeDelete(VTree* tree, void* elem);
+void destroyVTree(VTree* tree);
+
+int snapshotOpen(VTree* tree, VSnapshot* snapshot);
+void snapshotClose(VSnapshot* snapshot);
+long snapshotSize(VSnapshot* snapshot);
+VNode* snapshotSearch(VSnapshot* snapshot, void* elem);
+long snapshotForEach(VSnapshot* snapshot, void* lo, void* hi,
+					 void (*visit)(VNode*, void*), void* arg);
+
+#endif /* VERSIONEDTREE_H_ */
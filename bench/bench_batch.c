@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TreeMap.h"
+
+/*
+ * Benchmark: insert() one pair at a time vs insertBatch() with batches
+ * of different sizes, for long keys and packed words
+ *
+ * Usage: bench_batch [number of pairs]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Random word of 1 to 7 letters (only the first 5 are kept in the tree) */
+static void randomWord(char *word) {
+	int len = 1 + rand() % 7;
+	for (int i = 0; i < len; i++)
+		word[i] = 'A' + rand() % 26;
+	word[len] = '\0';
+}
+
+static TTree* createLongTree() {
+	TTree *tree = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	treeUseArena(tree, sizeof(long), sizeof(long));
+	return tree;
+}
+
+static TTree* createWordTree() {
+	TTree *tree = createTree(NULL, NULL, createLong, destroyLong, NULL);
+	treeUsePackedKeys(tree, 5);
+	treeUseArena(tree, 0, sizeof(long));
+	return tree;
+}
+
+
+/* Time n inserts, one by one (batch 0) or in batches */
+static double run(TTree* (*create)(), void **elems, void **infos, long n, long batch) {
+	TTree *tree = create();
+	double start = now();
+	if (batch == 0) {
+		for (long i = 0; i < n; i++)
+			insert(tree, elems[i], infos[i]);
+	} else {
+		for (long i = 0; i < n; i += batch)
+			insertBatch(tree, elems + i, infos + i, n - i < batch ? n - i : batch);
+	}
+	double elapsed = now() - start;
+	destroyTree(tree);
+	return elapsed;
+}
+
+
+static void compare(const char *name, TTree* (*create)(), void **elems, void **infos, long n) {
+	double single = run(create, elems, infos, n, 0);
+	printf("%-6s insert:          %7.1f ns/op\n", name, single * 1e9 / n);
+	long batches[] = {1000, 100000, n};
+	for (int b = 0; b < 3; b++) {
+		double elapsed = run(create, elems, infos, n, batches[b]);
+		printf("%-6s batch %8ld:  %7.1f ns/op  speedup: %.2fx\n", name, batches[b],
+			   elapsed * 1e9 / n, single / elapsed);
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	srand(42);
+
+	long *values = malloc(sizeof(long) * n);
+	char (*words)[8] = malloc(8 * n);
+	void **elems = malloc(sizeof(void*) * n);
+	void **infos = malloc(sizeof(void*) * n);
+	for (long i = 0; i < n; i++) {
+		values[i] = ((long)rand() << 20) ^ rand();
+		elems[i] = infos[i] = values + i;
+	}
+	compare("long", createLongTree, elems, infos, n);
+
+	for (long i = 0; i < n; i++) {
+		randomWord(words[i]);
+		elems[i] = words[i];
+	}
+	compare("words", createWordTree, elems, infos, n);
+
+	free(values);
+	free(words);
+	free(elems);
+	free(infos);
+	return 0;
+}
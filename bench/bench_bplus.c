@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TreeMapTyped.h"
+
+/*
+ * Benchmark: AVL trees (TreeMapTemplate.h) vs B+ trees (TreeMapBPlus.h)
+ * for long keys and packed words: inserts, lookups, an in-order walk
+ * and deletes
+ *
+ * Usage: bench_bplus [number of keys] [number of lookups]
+ */
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static unsigned long next(unsigned long *seed) {
+	*seed = *seed * 6364136223846793005ul + 1442695040888963407ul;
+	return *seed >> 11;
+}
+
+static void report(const char *what, double avl, double bpt, long ops) {
+	printf("  %-8s avl: %7.1f ns/op  b+: %7.1f ns/op  speedup: %.2fx\n",
+		   what, avl * 1e9 / ops, bpt * 1e9 / ops, avl / bpt);
+}
+
+
+/* A random lowercase word, truncated by the key like the words of a text */
+static uint64_t randomWord(unsigned long *seed) {
+	char word[ELEMENT_TREE_LENGTH + 2];
+	unsigned long r = next(seed);
+	for (int i = 0; i <= ELEMENT_TREE_LENGTH; i++, r /= 26)
+		word[i] = 'a' + r % 26;
+	word[ELEMENT_TREE_LENGTH + 1] = '\0';
+	return packKey(word, ELEMENT_TREE_LENGTH);
+}
+
+
+static void benchLong(long n, long lookups) {
+	long *values = malloc(sizeof(long) * n);
+	long *probes = malloc(sizeof(long) * lookups);
+	unsigned long seed = 42;
+	for (long i = 0; i < n; i++)
+		values[i] = (long)next(&seed);
+	for (long i = 0; i < lookups; i++)
+		probes[i] = i % 2 ? values[next(&seed) % n] : (long)next(&seed);
+
+	struct avl_long *tree = avl_long_create();
+	struct bpt_long *bpt = bpt_long_create();
+	double start = now();
+	for (long i = 0; i < n; i++)
+		avl_long_insert(tree, values[i], i);
+	double avl = now() - start;
+	start = now();
+	for (long i = 0; i < n; i++)
+		bpt_long_insert(bpt, values[i], i);
+	double bplus = now() - start;
+	printf("long keys (%ld):\n", n);
+	report("insert", avl, bplus, n);
+
+	// The infos of the found keys are summed so the lookups are not dropped
+	long sum = 0, sumBpt = 0;
+	start = now();
+	for (long i = 0; i < lookups; i++) {
+		struct avl_long_node *x = avl_long_search(tree, probes[i]);
+		if (x != NULL)
+			sum += x->info;
+	}
+	avl = now() - start;
+	start = now();
+	for (long i = 0; i < lookups; i++) {
+		struct bpt_long_pos p = bpt_long_search(bpt, probes[i]);
+		if (p.leaf != NULL)
+			sumBpt += p.leaf->infos[p.slot];
+	}
+	bplus = now() - start;
+	report("search", avl, bplus, lookups);
+
+	long walk = 0, walkBpt = 0;
+	start = now();
+	for (struct avl_long_node *x = avl_long_minimum(tree->root); x != NULL; x = x->next)
+		walk += x->info;
+	avl = now() - start;
+	start = now();
+	for (struct bpt_long_pos p = bpt_long_minimum(bpt); p.leaf != NULL; p = bpt_long_successor(bpt, p))
+		walkBpt += p.leaf->infos[p.slot];
+	bplus = now() - start;
+	report("walk", avl, bplus, n);
+
+	start = now();
+	for (long i = 0; i < n; i++)
+		avl_long_delete(tree, values[i]);
+	avl = now() - start;
+	start = now();
+	for (long i = 0; i < n; i++)
+		bpt_long_delete(bpt, values[i]);
+	bplus = now() - start;
+	report("delete", avl, bplus, n);
+	if (sum != sumBpt || walk != walkBpt || !avl_long_isEmpty(tree) || !bpt_long_isEmpty(bpt))
+		printf("  MISMATCH\n");
+
+	avl_long_destroy(tree);
+	bpt_long_destroy(bpt);
+	free(values);
+	free(probes);
+}
+
+
+static void benchWords(long n, long lookups) {
+	uint64_t *values = malloc(sizeof(uint64_t) * n);
+	uint64_t *probes = malloc(sizeof(uint64_t) * lookups);
+	unsigned long seed = 7;
+	for (long i = 0; i < n; i++)
+		values[i] = randomWord(&seed);
+	for (long i = 0; i < lookups; i++)
+		probes[i] = i % 2 ? values[next(&seed) % n] : randomWord(&seed);
+
+	struct avl_str5 *tree = avl_str5_create();
+	struct bpt_str5 *bpt = bpt_str5_create();
+	double start = now();
+	for (long i = 0; i < n; i++)
+		avl_str5_insert(tree, values[i], (int)i);
+	double avl = now() - start;
+	start = now();
+	for (long i = 0; i < n; i++)
+		bpt_str5_insert(bpt, values[i], (int)i);
+	double bplus = now() - start;
+	printf("packed words (%ld):\n", n);
+	report("insert", avl, bplus, n);
+
+	long sum = 0, sumBpt = 0;
+	start = now();
+	for (long i = 0; i < lookups; i++) {
+		struct avl_str5_node *x = avl_str5_search(tree, probes[i]);
+		if (x != NULL)
+			sum += x->info;
+	}
+	avl = now() - start;
+	start = now();
+	for (long i = 0; i < lookups; i++) {
+		struct bpt_str5_pos p = bpt_str5_search(bpt, probes[i]);
+		if (p.leaf != NULL)
+			sumBpt += p.leaf->infos[p.slot];
+	}
+	bplus = now() - start;
+	report("search", avl, bplus, lookups);
+	if (sum != sumBpt)
+		printf("  MISMATCH\n");
+
+	avl_str5_destroy(tree);
+	bpt_str5_destroy(bpt);
+	free(values);
+	free(probes);
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 10000000;
+	long lookups = argc > 2 ? atol(argv[2]) : 10000000;
+
+	benchLong(n, lookups);
+	benchWords(n, lookups);
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TreeMap.h"
+#include "ConcurrentTree.h"
+
+/*
+ * Benchmark: inserts from 1, 2, 4, ... writer threads into a CTree,
+ * compared with a TTree behind one mutex
+ *
+ * Usage: bench_concurrent [inserts per run] [max writers]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+typedef struct Worker{
+	CTree *tree;				// the concurrent tree or NULL
+	TTree *locked;				// the tree behind the mutex
+	pthread_mutex_t *lock;
+	long inserts;
+	unsigned int seed;
+}Worker;
+
+/* Random keys, about one in four is a duplicate */
+static void* writer(void* arg) {
+	Worker *w = (Worker *)arg;
+	long range = w->inserts * 3;
+	for (long i = 0; i < w->inserts; i++) {
+		long key = ((long)rand_r(&w->seed) << 16 ^ rand_r(&w->seed)) % range;
+		if (w->tree != NULL) {
+			ctreeInsert(w->tree, &key, &i);
+		} else {
+			pthread_mutex_lock(w->lock);
+			insert(w->locked, &key, &i);
+			pthread_mutex_unlock(w->lock);
+		}
+	}
+	return NULL;
+}
+
+/* Run the writers on an empty tree
+ *
+ * return: inserts per second
+ */
+static double run(int concurrent, long n, int writers) {
+	CTree *tree = concurrent ? createCTree(createLong, destroyLong, createLong,
+										   destroyLong, compareLong) : NULL;
+	TTree *locked = concurrent ? NULL : createTree(createLong, destroyLong,
+												   createLong, destroyLong, compareLong);
+	pthread_mutex_t lock;
+	pthread_mutex_init(&lock, NULL);
+	Worker *workers = malloc(sizeof(Worker) * writers);
+	pthread_t *threads = malloc(sizeof(pthread_t) * writers);
+
+	double start = now();
+	for (int i = 0; i < writers; i++) {
+		workers[i] = (Worker){tree, locked, &lock, n / writers, 31 + i};
+		pthread_create(&threads[i], NULL, writer, &workers[i]);
+	}
+	for (int i = 0; i < writers; i++)
+		pthread_join(threads[i], NULL);
+	double elapsed = now() - start;
+
+	if (tree != NULL)
+		destroyCTree(tree);
+	else
+		destroyTree(locked);
+	pthread_mutex_destroy(&lock);
+	free(workers);
+	free(threads);
+	return (n / writers) * writers / elapsed;
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	int maxWriters = argc > 2 ? atoi(argv[2]) : 8;
+
+	double base = 0;
+	for (int writers = 1; writers <= maxWriters; writers *= 2) {
+		double locked = run(0, n, writers);
+		double rate = run(1, n, writers);
+		if (writers == 1)
+			base = rate;
+		printf("writers: %2d  ctree: %6.2f M/s  scaling: %.2fx  mutex + TTree: %6.2f M/s\n",
+			   writers, rate * 1e-6, rate / base, locked * 1e-6);
+	}
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TreeMap.h"
+
+/*
+ * Benchmark: search() and insert() on a tree vs the same tree with a
+ * hash index (treeUseHashIndex), for long keys and packed words
+ *
+ * Usage: bench_hash [number of keys] [number of lookups]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static uint64_t hashLong(void* value) {
+	return *((long*)value);
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Random word of 1 to 7 letters (only the first 5 are kept in the tree) */
+static void randomWord(char *word) {
+	int len = 1 + rand() % 7;
+	for (int i = 0; i < len; i++)
+		word[i] = 'A' + rand() % 26;
+	word[len] = '\0';
+}
+
+
+/* Build a tree from the keys, then time the lookups on it */
+static void run(const char *name, int words, int indexed, void **elems, long n,
+				void **keys, long lookups) {
+	TTree *tree;
+	if (words) {
+		tree = createTree(NULL, NULL, createLong, destroyLong, NULL);
+		treeUsePackedKeys(tree, 5);
+	} else
+		tree = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	treeUseArena(tree, words ? 0 : sizeof(long), sizeof(long));
+	if (indexed)
+		treeUseHashIndex(tree, words ? NULL : hashLong);
+
+	double start = now();
+	for (long i = 0; i < n; i++)
+		insert(tree, elems[i], &i);
+	double inserts = now() - start;
+
+	long found = 0;
+	resetTreeCounters();
+	start = now();
+	for (long i = 0; i < lookups; i++)
+		found += search(tree, tree->root, keys[i]) != NULL;
+	double lookup = now() - start;
+
+	printf("%-6s %-10s insert: %7.1f ns/op  search: %7.1f ns/op  "
+		   "comparisons: %5.2f/search  found: %ld/%ld\n",
+		   name, indexed ? "hash index" : "tree", inserts * 1e9 / n, lookup * 1e9 / lookups,
+		   (double) treeCounters.compares / lookups, found, lookups);
+	destroyTree(tree);
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	long lookups = argc > 2 ? atol(argv[2]) : 1000000;
+	srand(42);
+
+	long *values = malloc(sizeof(long) * n);
+	void **elems = malloc(sizeof(void*) * n);
+	for (long i = 0; i < n; i++) {
+		values[i] = ((long)rand() << 20) ^ rand();
+		elems[i] = values + i;
+	}
+	long *probes = malloc(sizeof(long) * lookups);
+	void **keys = malloc(sizeof(void*) * lookups);
+	for (long i = 0; i < lookups; i++) {
+		probes[i] = i % 2 ? values[rand() % n] : ((long)rand() << 20) ^ rand();
+		keys[i] = probes + i;
+	}
+	run("long", 0, 0, elems, n, keys, lookups);
+	run("long", 0, 1, elems, n, keys, lookups);
+
+	char (*words)[8] = malloc(8 * n);
+	for (long i = 0; i < n; i++) {
+		randomWord(words[i]);
+		elems[i] = words[i];
+	}
+	char (*queries)[8] = malloc(8 * lookups);
+	for (long i = 0; i < lookups; i++) {
+		if (i % 2)
+			strcpy(queries[i], words[rand() % n]);
+		else
+			randomWord(queries[i]);
+		keys[i] = queries[i];
+	}
+	run("words", 1, 0, elems, n, keys, lookups);
+	run("words", 1, 1, elems, n, keys, lookups);
+
+	free(values);
+	free(elems);
+	free(probes);
+	free(keys);
+	free(words);
+	free(queries);
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TreeMapTyped.h"
+
+/*
+ * Benchmark: pointer nodes (TreeMapTemplate.h) vs the compact layout
+ * of TreeMapPool.h on a search-heavy workload
+ *
+ * Usage: bench_layout [number of keys] [number of lookups]
+ */
+
+#define CACHE_LINE 64
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	long lookups = argc > 2 ? atol(argv[2]) : 4000000;
+	srand(42);
+
+	struct avl_long *tree = avl_long_create();
+	struct avl_long_pool *pool = avl_long_pool_create();
+	long *probes = malloc(sizeof(long) * lookups);
+	long *values = malloc(sizeof(long) * n);
+	for (long i = 0; i < n; i++) {
+		values[i] = ((long)rand() << 20) ^ rand();
+		avl_long_insert(tree, values[i], i);
+		avl_long_pool_insert(pool, values[i], i);
+	}
+	for (long i = 0; i < lookups; i++)
+		probes[i] = i % 2 ? values[rand() % n] : ((long)rand() << 20) ^ rand();
+
+	// The infos of the found nodes are summed so the lookups are not dropped
+	long found = 0, sum = 0;
+	double start = now();
+	for (long i = 0; i < lookups; i++) {
+		struct avl_long_node *x = avl_long_search(tree, probes[i]);
+		if (x != NULL) {
+			found++;
+			sum += x->info;
+		}
+	}
+	double pointers = now() - start;
+
+	long foundPool = 0, sumPool = 0;
+	start = now();
+	for (long i = 0; i < lookups; i++) {
+		uint32_t x = avl_long_pool_search(pool, probes[i]);
+		if (x != TM_NIL) {
+			foundPool++;
+			sumPool += pool->cold[x].info;
+		}
+	}
+	double compact = now() - start;
+
+	printf("pointer nodes: %3zu bytes, %.2f nodes/line  search: %7.1f ns/op\n",
+		   sizeof(struct avl_long_node),
+		   (double)CACHE_LINE / sizeof(struct avl_long_node), pointers * 1e9 / lookups);
+	printf("compact nodes: %3zu bytes hot + %zu cold, %.2f nodes/line  search: %7.1f ns/op\n",
+		   sizeof(struct avl_long_pool_hot), sizeof(struct avl_long_pool_cold),
+		   (double)CACHE_LINE / sizeof(struct avl_long_pool_hot), compact * 1e9 / lookups);
+	printf("speedup: %.2fx  found: %ld/%ld%s\n", pointers / compact, found, lookups,
+		   found == foundPool && sum == sumPool ? "" : "  MISMATCH");
+
+	avl_long_destroy(tree);
+	avl_long_pool_destroy(pool);
+	free(values);
+	free(probes);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TreeMap.h"
+
+/*
+ * Benchmark: latency of delete() on an eager tree vs a lazy tree
+ * (tombstones), then the time compactTree() needs to remove them
+ *
+ * Usage: bench_lazy [number of keys]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compareDouble(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+
+/* Delete half of the keys, timing every delete */
+static void run(const char *name, long *values, long n, double ratio) {
+	TTree *tree = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	treeUseArena(tree, sizeof(long), sizeof(long));
+	if (ratio > 0)
+		treeLazyDelete(tree, ratio);
+	for (long i = 0; i < n; i++)
+		insert(tree, values + i, values + i);
+
+	long deletes = n / 2;
+	double *latency = malloc(sizeof(double) * deletes);
+	double start = now();
+	for (long i = 0; i < deletes; i++) {
+		double t = now();
+		delete(tree, values + i);
+		latency[i] = now() - t;
+	}
+	double total = now() - start;
+	qsort(latency, deletes, sizeof(double), compareDouble);
+
+	start = now();
+	long removed = compactTree(tree, -1);
+	double compact = now() - start;
+	printf("%-18s delete: %6.1f ns/op  p50: %6.1f  p99: %7.1f  max: %9.1f ns  "
+		   "compactTree: %6.1f ms (%ld tombstones)\n", name, total * 1e9 / deletes,
+		   latency[deletes / 2] * 1e9, latency[deletes * 99 / 100] * 1e9,
+		   latency[deletes - 1] * 1e9, compact * 1e3, removed);
+	free(latency);
+	destroyTree(tree);
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	srand(42);
+	long *values = malloc(sizeof(long) * n);
+	for (long i = 0; i < n; i++)
+		values[i] = ((long)rand() << 20) ^ rand();
+
+	run("eager", values, n, 0);
+	run("lazy, ratio 0.25", values, n, 0.25);
+	run("lazy, no limit", values, n, 1e18);
+	free(values);
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TreeMap.h"
+#include "LoggedTree.h"
+
+/*
+ * Benchmark: insert() vs loggedInsert() with groups of different sizes,
+ * then the time to restart from the checkpoint and the log
+ *
+ * Usage: bench_logged [number of keys] [base name of the files]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static TTree* createLongTree() {
+	TTree *tree = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	treeUseArena(tree, sizeof(long), sizeof(long));
+	return tree;
+}
+
+static void removeFiles(char *baseName) {
+	char name[1024];
+	snprintf(name, sizeof(name), "%s.snap", baseName);
+	remove(name);
+	snprintf(name, sizeof(name), "%s.wal", baseName);
+	remove(name);
+}
+
+
+/* Time n logged inserts committed in groups of the given size */
+static double timeLogged(char *baseName, long *values, long n, long group) {
+	removeFiles(baseName);
+	TTree *tree = createLongTree();
+	LTree *logged = openLoggedTree(tree, baseName, sizeof(long), sizeof(long));
+	logged->groupRecords = group;
+	double start = now();
+	for (long i = 0; i < n; i++)
+		loggedInsert(logged, values + i, values + i);
+	loggedSync(logged);
+	double elapsed = now() - start;
+	closeLoggedTree(logged);
+	destroyTree(tree);
+	return elapsed;
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	char *baseName = argc > 2 ? argv[2] : "bench_logged";
+	srand(42);
+
+	long *values = malloc(sizeof(long) * n);
+	for (long i = 0; i < n; i++)
+		values[i] = ((long)rand() << 20) ^ rand();
+
+	double start = now();
+	TTree *tree = createLongTree();
+	for (long i = 0; i < n; i++)
+		insert(tree, values + i, values + i);
+	double memory = now() - start;
+	destroyTree(tree);
+	printf("insert:                   %7.1f ns/op\n", memory * 1e9 / n);
+
+	// a flush per change is slow: only a sample of it is timed
+	long sample = n < 2000 ? n : 2000;
+	long groups[] = {1, 16, LOG_GROUP_RECORDS, 1024};
+	for (int g = 0; g < 4; g++) {
+		long count = groups[g] == 1 ? sample : n;
+		double elapsed = timeLogged(baseName, values, count, groups[g]);
+		printf("loggedInsert, group %4ld: %7.1f ns/op  (%.2fx insert)\n", groups[g],
+			   elapsed * 1e9 / count, elapsed / count / (memory / n));
+	}
+
+	// restart: the last run checkpointed every LOG_CHECKPOINT_BYTES
+	start = now();
+	tree = createLongTree();
+	LTree *logged = openLoggedTree(tree, baseName, sizeof(long), sizeof(long));
+	double restart = now() - start;
+	printf("restart: %.1f ms  (%ld entries, %.1f MB of log replayed)\n", restart * 1e3,
+		   tree->size, logged->logBytes / 1e6);
+	closeLoggedTree(logged);
+	destroyTree(tree);
+	removeFiles(baseName);
+	free(values);
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TreeMap.h"
+#include "MappedTree.h"
+
+/*
+ * Benchmark: restarting by re-inserting every key vs mapping a snapshot
+ * saved with saveTree(), then search() vs mappedSearch()
+ *
+ * Usage: bench_mapped [number of keys] [number of lookups] [file]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	long lookups = argc > 2 ? atol(argv[2]) : 1000000;
+	char *fileName = argc > 3 ? argv[3] : "bench_mapped.snap";
+	srand(42);
+
+	long *values = malloc(sizeof(long) * n);
+	for (long i = 0; i < n; i++)
+		values[i] = ((long)rand() << 20) ^ rand();
+
+	// What every start does today: insert the keys one by one
+	double start = now();
+	TTree *tree = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	treeUseArena(tree, sizeof(long), sizeof(long));
+	for (long i = 0; i < n; i++)
+		insert(tree, values + i, values + i);
+	double rebuild = now() - start;
+
+	start = now();
+	if (saveTree(tree, fileName, sizeof(long), sizeof(long)) != 0) {
+		printf("saveTree failed\n");
+		return 1;
+	}
+	double save = now() - start;
+
+	start = now();
+	MTree *mapped = loadTree(fileName, compareLong);
+	double load = now() - start;
+
+	long *probes = malloc(sizeof(long) * lookups);
+	for (long i = 0; i < lookups; i++)
+		probes[i] = i % 2 ? values[rand() % n] : ((long)rand() << 20) ^ rand();
+
+	long found = 0, entries = 0, same = 1;
+	start = now();
+	for (long i = 0; i < lookups; i++)
+		found += search(tree, tree->root, probes + i) != NULL;
+	double live = now() - start;
+
+	start = now();
+	for (long i = 0; i < lookups; i++)
+		entries += mappedSearch(mapped, probes + i) >= 0;
+	double mappedTime = now() - start;
+
+	for (long i = 0; i < lookups; i += 97) {
+		TreeNode *x = search(tree, tree->root, probes + i);
+		long entry = mappedSearch(mapped, probes + i);
+		if (x == NULL)
+			same &= entry == -1;
+		else
+			same &= *((long*)mappedInfo(mapped, entry)) == *((long*)x->info);
+	}
+	printf("keys: %ld  rebuild: %.1f ms  save: %.1f ms  load: %.3f ms  "
+		   "file: %.1f MB\n", n, rebuild * 1e3, save * 1e3, load * 1e3,
+		   mapped->length / 1e6);
+	printf("search: %7.1f ns/op  mappedSearch: %7.1f ns/op  found: %ld/%ld%s\n",
+		   live * 1e9 / lookups, mappedTime * 1e9 / lookups, found, lookups,
+		   same && found == entries ? "" : "  MISMATCH");
+
+	closeMappedTree(mapped);
+	destroyTree(tree);
+	remove(fileName);
+	free(values);
+	free(probes);
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "TreeMap.h"
+
+/*
+ * Benchmark: looping over search() vs searchBatch()
+ *
+ * Usage: bench_search [number of keys] [number of lookups]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Random word of 1 to 7 letters (only the first 5 are kept in the tree) */
+static void randomWord(char *word) {
+	int len = 1 + rand() % 7;
+	for (int i = 0; i < len; i++)
+		word[i] = 'A' + rand() % 26;
+	word[len] = '\0';
+}
+
+
+/* Time both ways of resolving the same lookups
+ * and check that they find the same nodes
+ */
+static void run(const char *name, TTree *tree, void **keys, long lookups) {
+	TreeNode **single = malloc(sizeof(TreeNode*) * lookups);
+	TreeNode **batch = malloc(sizeof(TreeNode*) * lookups);
+
+	double start = now();
+	for (long i = 0; i < lookups; i++)
+		single[i] = search(tree, tree->root, keys[i]);
+	double loop = now() - start;
+
+	start = now();
+	searchBatch(tree, keys, lookups, batch);
+	double batched = now() - start;
+
+	long found = 0, same = 1;
+	for (long i = 0; i < lookups; i++) {
+		found += single[i] != NULL;
+		same &= single[i] == batch[i];
+	}
+	printf("%-6s search: %7.1f ns/op  searchBatch: %7.1f ns/op  "
+		   "speedup: %.2fx  found: %ld/%ld%s\n",
+		   name, loop * 1e9 / lookups, batched * 1e9 / lookups,
+		   loop / batched, found, lookups, same ? "" : "  MISMATCH");
+	free(single);
+	free(batch);
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 1000000;
+	long lookups = argc > 2 ? atol(argv[2]) : 1000000;
+	srand(42);
+
+	// Long keys, payloads kept in the arena
+	TTree *tree = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	treeUseArena(tree, sizeof(long), sizeof(long));
+	long *values = malloc(sizeof(long) * n);
+	for (long i = 0; i < n; i++) {
+		values[i] = ((long)rand() << 20) ^ rand();
+		insert(tree, values + i, values + i);
+	}
+	long *probes = malloc(sizeof(long) * lookups);
+	void **keys = malloc(sizeof(void*) * lookups);
+	for (long i = 0; i < lookups; i++) {
+		probes[i] = i % 2 ? values[rand() % n] : ((long)rand() << 20) ^ rand();
+		keys[i] = probes + i;
+	}
+	run("long", tree, keys, lookups);
+	destroyTree(tree);
+
+	// Words packed inside the nodes
+	tree = createTree(NULL, NULL, createLong, destroyLong, NULL);
+	treeUsePackedKeys(tree, 5);
+	treeUseArena(tree, 0, sizeof(long));
+	char (*words)[8] = malloc(8 * n);
+	for (long i = 0; i < n; i++) {
+		randomWord(words[i]);
+		insert(tree, words[i], &i);
+	}
+	char (*queries)[8] = malloc(8 * lookups);
+	for (long i = 0; i < lookups; i++) {
+		if (i % 2)
+			strcpy(queries[i], words[rand() % n]);
+		else
+			randomWord(queries[i]);
+		keys[i] = queries[i];
+	}
+	run("words", tree, keys, lookups);
+	destroyTree(tree);
+
+	free(values);
+	free(probes);
+	free(keys);
+	free(words);
+	free(queries);
+	return 0;
+}
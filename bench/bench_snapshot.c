@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "VersionedTree.h"
+
+/*
+ * Benchmark: lookups on snapshots from 1, 2, 4, ... reader threads while
+ * one writer keeps inserting and deleting
+ *
+ * Usage: bench_snapshot [number of keys] [max readers] [ms per run]
+ */
+
+static void* createLong(void* value) {
+	long *l = malloc(sizeof(long));
+	*l = *((long*) (value));
+	return l;
+}
+
+static void destroyLong(void* value) {
+	free(value);
+}
+
+static int compareLong(void* a, void* b) {
+	if (*((long*)a) < *((long*)b)) return -1;
+	if (*((long*)a) > *((long*)b)) return  1;
+	return 0;
+}
+
+static double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+typedef struct Worker{
+	VTree *tree;
+	long keys;
+	atomic_int *stop;
+	long ops;
+	unsigned int seed;
+}Worker;
+
+/* Every snapshot serves a small batch of lookups */
+static void* reader(void* arg) {
+	Worker *w = (Worker *)arg;
+	w->ops = 0;
+	while (!atomic_load(w->stop)) {
+		VSnapshot snapshot;
+		if (snapshotOpen(w->tree, &snapshot) != 0)
+			continue;
+		for (int i = 0; i < 64; i++) {
+			long key = rand_r(&w->seed) % w->keys;
+			snapshotSearch(&snapshot, &key);
+		}
+		snapshotClose(&snapshot);
+		w->ops += 64;
+	}
+	return NULL;
+}
+
+static void* writer(void* arg) {
+	Worker *w = (Worker *)arg;
+	w->ops = 0;
+	while (!atomic_load(w->stop)) {
+		long key = rand_r(&w->seed) % w->keys;
+		vtreeInsert(w->tree, &key, &key);
+		vtreeDelete(w->tree, &key);
+		w->ops += 2;
+	}
+	return NULL;
+}
+
+
+int main(int argc, char *argv[]) {
+	long n = argc > 1 ? atol(argv[1]) : 100000;
+	int maxReaders = argc > 2 ? atoi(argv[2]) : 8;
+	long ms = argc > 3 ? atol(argv[3]) : 500;
+
+	VTree *tree = createVTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	for (long i = 0; i < n; i++)
+		vtreeInsert(tree, &i, &i);
+
+	double base = 0;
+	for (int readers = 1; readers <= maxReaders && readers < VTREE_READERS; readers *= 2) {
+		atomic_int stop;
+		atomic_init(&stop, 0);
+		Worker *workers = malloc(sizeof(Worker) * (readers + 1));
+		pthread_t *threads = malloc(sizeof(pthread_t) * (readers + 1));
+		for (int i = 0; i <= readers; i++) {
+			workers[i].tree = tree;
+			workers[i].keys = n;
+			workers[i].stop = &stop;
+			workers[i].seed = 17 + i;
+			pthread_create(&threads[i], NULL, i == 0 ? writer : reader, &workers[i]);
+		}
+		double start = now();
+		struct timespec pause = {ms / 1000, (ms % 1000) * 1000000};
+		nanosleep(&pause, NULL);
+		atomic_store(&stop, 1);
+		long lookups = 0;
+		for (int i = 0; i <= readers; i++) {
+			pthread_join(threads[i], NULL);
+			if (i > 0)
+				lookups += workers[i].ops;
+		}
+		double elapsed = now() - start;
+		double rate = lookups / elapsed;
+		if (readers == 1)
+			base = rate;
+		printf("readers: %2d  lookups: %8.2f M/s  scaling: %.2fx  writes: %7.0f /s\n",
+			   readers, rate * 1e-6, rate / base, workers[0].ops / elapsed);
+		free(workers);
+		free(threads);
+	}
+	destroyVTree(tree);
+	return 0;
+}
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "TreeMap.h"
+#include "Cipher.h"
+
+/*
+ * Benchmark suite: insert, search, delete, successor/predecessor walks,
+ * destroyTree and the Cipher key queries, for several sizes and key
+ * distributions, written as JSON (to compare two builds, diff or plot
+ * their files)
+ *
+ * Every entry has ns/op, the p50/p90/p99/max latency of a sample of
+ * the operations (the cost of reading the clock is measured once and
+ * taken out), the allocations made by the tree code (malloc is wrapped
+ * at link time), the key comparisons and rotations of the thread
+ * (getTreeStats counters) and the RSS of the process
+ *
+ * The trees are built like the Cipher dictionary: 7-letter words
+ * packed in the nodes, nodes and int infos in an arena (-plain: words
+ * and infos allocated one by one, as with createTree alone)
+ *
+ * Usage: bench_suite [-plain] [sizes...]   (default: 1K to 10M)
+ */
+
+/* Letters of a word (the most the packed keys hold) */
+#define WORD_LENGTH 7
+
+/* Latencies kept per operation (the others are only counted) */
+#define MAX_SAMPLES 100000
+
+/* Successor/predecessor steps timed together */
+#define WALK_BLOCK 64
+
+/* Range queries timed for every tree */
+#define RANGE_QUERIES 1000
+
+/* Keys per range query, on uniform keys */
+#define RANGE_WIDTH 100
+
+/* Skew of the Zipfian keys (as in YCSB) */
+#define ZIPF_THETA 0.99
+
+/* Entries per key with heavy duplicates */
+#define DUPLICATES 1000
+
+
+/* Allocations of the tree code, through the linker's --wrap */
+static long allocations;
+static size_t allocatedBytes;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* block, size_t size);
+void* __real_aligned_alloc(size_t alignment, size_t size);
+
+void* __wrap_malloc(size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+	allocations++;
+	allocatedBytes += n * size;
+	return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* block, size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	return __real_realloc(block, size);
+}
+
+void* __wrap_aligned_alloc(size_t alignment, size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	return __real_aligned_alloc(alignment, size);
+}
+
+
+void* createStrElement(void* str) {
+	char *word = malloc(WORD_LENGTH + 1);
+	memcpy(word, str, WORD_LENGTH + 1);
+	return word;
+}
+
+void destroyStrElement(void* elem) {
+	free(elem);
+}
+
+static void* createInt(void* value) {
+	int *i = malloc(sizeof(int));
+	*i = *((int*) value);
+	return i;
+}
+
+static void destroyInt(void* value) {
+	free(value);
+}
+
+static int compareStr(void* a, void* b) {
+	int c = strcmp((char*) a, (char*) b);
+	return (c > 0) - (c < 0);
+}
+
+
+static long now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+static int compareLong(const void* a, const void* b) {
+	long x = *(const long*)a, y = *(const long*)b;
+	return (x > y) - (x < y);
+}
+
+static uint64_t state = 42;
+
+/* xorshift64*: the same keys on every run */
+static uint64_t nextRandom() {
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+static long residentBytes() {
+	long size, pages = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f != NULL) {
+		if (fscanf(f, "%ld %ld", &size, &pages) != 2)
+			pages = 0;
+		fclose(f);
+	}
+	return pages * sysconf(_SC_PAGESIZE);
+}
+
+static long peakResidentBytes() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024L;
+}
+
+
+/* Key number to a word of WORD_LENGTH letters (same order) */
+static void toWord(uint64_t key, char *word) {
+	for (int i = WORD_LENGTH - 1; i >= 0; i--) {
+		word[i] = 'A' + key % 26;
+		key /= 26;
+	}
+	word[WORD_LENGTH] = '\0';
+}
+
+
+/*
+ * A key distribution: keys[i] for n keys, taken from [0, space)
+ */
+typedef struct Distribution{
+	const char *name;
+	void (*generate)(uint64_t* keys, long n, uint64_t* space);
+}Distribution;
+
+static void uniformKeys(uint64_t* keys, long n, uint64_t* space) {
+	*space = 4 * (uint64_t) n;
+	for (long i = 0; i < n; i++)
+		keys[i] = nextRandom() % *space;
+}
+
+static void sortedKeys(uint64_t* keys, long n, uint64_t* space) {
+	*space = n;
+	for (long i = 0; i < n; i++)
+		keys[i] = i;
+}
+
+static void reverseKeys(uint64_t* keys, long n, uint64_t* space) {
+	*space = n;
+	for (long i = 0; i < n; i++)
+		keys[i] = n - 1 - i;
+}
+
+/* Scrambled Zipfian (Gray et al.): a few ranks are very frequent,
+ * and the ranks are hashed so the frequent keys are spread out
+ */
+static void zipfianKeys(uint64_t* keys, long n, uint64_t* space) {
+	double zetan = 0;
+	for (long i = 1; i <= n; i++)
+		zetan += 1 / pow(i, ZIPF_THETA);
+	double zeta2 = 1 + 1 / pow(2, ZIPF_THETA);
+	double alpha = 1 / (1 - ZIPF_THETA);
+	double eta = (1 - pow(2.0 / n, 1 - ZIPF_THETA)) / (1 - zeta2 / zetan);
+	*space = 4 * (uint64_t) n;
+	for (long i = 0; i < n; i++) {
+		double u = (nextRandom() >> 11) * 0x1.0p-53, uz = u * zetan;
+		uint64_t rank = uz < 1 ? 0 : uz < zeta2 ? 1 : (uint64_t) (n * pow(eta * u - eta + 1, alpha));
+		keys[i] = (rank * 0x9E3779B97F4A7C15ULL >> 16) % *space;
+	}
+}
+
+static void duplicateKeys(uint64_t* keys, long n, uint64_t* space) {
+	*space = n / DUPLICATES + 1;
+	for (long i = 0; i < n; i++)
+		keys[i] = nextRandom() % *space;
+}
+
+static Distribution distributions[] = {
+	{"uniform", uniformKeys},
+	{"sorted", sortedKeys},
+	{"reverse", reverseKeys},
+	{"zipfian", zipfianKeys},
+	{"duplicates", duplicateKeys},
+};
+
+
+/*
+ * Measurements of one operation, taken between beginOp and endOp
+ */
+typedef struct Measure{
+	long *samples;			// latencies of the sampled operations (ns)
+	long sampled;			// number of samples
+	long ops;				// operations made
+	long stride;			// one operation out of stride is sampled
+	long start;				// clock at beginOp
+	long allocations;		// at beginOp
+	size_t allocatedBytes;	// at beginOp
+	TreeCounters counters;	// at beginOp
+}Measure;
+
+static long clockCost;
+static int firstRun = 1, firstResult = 1;
+
+static void beginOp(Measure* m, long ops) {
+	m->sampled = 0;
+	m->ops = ops;
+	m->stride = ops > MAX_SAMPLES ? (ops + MAX_SAMPLES - 1) / MAX_SAMPLES : 1;
+	m->allocations = allocations;
+	m->allocatedBytes = allocatedBytes;
+	m->counters = treeCounters;
+	m->start = now();
+}
+
+static void sample(Measure* m, long ns) {
+	if (m->sampled < MAX_SAMPLES)
+		m->samples[m->sampled++] = ns > clockCost ? ns - clockCost : 0;
+}
+
+/* Write the measurements of an operation as a JSON member */
+static void endOp(Measure* m, const char* name, long perSample) {
+	long total = now() - m->start - m->sampled * clockCost;
+	long *s = m->samples, k = m->sampled;
+	qsort(s, k, sizeof(long), compareLong);
+	double ops = m->ops > 0 ? m->ops : 1;
+	printf("%s\n        \"%s\": {\"ops\": %ld, \"ns_per_op\": %.1f, "
+		   "\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f, "
+		   "\"allocations\": %ld, \"allocated_bytes\": %zu, "
+		   "\"compares_per_op\": %.2f, \"rotations\": %lu, \"rss_bytes\": %ld}",
+		   firstResult ? "" : ",", name, m->ops, (total > 0 ? total : 0) / ops,
+		   k ? (double) s[k / 2] / perSample : 0, k ? (double) s[k * 9 / 10] / perSample : 0,
+		   k ? (double) s[k * 99 / 100] / perSample : 0, k ? (double) s[k - 1] / perSample : 0,
+		   allocations - m->allocations, allocatedBytes - m->allocatedBytes,
+		   (treeCounters.compares - m->counters.compares) / ops,
+		   treeCounters.singleRotations - m->counters.singleRotations +
+		   treeCounters.doubleRotations - m->counters.doubleRotations, residentBytes());
+	firstResult = 0;
+}
+
+/* Time op(i) for i < ops, sampling one call out of m->stride */
+#define TIME_OPS(m, ops, op) do { \
+		beginOp(m, ops); \
+		for (long i = 0; i < (ops); i++) { \
+			if (i % (m)->stride == 0) { \
+				long t = now(); \
+				op; \
+				sample(m, now() - t); \
+			} else { \
+				op; \
+			} \
+		} \
+	} while (0)
+
+
+static TTree* createWordTree(int plain) {
+	TTree *tree = createTree(createStrElement, destroyStrElement,
+							 createInt, destroyInt, compareStr);
+	if (!plain) {
+		treeUsePackedKeys(tree, WORD_LENGTH);
+		treeUseArena(tree, 0, sizeof(int));
+	}
+	return tree;
+}
+
+static void freeRange(Range* range) {
+	if (range != NULL) {
+		free(range->index);
+		free(range);
+	}
+}
+
+
+/* Walk the whole tree with successor (or predecessor), timing blocks
+ * of steps (a single step is shorter than reading the clock)
+ */
+static void walk(Measure* m, TTree* tree, long keys, int forward) {
+	TreeNode *x = forward ? minimum(tree->root) : maximum(tree->root);
+	beginOp(m, keys);
+	while (x != NULL) {
+		long t = now();
+		for (int i = 0; i < WALK_BLOCK && x != NULL; i++)
+			x = forward ? successor(x) : predecessor(x);
+		sample(m, now() - t);
+	}
+	endOp(m, forward ? "successor_walk" : "predecessor_walk", WALK_BLOCK);
+}
+
+
+static void run(Distribution* d, long n, int plain, Measure* m) {
+	uint64_t space, *keys = malloc(sizeof(uint64_t) * n), *queries = malloc(sizeof(uint64_t) * n);
+	d->generate(keys, n, &space);
+	d->generate(queries, n, &space);
+	char (*words)[WORD_LENGTH + 1] = malloc(sizeof(*words) * n);
+	for (long i = 0; i < n; i++)
+		toWord(keys[i], words[i]);
+	fprintf(stderr, "%s %ld\n", d->name, n);
+
+	printf("%s\n    {\"distribution\": \"%s\", \"size\": %ld, \"ops\": {",
+		   firstRun ? "" : ",", d->name, n);
+	firstRun = 0;
+	firstResult = 1;
+
+	TTree *tree = createWordTree(plain);
+	TIME_OPS(m, n, { int info = i; insert(tree, words[i], &info); });
+	endOp(m, "insert", 1);
+
+	char word[WORD_LENGTH + 1];
+	TIME_OPS(m, n, { toWord(queries[i], word); search(tree, tree->root, word); });
+	endOp(m, "search", 1);
+
+	TreeStats stats = getTreeStats(tree);
+	walk(m, tree, stats.keys, 1);
+	walk(m, tree, stats.keys, 0);
+
+	// The Cipher queries, repeated on big trees less often
+	long repeats = n >= 1000000 ? 3 : 3000000 / n;
+	TIME_OPS(m, repeats, freeRange(inorderKeyQuery(tree)));
+	endOp(m, "inorderKeyQuery", 1);
+	TIME_OPS(m, repeats, freeRange(levelKeyQuery(tree)));
+	endOp(m, "levelKeyQuery", 1);
+	uint64_t width = RANGE_WIDTH * space / n + 2;
+	char q[WORD_LENGTH + 1], p[WORD_LENGTH + 1];
+	TIME_OPS(m, RANGE_QUERIES, {
+		uint64_t lo = queries[i % n];
+		toWord(lo, q);
+		toWord(lo + width, p);
+		freeRange(rangeKeyQuery(tree, q, p));
+	});
+	endOp(m, "rangeKeyQuery", 1);
+
+	// Half of the entries are deleted, the other half go with the tree
+	TIME_OPS(m, n / 2, delete(tree, words[i]));
+	endOp(m, "delete", 1);
+	long entries = tree->size;
+	beginOp(m, entries);
+	destroyTree(tree);
+	endOp(m, "destroyTree", 1);
+
+	printf("\n      }, \"keys\": %ld, \"height\": %ld, \"tree_bytes\": %zu, "
+		   "\"peak_rss_bytes\": %ld}", stats.keys, stats.height,
+		   stats.nodeBytes + stats.elemBytes + stats.infoBytes, peakResidentBytes());
+	fflush(stdout);
+	free(words);
+	free(queries);
+	free(keys);
+}
+
+
+int main(int argc, char *argv[]) {
+	int plain = argc > 1 && strcmp(argv[1], "-plain") == 0;
+	long defaults[] = {1000, 10000, 100000, 1000000, 10000000};
+	long count = argc - 1 - plain, *sizes = defaults;
+	if (count > 0) {
+		sizes = malloc(sizeof(long) * count);
+		for (long i = 0; i < count; i++)
+			sizes[i] = atol(argv[1 + plain + i]);
+	} else
+		count = sizeof(defaults) / sizeof(long);
+
+	Measure m;
+	m.samples = malloc(sizeof(long) * MAX_SAMPLES);
+	long t = now();
+	for (int i = 0; i < 1000; i++)
+		now();
+	clockCost = (now() - t) / 1000;
+
+	printf("{\n  \"layout\": \"%s\", \"tree_stats\": %d, \"compiler\": \"%s\",\n"
+		   "  \"results\": [", plain ? "plain" : "packed", TREE_STATS, __VERSION__);
+	for (long i = 0; i < count; i++)
+		for (size_t j = 0; j < sizeof(distributions) / sizeof(Distribution); j++)
+			run(&distributions[j], sizes[i], plain, &m);
+	printf("\n  ]\n}\n");
+
+	free(m.samples);
+	if (sizes != defaults)
+		free(sizes);
+	return 0;
+}
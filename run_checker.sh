@@ -50,8 +50,8 @@ else
 fi
 
 
-tests=( "inorder_key" "level_key" "range_key" )
-scores=( 5 10 5 )
+tests=( "inorder_key" "level_key" "range_key" "typed" "comparisons" "search_batch" "bulk_load" "set_ops" "order_stats" "cursor" "frequency" "compact" "pool" "snapshot" "concurrent" "sharded" "frozen" "bplus" "mapped" "logged" "lazy" "insert_batch" "stats" "hash_index" "arena" "packed" )
+scores=( 5 10 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 5 )
 
 for i in ${!tests[@]}
 do
@@ -1,9 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "TreeMap.h"
 #include "Cipher.h"
+#include "TreeMapTyped.h"
+#include "TreeSet.h"
+#include "VersionedTree.h"
+#include "ConcurrentTree.h"
+#include "ShardedTree.h"
+#include "FrozenTree.h"
+#include "MappedTree.h"
+#include "LoggedTree.h"
 
 #define ASSERT(f, cond, msg) if (!(cond)) { failed(f, msg); return; } else passed(f, msg);
 
@@ -471,7 +483,7 @@ void test_list_insert(TTree **tree) {
 	}
 
 	long values[] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
-	for(int i = 0; i < sizeof(values)/sizeof(values[0]); i++)
+	for(size_t i = 0; i < sizeof(values)/sizeof(values[0]); i++)
 		insert(*(tree), values + i, values + i);
 
 	if (*tree == NULL || (*tree)->root == NULL) {
@@ -635,6 +647,46 @@ void draw_tree(TTree *tree, int type) {
 }
 
 
+/* Dictionary used by the Cipher tests
+ */
+TTree* create_dict() {
+	return createTree(
+		createStrElement,
+		destroyStrElement,
+		createIndexInfo,
+		destroyIndexInfo,
+		compareStr);
+}
+
+
+/* The same dictionary with the words packed after the nodes, the
+ * offsets kept in the node slots of an arena and the duplicates compacted
+ */
+TTree* create_packed_dict() {
+	TTree *dict = create_dict();
+	treeUsePackedKeys(dict, ELEMENT_TREE_LENGTH);
+	treeUseArena(dict, 0, sizeof(int));
+	treeCompactDuplicates(dict, sizeof(int));
+	return dict;
+}
+
+
+/* Compare two Cipher keys (both are released)
+ */
+int same_range(Range *expected, Range *actual) {
+	int ok = expected != NULL && actual != NULL && expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	if (expected != NULL)
+		free(expected->index);
+	if (actual != NULL)
+		free(actual->index);
+	free(expected);
+	free(actual);
+	return ok;
+}
+
+
 void test_build_tree(TTree **tree) {
 
 	FILE *f = fopen("outputs/simple_key_tree.dot", "w");
@@ -663,12 +715,7 @@ void test_build_tree(TTree **tree) {
 	}
 
 	destroyTree(*tree);
-	*tree = createTree(
-		createStrElement,
-		destroyStrElement,
-		createIndexInfo,
-		destroyIndexInfo,
-		compareStr);
+	*tree = create_dict();
 
 	buildTreeFromFile("inputs/key.txt", (*tree));
 
@@ -731,35 +778,2658 @@ void test_range_key(TTree **tree) {
 }
 
 
-int main() {
+void test_comparisons() {
 
-	TTree *tree1 = NULL;
-	TTree *tree2 = NULL;
+	FILE *f = fopen("outputs/output_comparisons.out", "w");
 
-	test_init(&tree1);
-	create_simple_tree(&tree1);
-	test_search(&tree1);
-	test_minmax(&tree1);
-	test_succ_pred(&tree1);
-	test_rotations(&tree1);
-	test_insert(&tree2);
-	test_delete(&tree2);
-	test_list_insert(&tree2);
-	test_list_delete(&tree2);
-	test_free(&tree1, &tree2);
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
 
-	TTree *dict = NULL;
-	dict = createTree(
-		createStrElement,
-		destroyStrElement,
-		createIndexInfo,
-		destroyIndexInfo,
-		compareStr);
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	long values[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	for (int i = 0; i < 7; i++)
+		insert(tree, values + i, values + i);
+	ASSERT(f, *((long*)tree->root->elem) == 4l, "Comparisons-01");
+
+	// One comparison per level: 1 + 2 * 2 + 4 * 3
+	resetTreeCounters();
+	for (int i = 0; i < 7; i++)
+		search(tree, tree->root, values + i);
+	ASSERT(f, treeCounters.compares == 17, "Comparisons-02");
+
+	// A duplicate of the root stops at the root
+	resetTreeCounters();
+	insert(tree, values + 3, values + 3);
+	ASSERT(f, treeCounters.compares == 1, "Comparisons-03");
+	ASSERT(f, tree->root->end == tree->root->next, "Comparisons-04");
+
+	// A new key costs one comparison per level of its path
+	resetTreeCounters();
+	insert(tree, values + 7, values + 7);
+	ASSERT(f, treeCounters.compares == 3, "Comparisons-05");
+
+	resetTreeCounters();
+	search(tree, tree->root, values + 7);
+	ASSERT(f, treeCounters.compares == 4, "Comparisons-06");
+
+	destroyTree(tree);
+	fprintf(f, "\nAll tests for Comparisons passed!\n");
+	fclose(f);
+}
+
+
+void test_search_batch(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_search_batch.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	char *words[] = {"THIS", "ALPHABET", "ZZZ", "YOU", "A", "ABSOLUTELY",
+					 "QUICK", "AAAA", "THE", "ENGLISH", "KEY", "NOPE",
+					 "LAZY", "DOG", "FOX", "OVER", "JUMPED", "HAS", "CASE"};
+	long n = sizeof(words) / sizeof(words[0]);
+	TreeNode *out[sizeof(words) / sizeof(words[0])];
+
+	searchBatch(*dict, (void**)words, n, out);
+	int same = 1;
+	for (long i = 0; i < n; i++)
+		same &= out[i] == search(*dict, (*dict)->root, words[i]);
+	ASSERT(f, same, "SearchBatch-01");
+	ASSERT(f, out[0] != NULL && strcmp((char*)out[0]->elem, "THIS") == 0, "SearchBatch-02");
+	ASSERT(f, out[2] == NULL && out[7] == NULL && out[11] == NULL, "SearchBatch-03");
+	ASSERT(f, strcmp((char*)out[1]->elem, "ALPHA") == 0, "SearchBatch-04");
+
+	searchBatch(*dict, (void**)words, 0, out);
+	ASSERT(f, out[0] != NULL, "SearchBatch-05");
+
+	fprintf(f, "\nAll tests for Search Batch passed!\n");
+	fclose(f);
+}
+
+
+/* Check the links, heights and balance of a subtree (and the summaries
+ * of an augmented tree)
+ *
+ * return: the height of the subtree or -1 if it is not a valid AVL
+ */
+long check_avl(TTree *tree, TreeNode *x, TreeNode *parent) {
+	if (x == NULL)
+		return 0;
+	if (x->parent != parent)
+		return -1;
+	long l = check_avl(tree, x->left, x), r = check_avl(tree, x->right, x);
+	if (l < 0 || r < 0 || l - r > 1 || r - l > 1)
+		return -1;
+	if (x->height != (l > r ? l : r) + 1)
+		return -1;
+	if (!tree->augmented)
+		return x->height;
+	NodeSummary *s = summaryOf(x);
+	long weight = s->count;
+	if (x->left != NULL)
+		weight += summaryOf(x->left)->weight;
+	if (x->right != NULL)
+		weight += summaryOf(x->right)->weight;
+	if (s->weight != weight)
+		return -1;
+	TreeNode *most = x;
+	if (x->left != NULL && summaryOf(x->left)->maxCount >= s->count)
+		most = summaryOf(x->left)->maxNode;
+	if (x->right != NULL && summaryOf(x->right)->maxCount > summaryOf(most)->count)
+		most = summaryOf(x->right)->maxNode;
+	if (s->maxNode != most || s->maxCount != summaryOf(most)->count)
+		return -1;
+	return x->height;
+}
+
+
+void test_bulk_load() {
+
+	FILE *f = fopen("outputs/output_bulk_load.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	long values[] = {0, 1, 1, 2, 3, 3, 3, 4, 5, 6, 7, 8, 8, 9};
+	long infos[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+	long n = sizeof(values) / sizeof(values[0]);
+	void *elems[sizeof(values) / sizeof(values[0])];
+	void *info[sizeof(values) / sizeof(values[0])];
+	for (long i = 0; i < n; i++) {
+		elems[i] = values + i;
+		info[i] = infos + i;
+	}
+
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	ASSERT(f, bulkLoadSorted(tree, elems, info, n) == 0, "BulkLoad-01");
+	ASSERT(f, tree->size == n, "BulkLoad-02");
+	ASSERT(f, *((long*)tree->root->elem) == 4l, "BulkLoad-03");
+	ASSERT(f, check_avl(tree, tree->root, NULL) == 4, "BulkLoad-04");
+
+	int ordered = 1;
+	long i = 0;
+	for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next, i++)
+		ordered &= *((long*)x->info) == i && (x->next == NULL || x->next->prev == x);
+	ASSERT(f, ordered && i == n, "BulkLoad-05");
+
+	long value = 3;
+	TreeNode *three = search(tree, tree->root, &value);
+	ASSERT(f, *((long*)three->info) == 4l && *((long*)three->end->info) == 6l, "BulkLoad-06");
+	ASSERT(f, three->end->next == successor(three), "BulkLoad-07");
+	ASSERT(f, three->prev == predecessor(three)->end, "BulkLoad-08");
+
+	// The loaded tree keeps working with the usual operations
+	insert(tree, &value, &value);
+	ASSERT(f, *((long*)three->end->info) == 3l, "BulkLoad-09");
+	value = 8;
+	delete(tree, &value);
+	delete(tree, &value);
+	ASSERT(f, search(tree, tree->root, &value) == NULL, "BulkLoad-10");
+	ASSERT(f, check_avl(tree, tree->root, NULL) > 0 && tree->size == n - 1, "BulkLoad-11");
+	destroyTree(tree);
+
+	// Unsorted input is rejected
+	tree = createTree(createLong, destroyLong,
+					  createLong, destroyLong, compareLong);
+	elems[3] = values;
+	ASSERT(f, bulkLoadSorted(tree, elems, info, n) == -1, "BulkLoad-12");
+	ASSERT(f, tree->root == NULL && tree->size == 0, "BulkLoad-13");
+	ASSERT(f, bulkLoadSorted(tree, elems, info, 3) == 0, "BulkLoad-14");
+	ASSERT(f, *((long*)tree->root->right->end->info) == 2l && tree->size == 3, "BulkLoad-15");
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Bulk Load passed!\n");
+	fclose(f);
+}
+
+
+/* Check the list of duplicates of a long tree: ordered, doubly linked,
+ * every head pointing to the end of its run and as long as the tree
+ */
+int check_list(TTree *tree) {
+	if (tree->root == NULL)
+		return tree->size == 0;
+	long count = 0;
+	TreeNode *head = NULL, *prev = NULL;
+	for (TreeNode *x = minimum(tree->root); x != NULL; prev = x, x = x->next, count++) {
+		if (x->prev != prev)
+			return 0;
+		// Chunked occurrences (a compacting tree has one node per key)
+		long chunked = 0;
+		InfoChunk *chunk = tree->dupSize != 0 ? *chunksOf(tree, x) : NULL;
+		for (; chunk != NULL; chunk = chunk->next)
+			chunked += chunk->used;
+		if (tree->dupSize != 0 && summaryOf(x)->count != chunked + 1)
+			return 0;
+		count += chunked;
+		if (head == NULL || compareLong(head->elem, x->elem) != 0) {
+			if (head != NULL && (compareLong(head->elem, x->elem) > 0 || head->end != prev))
+				return 0;
+			if (search(tree, tree->root, x->elem) != x)
+				return 0;
+			head = x;
+		}
+	}
+	return head->end == prev && count == tree->size;
+}
+
+
+/* Tree with the keys start, start + step, ... (< limit),
+ * the multiples of dup appearing twice (infos: key and key + 1)
+ */
+TTree* create_progression(long start, long step, long limit, long dup, int arena) {
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	if (arena)
+		treeUseArena(tree, sizeof(long), sizeof(long));
+	for (long key = start; key < limit; key += step) {
+		insert(tree, &key, &key);
+		if (key % dup == 0) {
+			long info = key + 1;
+			insert(tree, &key, &info);
+		}
+	}
+	return tree;
+}
+
+
+/* Check that two long trees hold the same pairs in the same order
+ */
+int same_pairs(TTree *a, TTree *b) {
+	if (a->size != b->size || (a->root == NULL) != (b->root == NULL))
+		return 0;
+	if (a->root == NULL)
+		return 1;
+	TreeCursor x = cursorAt(a, minimum(a->root)), y = cursorAt(b, minimum(b->root));
+	for (; cursorValid(&x) && cursorValid(&y); cursorNext(&x), cursorNext(&y))
+		if (compareLong(cursorElem(&x), cursorElem(&y)) != 0 ||
+			compareLong(cursorInfo(&x), cursorInfo(&y)) != 0)
+			return 0;
+	return !cursorValid(&x) && !cursorValid(&y);
+}
+
+
+void test_set_ops() {
+
+	FILE *f = fopen("outputs/output_set_ops.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Evens (multiples of 10 twice) with multiples of 3 (multiples of 9 twice)
+	TTree *a = create_progression(0, 2, 1000, 10, 0);
+	TTree *b = create_progression(0, 3, 1000, 9, 0);
+	long sa = a->size, sb = b->size;
+	ASSERT(f, treeUnion(a, b, NULL) == 0, "SetOps-01");
+	ASSERT(f, a->size == sa + sb && b->size == 0 && b->root == NULL, "SetOps-02");
+	ASSERT(f, check_avl(a, a->root, NULL) > 0 && check_list(a), "SetOps-03");
+	long key = 90;
+	TreeNode *x = search(a, a->root, &key);
+	ASSERT(f, *((long*)x->info) == 90 && *((long*)x->next->info) == 91, "SetOps-04");
+	ASSERT(f, *((long*)x->next->next->info) == 90, "SetOps-05");
+	ASSERT(f, *((long*)x->end->info) == 91 && x->end == x->next->next->next, "SetOps-06");
+	destroyTree(a);
+	destroyTree(b);
+
+	a = create_progression(0, 2, 1000, 10, 0);
+	b = create_progression(0, 3, 1000, 9, 0);
+	ASSERT(f, treeIntersect(a, b, NULL) == 0, "SetOps-07");
+	ASSERT(f, a->size == 167 + 34 && check_list(a), "SetOps-08");
+	ASSERT(f, check_avl(a, a->root, NULL) > 0, "SetOps-09");
+	key = 4;
+	ASSERT(f, search(a, a->root, &key) == NULL, "SetOps-10");
+	destroyTree(a);
+	destroyTree(b);
+
+	a = create_progression(0, 2, 1000, 10, 0);
+	b = create_progression(0, 3, 1000, 9, 0);
+	ASSERT(f, treeDifference(a, b, NULL) == 0, "SetOps-11");
+	ASSERT(f, a->size == 600 - 201 && check_list(a), "SetOps-12");
+	ASSERT(f, check_avl(a, a->root, NULL) > 0, "SetOps-13");
+	key = 6;
+	ASSERT(f, search(a, a->root, &key) == NULL, "SetOps-14");
+	key = 10;
+	ASSERT(f, search(a, a->root, &key)->end != search(a, a->root, &key), "SetOps-15");
+	destroyTree(a);
+	destroyTree(b);
+
+	// Parallel merges give the same trees as sequential ones
+	ThreadPool *pool = createThreadPool(4);
+	int (*ops[])(TTree*, TTree*, ThreadPool*) = {treeUnion, treeIntersect, treeDifference};
+	int same = 1;
+	for (int i = 0; i < 3; i++) {
+		TTree *seq = create_progression(0, 2, 100000, 10, 0);
+		TTree *par = create_progression(0, 2, 100000, 10, 0);
+		TTree *other = create_progression(1, 3, 120000, 7, 0);
+		ops[i](seq, other, NULL);
+		destroyTree(other);
+		other = create_progression(1, 3, 120000, 7, 0);
+		ops[i](par, other, pool);
+		destroyTree(other);
+		same &= same_pairs(seq, par) && check_list(par) && check_avl(par, par->root, NULL) > 0;
+		destroyTree(seq);
+		destroyTree(par);
+	}
+	destroyThreadPool(pool);
+	ASSERT(f, same, "SetOps-16");
+
+	// Trees taking their nodes from arenas
+	a = create_progression(0, 2, 1000, 10, 1);
+	b = create_progression(0, 3, 1000, 9, 0);
+	TTree *c = create_progression(0, 2, 1000, 10, 0);
+	TTree *d = create_progression(0, 3, 1000, 9, 1);
+	treeUnion(a, b, NULL);
+	treeUnion(c, d, NULL);
+	ASSERT(f, same_pairs(a, c) && check_list(a) && check_list(c), "SetOps-17");
+	destroyTree(a);
+	destroyTree(b);
+	destroyTree(c);
+	destroyTree(d);
+
+	// Split and join back
+	a = create_progression(0, 1, 500, 5, 0);
+	b = createTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	key = 200;
+	ASSERT(f, treeSplit(a, &key, b) == 0, "SetOps-18");
+	ASSERT(f, a->size == 201 + 41 && b->size == 299 + 59, "SetOps-19");
+	ASSERT(f, *((long*)maximum(a->root)->end->info) == 201l, "SetOps-20");
+	ASSERT(f, *((long*)minimum(b->root)->elem) == 201l, "SetOps-21");
+	ASSERT(f, check_list(a) && check_list(b), "SetOps-22");
+	ASSERT(f, check_avl(a, a->root, NULL) > 0 && check_avl(b, b->root, NULL) > 0, "SetOps-23");
+	ASSERT(f, treeJoin(b, a) == -1, "SetOps-24");
+	ASSERT(f, treeJoin(a, b) == 0 && b->root == NULL, "SetOps-25");
+	ASSERT(f, a->size == 600 && check_list(a) && check_avl(a, a->root, NULL) > 0, "SetOps-26");
+	destroyTree(a);
+	destroyTree(b);
+
+	fprintf(f, "\nAll tests for Set Operations passed!\n");
+	fclose(f);
+}
+
+
+void test_order_stats(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_order_stats.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Pseudo-random keys in [0, 200), many of them repeated
+	// (the same entries in a plain tree, which walks its list instead)
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	TTree *plain = createTree(createLong, destroyLong,
+							  createLong, destroyLong, compareLong);
+	treeAugment(tree);
+	unsigned long seed = 7;
+	for (long i = 0; i < 1000; i++) {
+		seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+		long key = (seed >> 33) % 200;
+		insert(tree, &key, &i);
+		insert(plain, &key, &i);
+	}
+	for (long key = 0; key < 200; key += 3) {
+		delete(tree, &key);
+		delete(plain, &key);
+	}
+	ASSERT(f, check_avl(tree, tree->root, NULL) > 0, "OrderStats-01");
+	ASSERT(f, summaryOf(tree->root)->weight == tree->size && plain->size == tree->size,
+		   "OrderStats-02");
+
+	int ok = 1;
+	long k = 0;
+	TreeNode *y = minimum(plain->root);
+	for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next, y = y->next, k++)
+		ok &= selectNode(tree, k) == x && selectNode(plain, k) == y;
+	ASSERT(f, ok && selectNode(tree, k) == NULL && selectNode(tree, -1) == NULL &&
+			  selectNode(plain, k) == NULL, "OrderStats-03");
+
+	ok = 1;
+	for (long key = -1; key <= 200; key++) {
+		long below = 0;
+		for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next)
+			below += *((long*)x->elem) < key;
+		ok &= rank(tree, &key) == below && rank(plain, &key) == below;
+	}
+	ASSERT(f, ok, "OrderStats-04");
+
+	ok = 1;
+	for (long lo = -1; lo <= 200; lo += 7)
+		for (long hi = lo; hi <= 201; hi += 11) {
+			long inside = 0;
+			for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next)
+				inside += *((long*)x->elem) > lo && *((long*)x->elem) < hi;
+			ok &= countRange(tree, &lo, &hi) == inside && countRange(plain, &lo, &hi) == inside;
+		}
+	ASSERT(f, ok, "OrderStats-05");
+	destroyTree(tree);
+	destroyTree(plain);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Range buffers are sized exactly
+	Range *range = rangeKeyQuery(*dict, "CD", "GG");
+	ASSERT(f, range->size == 11 && range->capacity == 11, "OrderStats-06");
+	ASSERT(f, countRange(*dict, "CD", "GG") == 11, "OrderStats-07");
+	free(range->index);
+	free(range);
+
+	// Paginated in-order export
+	Range *all = inorderKeyQuery(*dict);
+	ok = 1;
+	for (long offset = 0; offset < all->size; offset += 8) {
+		Range *page = inorderKeyPage(*dict, offset, 8);
+		for (int i = 0; i < page->size; i++)
+			ok &= page->index[i] == all->index[offset + i];
+		ok &= page->size == (all->size - offset < 8 ? all->size - offset : 8);
+		free(page->index);
+		free(page);
+	}
+	ASSERT(f, ok, "OrderStats-08");
+	free(all->index);
+	free(all);
+
+	fprintf(f, "\nAll tests for Order Statistics passed!\n");
+	fclose(f);
+}
+
+
+void test_cursor(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_cursor.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// 0, 2, ..., 18 with 10 appearing three times
+	TTree *tree = create_progression(0, 2, 20, 10, 0);
+	long key = 10, info = 12;
+	insert(tree, &key, &info);
+
+	TreeCursor cursor = lowerBound(tree, &key);
+	ASSERT(f, cursorValid(&cursor) && *((long*)cursorInfo(&cursor)) == 10l, "Cursor-01");
+	ASSERT(f, cursorNext(&cursor) && *((long*)cursorInfo(&cursor)) == 11l, "Cursor-02");
+	ASSERT(f, cursorNext(&cursor) && *((long*)cursorInfo(&cursor)) == 12l, "Cursor-03");
+	ASSERT(f, cursorNext(&cursor) && *((long*)cursorElem(&cursor)) == 12l, "Cursor-04");
+
+	cursor = upperBound(tree, &key);
+	ASSERT(f, *((long*)cursorElem(&cursor)) == 12l, "Cursor-05");
+	ASSERT(f, cursorPrev(&cursor) && *((long*)cursorInfo(&cursor)) == 12l, "Cursor-06");
+
+	key = 11;
+	cursor = lowerBound(tree, &key);
+	ASSERT(f, *((long*)cursorElem(&cursor)) == 12l, "Cursor-07");
+	cursor = upperBound(tree, &key);
+	ASSERT(f, *((long*)cursorElem(&cursor)) == 12l, "Cursor-08");
+
+	key = -5;
+	cursor = lowerBound(tree, &key);
+	ASSERT(f, cursor.node == minimum(tree->root), "Cursor-09");
+	ASSERT(f, !cursorPrev(&cursor) && !cursorValid(&cursor), "Cursor-10");
+
+	key = 18;
+	cursor = upperBound(tree, &key);
+	ASSERT(f, !cursorValid(&cursor) && cursorInfo(&cursor) == NULL, "Cursor-11");
+	cursor = lowerBound(tree, &key);
+	ASSERT(f, cursorValid(&cursor) && !cursorNext(&cursor), "Cursor-12");
+	destroyTree(tree);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Narrow ranges only produce the matching entries
+	Range *range = rangeKeyQuery(*dict, "KE", "KEYZ");
+	ASSERT(f, range->size == 4 && range->capacity == 4, "Cursor-13");
+	free(range->index);
+	free(range);
+	range = rangeKeyQuery(*dict, "GG", "CD");
+	ASSERT(f, range->size == 0, "Cursor-14");
+	free(range->index);
+	free(range);
+
+	fprintf(f, "\nAll tests for Cursor passed!\n");
+	fclose(f);
+}
+
+
+void test_frequency(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_frequency.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Key k appears k % 7 + 1 times, so 6, 13, 20, ... are the most frequent
+	// (the same entries in a plain tree, which counts every key instead)
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	TTree *plain = createTree(createLong, destroyLong,
+							  createLong, destroyLong, compareLong);
+	treeAugment(tree);
+	ASSERT(f, mostFrequent(tree) == NULL && topFrequent(tree, 3, NULL) == 0 &&
+			  mostFrequent(plain) == NULL, "Frequency-01");
+	for (long i = 0; i < 7; i++)
+		for (long key = 0; key < 100; key++)
+			if (i <= key % 7) {
+				insert(tree, &key, &i);
+				insert(plain, &key, &i);
+			}
+	ASSERT(f, check_avl(tree, tree->root, NULL) > 0 && check_list(tree), "Frequency-02");
+
+	long key = 20;
+	ASSERT(f, countOf(tree, search(tree, tree->root, &key)) == 7 &&
+			  countOf(plain, search(plain, plain->root, &key)) == 7, "Frequency-03");
+	ASSERT(f, *((long*)mostFrequent(tree)->elem) == 6l && countOf(tree, mostFrequent(tree)) == 7 &&
+			  *((long*)mostFrequent(plain)->elem) == 6l, "Frequency-04");
+
+	// Ties come out in key order
+	TreeNode *top[20], *plainTop[20];
+	long expected[] = {6, 13, 20, 27, 34, 41, 48, 55, 62, 69, 76, 83, 90, 97, 5, 12};
+	int ok = topFrequent(tree, 16, top) == 16 && topFrequent(plain, 16, plainTop) == 16;
+	for (long i = 0; ok && i < 16; i++)
+		ok = *((long*)top[i]->elem) == expected[i] && *((long*)plainTop[i]->elem) == expected[i];
+	ASSERT(f, ok, "Frequency-05");
+
+	// Removing one occurrence of 6 moves the maximum to the next key
+	key = 6;
+	delete(tree, &key);
+	delete(plain, &key);
+	ASSERT(f, *((long*)mostFrequent(tree)->elem) == 13l &&
+			  *((long*)mostFrequent(plain)->elem) == 13l, "Frequency-06");
+	ASSERT(f, check_avl(tree, tree->root, NULL) > 0, "Frequency-07");
+	for (key = 13; key < 100; key += 7)
+		for (long i = 0; i < 7; i++) {
+			delete(tree, &key);
+			delete(plain, &key);
+		}
+	ASSERT(f, *((long*)mostFrequent(tree)->elem) == 5l &&
+			  *((long*)mostFrequent(plain)->elem) == 5l, "Frequency-08");
+	ok = topFrequent(tree, 3, top) == 3 && topFrequent(plain, 3, plainTop) == 3;
+	for (long i = 0; ok && i < 3; i++)
+		ok = *((long*)top[i]->elem) == *((long*)plainTop[i]->elem);
+	ASSERT(f, ok && *((long*)top[1]->elem) == 6l && *((long*)top[2]->elem) == 12l, "Frequency-09");
+	ASSERT(f, check_avl(tree, tree->root, NULL) > 0 && check_list(tree), "Frequency-10");
+	destroyTree(tree);
+	destroyTree(plain);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	ASSERT(f, check_avl((*dict), (*dict)->root, NULL) > 0, "Frequency-11");
+	ASSERT(f, topFrequent(*dict, 2, top) == 2 && top[0] == mostFrequent(*dict), "Frequency-12");
+	ASSERT(f, countOf(*dict, top[0]) == 7 && countOf(*dict, top[1]) == 6, "Frequency-13");
+
+	fprintf(f, "\nAll tests for Frequency passed!\n");
+	fclose(f);
+}
+
+
+/* Long tree keeping its duplicates in chunks (or as nodes)
+ */
+TTree* create_long_tree(int compact) {
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	if (compact)
+		treeCompactDuplicates(tree, sizeof(long));
+	return tree;
+}
+
+
+void test_compact(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_compact.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// Same entries, as full nodes and as chunked infos
+	// (key k appears k % 30 + 1 times, more than a chunk holds)
+	TTree *nodes = create_long_tree(0), *chunked = create_long_tree(1);
+	ASSERT(f, treeCompactDuplicates(nodes, INFO_CHUNK_BYTES) == -1, "Compact-01");
+	for (long i = 0; i < 30; i++)
+		for (long key = 0; key < 60; key++)
+			if (i <= key % 30) {
+				insert(nodes, &key, &i);
+				insert(chunked, &key, &i);
+			}
+	ASSERT(f, check_avl(chunked, chunked->root, NULL) > 0 && check_list(chunked), "Compact-02");
+	long distinct = 0;
+	for (TreeNode *x = minimum(chunked->root); x != NULL; x = x->next)
+		distinct++;
+	ASSERT(f, distinct == 60 && chunked->size == nodes->size, "Compact-03");
+	ASSERT(f, same_pairs(nodes, chunked), "Compact-04");
+
+	// Backwards, and straight to the k-th entry
+	TreeCursor x = cursorAt(nodes, maximum(nodes->root)->end);
+	TreeCursor y = selectEntry(chunked, chunked->size - 1);
+	int ok = 1;
+	for (; cursorValid(&x) && cursorValid(&y); cursorPrev(&x), cursorPrev(&y))
+		ok &= compareLong(cursorInfo(&x), cursorInfo(&y)) == 0 &&
+			  compareLong(cursorElem(&x), cursorElem(&y)) == 0;
+	ASSERT(f, ok && !cursorValid(&x) && !cursorValid(&y), "Compact-05");
+	ok = 1;
+	for (long k = 0; k < nodes->size; k++) {
+		x = selectEntry(nodes, k);
+		y = selectEntry(chunked, k);
+		ok &= compareLong(cursorInfo(&x), cursorInfo(&y)) == 0 &&
+			  compareLong(cursorElem(&x), cursorElem(&y)) == 0;
+	}
+	ASSERT(f, ok, "Compact-06");
+
+	// The last occurrences are removed first
+	for (long key = 0; key < 60; key += 7)
+		for (long i = 0; i < 12; i++) {
+			delete(nodes, &key);
+			delete(chunked, &key);
+		}
+	ASSERT(f, same_pairs(nodes, chunked), "Compact-07");
+	ASSERT(f, check_avl(chunked, chunked->root, NULL) > 0 && check_list(chunked), "Compact-08");
+
+	// Bulk loading and set operations keep the occurrences in order
+	long size = nodes->size;
+	void **elems = malloc(size * sizeof(void*)), **infos = malloc(size * sizeof(void*));
+	x = cursorAt(nodes, minimum(nodes->root));
+	for (long i = 0; i < size; i++, cursorNext(&x)) {
+		elems[i] = cursorElem(&x);
+		infos[i] = cursorInfo(&x);
+	}
+	TTree *more = create_long_tree(0), *moreChunked = create_long_tree(1);
+	bulkLoadSorted(more, elems, infos, size);
+	bulkLoadSorted(moreChunked, elems, infos, size);
+	ASSERT(f, same_pairs(more, moreChunked) && check_list(moreChunked), "Compact-09");
+	free(elems);
+	free(infos);
+
+	treeUnion(nodes, more, NULL);
+	treeUnion(chunked, moreChunked, NULL);
+	ASSERT(f, same_pairs(nodes, chunked) && chunked->size == 2 * size, "Compact-10");
+	ASSERT(f, check_avl(chunked, chunked->root, NULL) > 0 && check_list(chunked), "Compact-11");
+	ASSERT(f, treeUnion(nodes, chunked, NULL) == -1, "Compact-12");
+	destroyTree(more);
+	destroyTree(moreChunked);
+
+	more = create_long_tree(0);
+	moreChunked = create_long_tree(1);
+	for (long key = 0; key < 60; key += 2) {
+		insert(more, &key, &key);
+		insert(moreChunked, &key, &key);
+	}
+	treeDifference(nodes, more, NULL);
+	treeDifference(chunked, moreChunked, NULL);
+	ASSERT(f, same_pairs(nodes, chunked) && check_list(chunked), "Compact-13");
+	destroyTree(more);
+	destroyTree(moreChunked);
+	destroyTree(nodes);
+	destroyTree(chunked);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// One node per distinct word of the text, the same Cipher queries
+	TTree *packed = create_packed_dict();
+	buildTreeFromFile("inputs/key.txt", packed);
+	distinct = 0;
+	for (TreeNode *x = minimum(packed->root); x != NULL; x = x->next)
+		distinct++;
+	ASSERT(f, packed->dupSize == sizeof(int) && distinct < packed->size &&
+			  packed->size == (*dict)->size &&
+			  same_range(levelKeyQuery(*dict), levelKeyQuery(packed)), "Compact-14");
+	destroyTree(packed);
+
+	fprintf(f, "\nAll tests for Compact passed!\n");
+	fclose(f);
+}
+
+
+/* Check the heights and the balance of a pool tree
+ *
+ * return: the height of the subtree of x, -1 if it is broken
+ */
+long check_pool(struct avl_long_pool *tree, uint32_t x) {
+	if (x == TM_NIL)
+		return 0;
+	long l = check_pool(tree, tree->hot[x].left);
+	long r = check_pool(tree, tree->hot[x].right);
+	if (l < 0 || r < 0 || l - r > 1 || r - l > 1)
+		return -1;
+	if (tree->hot[x].height != (l > r ? l : r) + 1)
+		return -1;
+	return tree->hot[x].height;
+}
+
+
+/* Check that a pool tree holds the same pairs, in the same shape,
+ * as a tree with the pointer layout
+ */
+int same_pool(struct avl_long *a, struct avl_long_pool *b) {
+	if (a->size != b->size || avl_long_isEmpty(a) != avl_long_pool_isEmpty(b))
+		return 0;
+	if (avl_long_isEmpty(a))
+		return 1;
+	if (a->root->elem != b->hot[b->root].elem || a->root->height != b->hot[b->root].height)
+		return 0;
+	struct avl_long_node *x = avl_long_minimum(a->root);
+	uint32_t y = avl_long_pool_minimum(b, b->root);
+	for (; x != NULL && y != TM_NIL; x = x->next, y = b->cold[y].next)
+		if (x->elem != b->hot[y].elem || x->info != b->cold[y].info)
+			return 0;
+	return x == NULL && y == TM_NIL;
+}
+
+
+void test_pool() {
+
+	FILE *f = fopen("outputs/output_pool.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	// The hot part of a node is a fraction of a pointer node
+	ASSERT(f, sizeof(struct avl_long_pool_hot) * 3 <= sizeof(struct avl_long_node), "Pool-01");
+
+	struct avl_long *tree = avl_long_create();
+	struct avl_long_pool *pool = avl_long_pool_create();
+	ASSERT(f, pool != NULL && avl_long_pool_isEmpty(pool), "Pool-02");
+	ASSERT(f, avl_long_pool_search(pool, 5) == TM_NIL, "Pool-03");
+
+	// Pseudo-random keys in [0, 300), many of them repeated
+	unsigned long seed = 11;
+	for (long i = 0; i < 2000; i++) {
+		seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+		long key = (seed >> 33) % 300;
+		avl_long_insert(tree, key, i);
+		avl_long_pool_insert(pool, key, i);
+	}
+	ASSERT(f, check_pool(pool, pool->root) > 0, "Pool-04");
+	ASSERT(f, same_pool(tree, pool), "Pool-05");
+
+	uint32_t x = avl_long_pool_search(pool, 150);
+	ASSERT(f, x != TM_NIL && pool->hot[x].elem == 150, "Pool-06");
+	ASSERT(f, pool->hot[avl_long_pool_successor(pool, x)].elem > 150, "Pool-07");
+	ASSERT(f, pool->hot[avl_long_pool_predecessor(pool, x)].elem < 150, "Pool-08");
+
+	for (long key = 0; key < 300; key += 2)
+		for (long i = 0; i < 5; i++) {
+			avl_long_delete(tree, key);
+			avl_long_pool_delete(pool, key);
+		}
+	ASSERT(f, check_pool(pool, pool->root) > 0, "Pool-09");
+	ASSERT(f, same_pool(tree, pool), "Pool-10");
+
+	// Released slots are handed out again
+	uint32_t used = pool->used;
+	for (long key = 0; key < 300; key += 2) {
+		avl_long_insert(tree, key, key);
+		avl_long_pool_insert(pool, key, key);
+	}
+	ASSERT(f, pool->used == used && same_pool(tree, pool), "Pool-11");
+
+	for (long key = 0; key < 300; key++)
+		while (avl_long_pool_search(pool, key) != TM_NIL)
+			avl_long_pool_delete(pool, key);
+	ASSERT(f, avl_long_pool_isEmpty(pool) && pool->size == 0, "Pool-12");
+
+	// The climb stops early: every intermediate tree has to stay valid
+	int ok = 1;
+	for (long key = 0; key < 500; key++)
+		avl_long_pool_insert(pool, key * 7 % 500, key);
+	for (long key = 0; key < 500 && ok; key++) {
+		avl_long_pool_delete(pool, key * 13 % 500);
+		ok = check_pool(pool, pool->root) >= 0;
+	}
+	ASSERT(f, ok && avl_long_pool_isEmpty(pool), "Pool-13");
+	avl_long_destroy(tree);
+	avl_long_pool_destroy(pool);
+
+	fprintf(f, "\nAll tests for Pool passed!\n");
+	fclose(f);
+}
+
+
+/* Check the keys of a B+ tree node: fill, order, bounds (lo included,
+ * hi excluded, NULL - none) and the padding of the free slots
+ */
+int check_bplus_keys(long *keys, int used, int root, long *lo, long *hi) {
+	if (used > TM_BPLUS_KEYS || used < (root ? 1 : TM_BPLUS_MIN))
+		return 0;
+	for (int i = 0; i < TM_BPLUS_KEYS; i++) {
+		if (i >= used) {
+			if (keys[i] != LONG_MAX)
+				return 0;
+		} else if ((i > 0 && keys[i - 1] >= keys[i])
+				   || (lo != NULL && keys[i] < *lo) || (hi != NULL && keys[i] >= *hi)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/* Check a B+ tree: every leaf at the same depth and met in the order of
+ * the leaf links (*leaf is the next one expected)
+ *
+ * return: the number of entries below x, -1 if it is broken
+ */
+long check_bplus(struct bpt_long *tree, void *x, int height, long *lo, long *hi,
+				 struct bpt_long_leaf **leaf) {
+	int root = x == tree->root;
+	if (height == 0) {
+		struct bpt_long_leaf *l = (struct bpt_long_leaf *)x;
+		if (l != *leaf || !check_bplus_keys(l->keys, l->used, root, lo, hi))
+			return -1;
+		if ((l->prev == NULL) != (l == tree->first) || (l->prev != NULL && l->prev->next != l))
+			return -1;
+		if (l->next == NULL && l != tree->last)
+			return -1;
+		*leaf = l->next;
+		long entries = l->used;
+		for (int i = 0; i < l->used; i++)
+			for (struct bpt_long_dup *d = l->dups[i]; d != NULL; d = d->next)
+				entries++;
+		return entries;
+	}
+	struct bpt_long_inner *inner = (struct bpt_long_inner *)x;
+	if (!check_bplus_keys(inner->keys, inner->used, root, lo, hi))
+		return -1;
+	long entries = 0;
+	for (int i = 0; i <= inner->used; i++) {
+		long sub = check_bplus(tree, inner->children[i], height - 1,
+							   i > 0 ? &inner->keys[i - 1] : lo,
+							   i < inner->used ? &inner->keys[i] : hi, leaf);
+		if (sub < 0)
+			return -1;
+		entries += sub;
+	}
+	return entries;
+}
+
+
+/* Check that a B+ tree holds the same pairs, in the same order,
+ * as an AVL tree
+ */
+int same_bplus(struct avl_long *a, struct bpt_long *b) {
+	if (a->size != b->size || avl_long_isEmpty(a) != bpt_long_isEmpty(b))
+		return 0;
+	struct bpt_long_leaf *leaf = b->first;
+	if (b->root != NULL && check_bplus(b, b->root, b->height, NULL, NULL, &leaf) != b->size)
+		return 0;
+	struct avl_long_node *x = avl_long_isEmpty(a) ? NULL : avl_long_minimum(a->root);
+	for (struct bpt_long_pos p = bpt_long_minimum(b); p.leaf != NULL; p = bpt_long_successor(b, p)) {
+		if (x == NULL || x->elem != p.leaf->keys[p.slot] || x->info != p.leaf->infos[p.slot])
+			return 0;
+		x = x->next;
+		for (struct bpt_long_dup *d = p.leaf->dups[p.slot]; d != NULL; d = d->next, x = x->next)
+			if (x == NULL || x->elem != p.leaf->keys[p.slot] || x->info != d->info)
+				return 0;
+	}
+	return x == NULL;
+}
+
+
+void test_bplus(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_bplus.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	struct avl_long *tree = avl_long_create();
+	struct bpt_long *bpt = bpt_long_create();
+	ASSERT(f, bpt != NULL && bpt_long_isEmpty(bpt), "BPlus-01");
+	ASSERT(f, bpt_long_search(bpt, 5).leaf == NULL && bpt_long_minimum(bpt).leaf == NULL, "BPlus-02");
+
+	// The vector count of a node agrees with the comparisons one by one
+	long node[TM_BPLUS_KEYS];
+	int agree = 1;
+	for (int used = 0; used <= TM_BPLUS_KEYS; used++) {
+		for (int i = 0; i < TM_BPLUS_KEYS; i++)
+			node[i] = i < used ? (i - 4) * 3L : LONG_MAX;
+		node[0] = used > 0 ? LONG_MIN : node[0];
+		for (long k = -20; k < 60; k++) {
+			int below = 0, notAbove = 0;
+			for (int i = 0; i < used; i++) {
+				below += node[i] < k;
+				notAbove += node[i] <= k;
+			}
+			if (bpt_long_countBelow(node, used, k, 0) != below
+				|| bpt_long_countBelow(node, used, k, 1) != notAbove)
+				agree = 0;
+		}
+		if (used > 0 && bpt_long_countBelow(node, used, LONG_MIN, 1) != 1)
+			agree = 0;
+	}
+	ASSERT(f, agree, "BPlus-03");
+
+	// Pseudo-random keys in [0, 3000), many of them repeated
+	unsigned long seed = 23;
+	for (long i = 0; i < 8000; i++) {
+		seed = seed * 6364136223846793005ul + 1442695040888963407ul;
+		long key = (seed >> 33) % 3000;
+		avl_long_insert(tree, key, i);
+		bpt_long_insert(bpt, key, i);
+	}
+	ASSERT(f, bpt->height >= 2 && same_bplus(tree, bpt), "BPlus-04");
+
+	int found = 1;
+	for (long key = -1; key <= 3000; key++) {
+		struct avl_long_node *x = avl_long_search(tree, key);
+		struct bpt_long_pos p = bpt_long_search(bpt, key);
+		if ((x == NULL) != (p.leaf == NULL) || (x != NULL && p.leaf->infos[p.slot] != x->info))
+			found = 0;
+	}
+	ASSERT(f, found, "BPlus-05");
+
+	// Walking back from the maximum meets the same keys, decreasing
+	long keys = 0, forward = 0, last = LONG_MAX;
+	int descending = 1;
+	for (struct bpt_long_pos p = bpt_long_minimum(bpt); p.leaf != NULL; p = bpt_long_successor(bpt, p))
+		forward++;
+	for (struct bpt_long_pos p = bpt_long_maximum(bpt); p.leaf != NULL; p = bpt_long_predecessor(bpt, p)) {
+		descending &= p.leaf->keys[p.slot] < last;
+		last = p.leaf->keys[p.slot];
+		keys++;
+	}
+	struct bpt_long_pos p = bpt_long_search(bpt, avl_long_maximum(tree->root)->elem);
+	ASSERT(f, descending && keys == forward && bpt_long_successor(bpt, p).leaf == NULL, "BPlus-06");
+
+	for (long key = 0; key < 3000; key += 2)
+		for (long i = 0; i < 5; i++) {
+			avl_long_delete(tree, key);
+			bpt_long_delete(bpt, key);
+		}
+	ASSERT(f, same_bplus(tree, bpt), "BPlus-07");
+
+	for (long key = 0; key < 3000; key++)
+		while (avl_long_search(tree, key) != NULL) {
+			avl_long_delete(tree, key);
+			bpt_long_delete(bpt, key);
+		}
+	ASSERT(f, bpt_long_isEmpty(bpt) && bpt->size == 0 && bpt->first == NULL, "BPlus-08");
+
+	// Every intermediate tree stays valid while the leaves and the
+	// inner nodes borrow from and merge with their siblings
+	for (long key = 0; key < 20000; key++) {
+		avl_long_insert(tree, key * 7 % 20000, key);
+		bpt_long_insert(bpt, key * 7 % 20000, key);
+	}
+	int ok = bpt->height >= 3 && same_bplus(tree, bpt);
+	for (long key = 0; key < 20000 && ok; key++) {
+		avl_long_delete(tree, key * 13 % 20000);
+		bpt_long_delete(bpt, key * 13 % 20000);
+		if (key % 97 == 0)
+			ok = same_bplus(tree, bpt);
+	}
+	ASSERT(f, ok && bpt_long_isEmpty(bpt) && avl_long_isEmpty(tree), "BPlus-09");
+	avl_long_destroy(tree);
+	bpt_long_destroy(bpt);
+
+	// Same words and order as the generic dictionary
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+	struct bpt_str5 *words = bpt_str5_create();
+	char buffer[BUFLEN];
+	FILE *in = fopen("inputs/key.txt", "r");
+	int idx = 0;
+	while (in != NULL && fgets(buffer, BUFLEN, in)) {
+		char *token = strtok(buffer, " ,.?!\n");
+		while (token) {
+			bpt_str5_insert(words, packKey(token, ELEMENT_TREE_LENGTH), idx);
+			idx += strlen(token);
+			token = strtok(NULL, " ,.?!\n\r");
+		}
+	}
+	if (in != NULL)
+		fclose(in);
+	ASSERT(f, words->size == (*dict)->size, "BPlus-10");
+
+	int same = 1;
+	char word[sizeof(uint64_t)];
+	TreeCursor y = cursorAt(*dict, minimum((*dict)->root));
+	for (struct bpt_str5_pos q = bpt_str5_minimum(words); q.leaf != NULL && same; q = bpt_str5_successor(words, q)) {
+		avl_str5_word(q.leaf->keys[q.slot], word);
+		int info = q.leaf->infos[q.slot];
+		for (struct bpt_str5_dup *d = q.leaf->dups[q.slot]; ; d = d->next) {
+			if (!cursorValid(&y) || info != *(int*)cursorInfo(&y)
+				|| strcmp(word, (char*)cursorElem(&y)) != 0) {
+				same = 0;
+				break;
+			}
+			cursorNext(&y);
+			if (d == NULL)
+				break;
+			info = d->info;
+		}
+	}
+	ASSERT(f, same && !cursorValid(&y), "BPlus-11");
+	bpt_str5_destroy(words);
+
+	fprintf(f, "\nAll tests for BPlus passed!\n");
+	fclose(f);
+}
+
+
+/* Reader thread of test_snapshot: every snapshot must stay sorted and
+ * as big as its version says, while the writer keeps changing the tree
+ */
+typedef struct SnapshotReader{
+	VTree *tree;
+	atomic_int *stop;
+	long snapshots;
+	int ok;
+}SnapshotReader;
+
+static void countSorted(VNode *x, void *arg) {
+	long *last = (long *)arg;
+	if (last[1] != 0 && *((long*)x->elem) < last[0])
+		last[2] = 1;
+	last[0] = *((long*)x->elem);
+	last[1]++;
+}
+
+static void* readSnapshots(void *arg) {
+	SnapshotReader *reader = (SnapshotReader *)arg;
+	reader->ok = 1;
+	reader->snapshots = 0;
+	while (!atomic_load(reader->stop) || reader->snapshots == 0) {
+		VSnapshot snapshot;
+		if (snapshotOpen(reader->tree, &snapshot) != 0)
+			continue;
+		long state[3] = {0, 0, 0};	// last key, entries, unsorted
+		snapshotForEach(&snapshot, NULL, NULL, countSorted, state);
+		if (state[2] || state[1] != snapshotSize(&snapshot))
+			reader->ok = 0;
+		snapshotClose(&snapshot);
+		reader->snapshots++;
+	}
+	return NULL;
+}
+
+
+void test_snapshot(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_snapshot.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	VTree *tree = createVTree(createLong, destroyLong,
+							  createLong, destroyLong, compareLong);
+	VSnapshot empty, before, after;
+	ASSERT(f, snapshotOpen(tree, &empty) == 0 && snapshotSize(&empty) == 0, "Snapshot-01");
+	for (long key = 0; key < 100; key++) {
+		long info = key + 1000;
+		vtreeInsert(tree, &key, &key);
+		if (key % 10 == 0)
+			vtreeInsert(tree, &key, &info);
+	}
+	ASSERT(f, snapshotOpen(tree, &before) == 0 && snapshotSize(&before) == 110, "Snapshot-02");
+
+	// Writes do not change the versions already pinned
+	for (long key = 0; key < 100; key += 2)
+		vtreeDelete(tree, &key);
+	long key = 50;
+	ASSERT(f, snapshotSize(&empty) == 0 && snapshotSearch(&empty, &key) == NULL, "Snapshot-03");
+	ASSERT(f, snapshotSize(&before) == 110 && snapshotSearch(&before, &key) != NULL, "Snapshot-04");
+	ASSERT(f, snapshotOpen(tree, &after) == 0 && snapshotSize(&after) == 60, "Snapshot-05");
+	ASSERT(f, *((long*)snapshotSearch(&after, &key)->info) == 50l, "Snapshot-06");
+	key = 51;
+	ASSERT(f, *((long*)snapshotSearch(&after, &key)->info) == 51l, "Snapshot-07");
+	snapshotClose(&empty);
+	snapshotClose(&before);
+
+	// Duplicates come out in insertion order, the last one is deleted
+	long lo = 9, hi = 31;
+	long state[3] = {0, 0, 0};
+	ASSERT(f, snapshotForEach(&after, &lo, &hi, countSorted, state) == 13 && !state[2], "Snapshot-08");
+	snapshotClose(&after);
+
+	// Readers keep working while the writer changes the tree
+	atomic_int stop;
+	atomic_init(&stop, 0);
+	SnapshotReader readers[4];
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) {
+		readers[i].tree = tree;
+		readers[i].stop = &stop;
+		pthread_create(&threads[i], NULL, readSnapshots, &readers[i]);
+	}
+	for (long i = 0; i < 2000; i++) {
+		key = (i * 37) % 300;
+		vtreeInsert(tree, &key, &i);
+		if (i % 3 == 0)
+			vtreeDelete(tree, &key);
+	}
+	atomic_store(&stop, 1);
+	int ok = 1;
+	for (int i = 0; i < 4; i++) {
+		pthread_join(threads[i], NULL);
+		ok &= readers[i].ok;
+	}
+	ASSERT(f, ok, "Snapshot-09");
+	destroyVTree(tree);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Same keys as the queries on the dictionary
+	VTree *words = createVTree(createStrElement, destroyStrElement,
+							   createIndexInfo, destroyIndexInfo, compareStr);
+	char buffer[BUFLEN];
+	FILE *in = fopen("inputs/key.txt", "r");
+	int idx = 0;
+	while (in != NULL && fgets(buffer, BUFLEN, in)) {
+		char *token = strtok(buffer, " ,.?!\n");
+		while (token) {
+			vtreeInsert(words, token, &idx);
+			idx += strlen(token);
+			token = strtok(NULL, " ,.?!\n\r");
+		}
+	}
+	if (in != NULL)
+		fclose(in);
+	VSnapshot snapshot;
+	snapshotOpen(words, &snapshot);
+	Range *expected = inorderKeyQuery(*dict), *actual = snapshotInorderKey(&snapshot);
+	ok = expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Snapshot-10");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+
+	expected = rangeKeyQuery(*dict, "CD", "GG");
+	actual = snapshotRangeKey(&snapshot, "CD", "GG");
+	ok = expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Snapshot-11");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+	snapshotClose(&snapshot);
+	destroyVTree(words);
+
+	fprintf(f, "\nAll tests for Snapshot passed!\n");
+	fclose(f);
+}
+
+
+/* Check a quiescent concurrent tree: order, parent links, heights and
+ * balance, no routing node with less than two children
+ *
+ * return: the height of x or -1
+ */
+long check_ctree(CNode *x, CNode *parent, long *lo, long *hi) {
+	if (x == NULL)
+		return 0;
+	long key = *((long*)x->elem);
+	if (atomic_load(&x->parent) != parent || (lo && key <= *lo) || (hi && key >= *hi))
+		return -1;
+	CNode *left = atomic_load(&x->left), *right = atomic_load(&x->right);
+	if (atomic_load(&x->first) == NULL && (left == NULL || right == NULL))
+		return -1;
+	long l = check_ctree(left, x, lo, &key);
+	long r = check_ctree(right, x, &key, hi);
+	if (l < 0 || r < 0 || l - r > 1 || r - l > 1)
+		return -1;
+	long height = 1 + (l > r ? l : r);
+	return atomic_load(&x->height) == height ? height : -1;
+}
+
+/* Visitor of test_concurrent: keys sorted and occurrences per key */
+static void countOccurrences(void *elem, void *info, void *arg) {
+	long *state = (long *)arg;	// last key, entries, unsorted, last info,
+								// occurrences of the last key, uneven keys
+	long key = *((long*)elem);
+	if (state[1] != 0 && key < state[0])
+		state[2] = 1;
+	if (state[1] != 0 && key == state[0] && *((long*)info) < state[3])
+		state[2] = 1;
+	if (state[1] != 0 && key != state[0]) {
+		if (state[4] != 4)
+			state[5]++;
+		state[4] = 0;
+	}
+	state[0] = key;
+	state[3] = *((long*)info);
+	state[4]++;
+	state[1]++;
+}
+
+typedef struct ConcurrentWriter{
+	CTree *tree;
+	long id;
+	long keys;
+	int deletes;
+}ConcurrentWriter;
+
+/* Every writer inserts every key once; with deletes it first removes one
+ * occurrence of the key and inserts it again shifted by keys
+ */
+static void* writeConcurrent(void *arg) {
+	ConcurrentWriter *w = (ConcurrentWriter *)arg;
+	for (long i = 0; i < w->keys; i++) {
+		long key = (i * 7 + w->id * 131) % w->keys;
+		if (w->deletes) {
+			ctreeDelete(w->tree, &key);
+			key += w->keys;
+		}
+		ctreeInsert(w->tree, &key, &w->id);
+	}
+	return NULL;
+}
+
+
+void test_concurrent() {
+
+	FILE *f = fopen("outputs/output_concurrent.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	CTree *tree = createCTree(createLong, destroyLong,
+							  createLong, destroyLong, compareLong);
+	long key = 5;
+	ASSERT(f, ctreeSize(tree) == 0 && ctreeSearch(tree, &key) == NULL, "Concurrent-01");
+
+	// Same duplicate semantics as insert() and delete()
+	for (long i = 0; i < 100; i++) {
+		key = i % 20;
+		ctreeInsert(tree, &key, &i);
+	}
+	key = 5;
+	ASSERT(f, ctreeSize(tree) == 100 && *((long*)ctreeSearch(tree, &key)) == 5l, "Concurrent-02");
+	ctreeDelete(tree, &key);
+	ctreeDelete(tree, &key);
+	ASSERT(f, ctreeSize(tree) == 98 && *((long*)ctreeSearch(tree, &key)) == 5l, "Concurrent-03");
+	long state[6] = {0, 0, 0, 0, 0, 0};
+	ctreeForEach(tree, countOccurrences, state);
+	ASSERT(f, state[1] == 98 && !state[2], "Concurrent-04");
+
+	for (int i = 0; i < 3; i++)
+		ctreeDelete(tree, &key);
+	ctreeDelete(tree, &key);
+	ASSERT(f, ctreeSize(tree) == 95 && ctreeSearch(tree, &key) == NULL, "Concurrent-05");
+	ASSERT(f, check_ctree(atomic_load(&tree->holder.right), &tree->holder, NULL, NULL) > 0, "Concurrent-06");
+	destroyCTree(tree);
+
+	// Several writers at the same time
+	tree = createCTree(createLong, destroyLong, createLong, destroyLong, compareLong);
+	ConcurrentWriter writers[4];
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) {
+		writers[i] = (ConcurrentWriter){tree, i, 2000, 0};
+		pthread_create(&threads[i], NULL, writeConcurrent, &writers[i]);
+	}
+	for (int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+	memset(state, 0, sizeof(state));
+	ctreeForEach(tree, countOccurrences, state);
+	ASSERT(f, ctreeSize(tree) == 8000 && state[1] == 8000 && !state[5] && state[4] == 4, "Concurrent-07");
+	ASSERT(f, check_ctree(atomic_load(&tree->holder.right), &tree->holder, NULL, NULL) > 0, "Concurrent-08");
+
+	for (int i = 0; i < 4; i++) {
+		writers[i].deletes = 1;
+		pthread_create(&threads[i], NULL, writeConcurrent, &writers[i]);
+	}
+	for (int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+	key = 1000;
+	ASSERT(f, ctreeSearch(tree, &key) == NULL && ctreeSize(tree) == 8000, "Concurrent-09");
+	memset(state, 0, sizeof(state));
+	ctreeForEach(tree, countOccurrences, state);
+	ASSERT(f, state[1] == 8000 && !state[5] && state[4] == 4 && state[0] == 3999, "Concurrent-10");
+	ASSERT(f, check_ctree(atomic_load(&tree->holder.right), &tree->holder, NULL, NULL) > 0, "Concurrent-11");
+	// the 8000 deleted occurrences are freed while the writers run
+	ASSERT(f, atomic_load(&tree->pending) < 1000, "Concurrent-12");
+	destroyCTree(tree);
+
+	fprintf(f, "\nAll tests for Concurrent passed!\n");
+	fclose(f);
+}
+
+
+typedef struct ShardWriter{
+	STree *tree;
+	long id;
+	long first;			// keys first ... first + keys - 1
+	long keys;
+}ShardWriter;
+
+/* Every writer inserts every key of its range once */
+static void* writeShards(void *arg) {
+	ShardWriter *w = (ShardWriter *)arg;
+	for (long i = 0; i < w->keys; i++) {
+		long key = w->first + (i * 7 + w->id * 131) % w->keys;
+		shardedInsert(w->tree, &key, &w->id);
+	}
+	return NULL;
+}
+
+static void ingestShards(STree *tree, long first, long keys) {
+	ShardWriter writers[4];
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++) {
+		writers[i] = (ShardWriter){tree, i, first, keys};
+		pthread_create(&threads[i], NULL, writeShards, &writers[i]);
+	}
+	for (int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+}
+
+/* Check every shard: valid tree, keys inside its bounds, size
+ * return: 1 - if every shard holds exactly size entries, 0 - otherwise
+ */
+int check_shards(STree *tree, long size) {
+	for (int i = 0; i < tree->count; i++) {
+		TTree *shard = tree->shards[i];
+		if (shard->size != size || check_avl(shard, shard->root, NULL) < 0)
+			return 0;
+		if (i > 0 && compareLong(minimum(shard->root)->elem, tree->bounds[i - 1]) <= 0)
+			return 0;
+		if (i + 1 < tree->count && compareLong(maximum(shard->root)->elem, tree->bounds[i]) > 0)
+			return 0;
+	}
+	return 1;
+}
+
+
+void test_sharded(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_sharded.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	STree *tree = createShardedTree(4, createLong, destroyLong,
+									createLong, destroyLong, compareLong);
+	long key = 10;
+	ASSERT(f, tree->count == 1 && shardedSize(tree) == 0 && shardedSearch(tree, &key) == NULL, "Sharded-01");
+
+	// Parallel ingest, then bounds at the quartiles
+	ingestShards(tree, 0, 1000);
+	ASSERT(f, shardedSize(tree) == 4000, "Sharded-02");
+	ASSERT(f, rebalanceShards(tree) == 0 && tree->count == 4, "Sharded-03");
+	ASSERT(f, check_shards(tree, 1000), "Sharded-04");
+
+	// Skewed ingest: every new key lands in the last shard
+	ingestShards(tree, 1000, 1000);
+	ASSERT(f, tree->shards[3]->size == 5000 && shardedSize(tree) == 8000, "Sharded-05");
+	ASSERT(f, rebalanceShards(tree) == 0 && check_shards(tree, 2000), "Sharded-06");
+
+	key = 1500;
+	ASSERT(f, shardedSearch(tree, &key) != NULL, "Sharded-07");
+	for (int i = 0; i < 4; i++)
+		shardedDelete(tree, &key);
+	ASSERT(f, shardedSearch(tree, &key) == NULL && shardedSize(tree) == 7996, "Sharded-08");
+	destroyShardedTree(tree);
+
+	// A shard using an arena cannot be split: the layout does not move
+	tree = createShardedTree(2, createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	treeUseArena(tree->shards[0], sizeof(long), sizeof(long));
+	for (key = 0; key < 100; key++)
+		shardedInsert(tree, &key, &key);
+	ASSERT(f, rebalanceShards(tree) == -1 && tree->count == 1 &&
+			  tree->shards[0]->size == 100 && tree->shards[1]->size == 0, "Sharded-09");
+	destroyShardedTree(tree);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Cipher queries stitched from the shards
+	STree *words = createShardedTree(3, createStrElement, destroyStrElement,
+									 createIndexInfo, destroyIndexInfo, compareStr);
+	shardsUsePackedKeys(words, ELEMENT_TREE_LENGTH);
+	shardsCompactDuplicates(words, sizeof(int));
+	char buffer[BUFLEN];
+	FILE *in = fopen("inputs/key.txt", "r");
+	int idx = 0;
+	while (in != NULL && fgets(buffer, BUFLEN, in)) {
+		char *token = strtok(buffer, " ,.?!\n");
+		while (token) {
+			shardedInsert(words, token, &idx);
+			idx += strlen(token);
+			token = strtok(NULL, " ,.?!\n\r");
+		}
+	}
+	if (in != NULL)
+		fclose(in);
+	ASSERT(f, rebalanceShards(words) == 0 && words->count == 3, "Sharded-10");
+
+	Range *expected = inorderKeyQuery(*dict), *actual = shardedInorderKey(words);
+	int ok = expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Sharded-11");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+
+	expected = rangeKeyQuery(*dict, "CD", "GG");
+	actual = shardedRangeKey(words, "CD", "GG");
+	ok = expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Sharded-12");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+	destroyShardedTree(words);
+
+	// Packed keys are routed without compare nor createElement
+	words = createShardedTree(3, NULL, NULL, createIndexInfo, destroyIndexInfo, NULL);
+	shardsUsePackedKeys(words, ELEMENT_TREE_LENGTH);
+	for (TreeNode *x = minimum((*dict)->root); x != NULL; x = x->next)
+		shardedInsert(words, x->elem, x->info);
+	ok = rebalanceShards(words) == 0 && words->count == 3 &&
+		 shardedSize(words) == (*dict)->size;
+	for (TreeNode *x = minimum((*dict)->root); ok && x != NULL; x = x->next)
+		ok = shardedSearch(words, x->elem) != NULL;
+	expected = rangeKeyQuery(*dict, "CD", "GG");
+	actual = shardedRangeKey(words, "CD", "GG");
+	ok = ok && expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Sharded-13");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+	destroyShardedTree(words);
+
+	fprintf(f, "\nAll tests for Sharded passed!\n");
+	fclose(f);
+}
+
+
+/* Compare the answers of a frozen copy with the ones of its tree for
+ * every key in [lo, hi)
+ */
+int same_frozen(TTree *tree, FTree *frozen, long lo, long hi) {
+	for (long key = lo; key < hi; key++) {
+		TreeNode *x = search(tree, tree->root, &key);
+		long entry = frozenSearch(frozen, &key);
+		if ((x == NULL) != (entry == -1))
+			return 0;
+		if (x != NULL && *((long*)frozenInfo(frozen, entry)) != *((long*)x->info))
+			return 0;
+		long below = rank(tree, &key);
+		if (frozenLowerBound(frozen, &key) != below)
+			return 0;
+		if (frozenUpperBound(frozen, &key) != below + (x != NULL ? countOf(tree, x) : 0))
+			return 0;
+	}
+	return 1;
+}
+
+
+void test_frozen(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_frozen.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *tree = create_long_tree(0), *chunked = create_long_tree(1);
+	FTree *frozen = freezeTree(tree, sizeof(long));
+	long key = 3;
+	ASSERT(f, frozen->size == 0 && frozenSearch(frozen, &key) == -1 &&
+			  frozenUpperBound(frozen, &key) == 0, "Frozen-01");
+	destroyFrozenTree(frozen);
+
+	long n = 0;
+	for (key = 0; key < 300; key += 3)
+		for (long i = 0; i <= key % 7; i++, n++) {
+			insert(tree, &key, &n);
+			insert(chunked, &key, &n);
+		}
+	frozen = freezeTree(tree, sizeof(long));
+	ASSERT(f, frozen->keys == 100 && frozen->size == n, "Frozen-02");
+
+	// Same first occurrence as search(), duplicates in order
+	ASSERT(f, same_frozen(tree, frozen, -2, 305), "Frozen-03");
+	int ok = 1;
+	TreeCursor cursor = cursorAt(tree, minimum(tree->root));
+	for (long i = 0; cursorValid(&cursor); i++, cursorNext(&cursor))
+		ok &= *((long*)frozenInfo(frozen, i)) == *((long*)cursorInfo(&cursor));
+	ASSERT(f, ok, "Frozen-04");
+	destroyFrozenTree(frozen);
+
+	frozen = freezeTree(chunked, sizeof(long));
+	ASSERT(f, frozen->size == n && same_frozen(chunked, frozen, -2, 305), "Frozen-05");
+	destroyFrozenTree(frozen);
+	destroyTree(tree);
+	destroyTree(chunked);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Packed keys: the Cipher queries become slices of the info column
+	frozen = freezeTree(*dict, sizeof(int));
+	ASSERT(f, frozenSearch(frozen, minimum((*dict)->root)->elem) == 0, "Frozen-06");
+	Range *expected = inorderKeyQuery(*dict), *actual = frozenInorderKey(frozen);
+	ok = expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Frozen-07");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+
+	expected = rangeKeyQuery(*dict, "CD", "GG");
+	actual = frozenRangeKey(frozen, "CD", "GG");
+	ok = expected->size == actual->size;
+	for (int i = 0; ok && i < expected->size; i++)
+		ok = expected->index[i] == actual->index[i];
+	ASSERT(f, ok, "Frozen-08");
+	free(expected->index);
+	free(expected);
+	free(actual->index);
+	free(actual);
+	destroyFrozenTree(frozen);
+
+	fprintf(f, "\nAll tests for Frozen passed!\n");
+	fclose(f);
+}
+
+
+/* Apply the same inserts and deletes to a lazy and an eager tree
+ * (keys 0 ... 199, every third one twice; the even keys are deleted)
+ */
+void fill_lazy(TTree *lazy, TTree *eager) {
+	for (long key = 0; key < 200; key++)
+		for (long i = 0; i <= (key % 3 == 0); i++) {
+			long info = key * 10 + i;
+			insert(lazy, &key, &info);
+			insert(eager, &key, &info);
+		}
+	for (long key = 0; key < 200; key += 2)
+		for (long i = 0; i <= (key % 3 == 0); i++) {
+			delete(lazy, &key);
+			delete(eager, &key);
+		}
+}
+
+
+int same_mapped(TTree *tree, MTree *mapped, long lo, long hi) {
+	for (long key = lo; key < hi; key++) {
+		TreeNode *x = search(tree, tree->root, &key);
+		long entry = mappedSearch(mapped, &key);
+		if ((x == NULL) != (entry == -1))
+			return 0;
+		if (x != NULL && *((long*)mappedInfo(mapped, entry)) != *((long*)x->info))
+			return 0;
+		long below = rank(tree, &key);
+		if (mappedLowerBound(mapped, &key) != below)
+			return 0;
+		if (mappedUpperBound(mapped, &key) != below + (x != NULL ? countOf(tree, x) : 0))
+			return 0;
+	}
+	return 1;
+}
+
+
+void test_mapped(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_mapped.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *tree = create_long_tree(0), *chunked = create_long_tree(1);
+	ASSERT(f, saveTree(tree, "outputs/empty.snap", sizeof(long), sizeof(long)) == 0, "Mapped-01");
+	MTree *mapped = loadTree("outputs/empty.snap", compareLong);
+	long key = 3;
+	ASSERT(f, mapped != NULL && mapped->header->size == 0 &&
+			  mappedSearch(mapped, &key) == -1 && mappedUpperBound(mapped, &key) == 0,
+			  "Mapped-02");
+	closeMappedTree(mapped);
+
+	long n = 0;
+	for (key = 0; key < 300; key += 3)
+		for (long i = 0; i <= key % 7; i++, n++) {
+			insert(tree, &key, &n);
+			insert(chunked, &key, &n);
+		}
+	saveTree(tree, "outputs/long.snap", sizeof(long), sizeof(long));
+	mapped = loadTree("outputs/long.snap", compareLong);
+	ASSERT(f, mapped != NULL && mapped->header->keys == 100 &&
+			  mapped->header->size == n, "Mapped-03");
+
+	// Same first occurrence as search(), duplicates in order
+	ASSERT(f, same_mapped(tree, mapped, -2, 305), "Mapped-04");
+	int ok = 1;
+	TreeCursor cursor = cursorAt(tree, minimum(tree->root));
+	for (long i = 0; cursorValid(&cursor); i++, cursorNext(&cursor))
+		ok &= *((long*)mappedInfo(mapped, i)) == *((long*)cursorInfo(&cursor));
+	ASSERT(f, ok, "Mapped-05");
+
+	// The shape of the tree is kept
+	long root = mapped->header->root;
+	ASSERT(f, *((long*)mappedElem(mapped, root)) == *((long*)tree->root->elem) &&
+			  *((long*)mappedElem(mapped, mapped->nodes[root].left)) ==
+			  *((long*)tree->root->left->elem), "Mapped-06");
+	closeMappedTree(mapped);
+
+	saveTree(chunked, "outputs/long.snap", sizeof(long), sizeof(long));
+	mapped = loadTree("outputs/long.snap", compareLong);
+	ASSERT(f, mapped != NULL && same_mapped(chunked, mapped, -2, 305), "Mapped-07");
+	closeMappedTree(mapped);
+	destroyTree(tree);
+	destroyTree(chunked);
+
+	// Missing, truncated and foreign files are refused
+	ASSERT(f, loadTree("outputs/missing.snap", compareLong) == NULL, "Mapped-08");
+	FILE *snap = fopen("outputs/long.snap", "r+b");
+	fseek(snap, 0, SEEK_END);
+	long length = ftell(snap);
+	ftruncate(fileno(snap), length - 1);
+	fclose(snap);
+	ASSERT(f, loadTree("outputs/long.snap", compareLong) == NULL, "Mapped-09");
+	ASSERT(f, loadTree("inputs/key.txt", compareStr) == NULL, "Mapped-10");
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Packed keys: the Cipher queries are served from the mapped pages
+	TTree *packed = create_packed_dict();
+	buildTreeFromFile("inputs/key.txt", packed);
+	saveTree(packed, "outputs/dict.snap", 0, sizeof(int));
+	mapped = loadTree("outputs/dict.snap", NULL);
+	ASSERT(f, mapped != NULL &&
+			  mappedSearch(mapped, minimum(packed->root)->elem) == 0, "Mapped-11");
+	destroyTree(packed);
+	ASSERT(f, same_range(inorderKeyQuery(*dict), mappedInorderKey(mapped)), "Mapped-12");
+	ASSERT(f, same_range(levelKeyQuery(*dict), mappedLevelKey(mapped)), "Mapped-13");
+	ASSERT(f, same_range(rangeKeyQuery(*dict, "CD", "GG"),
+						 mappedRangeKey(mapped, "CD", "GG")), "Mapped-14");
+	closeMappedTree(mapped);
+
+	// String keys are copied into the keys section
+	TTree *words = createTree(createStrElement, destroyStrElement,
+							  createIndexInfo, destroyIndexInfo, compareStr);
+	buildTreeFromFile("inputs/key.txt", words);
+	saveTree(words, "outputs/words.snap", 0, sizeof(int));
+	mapped = loadTree("outputs/words.snap", compareStr);
+	ok = mapped != NULL && mapped->header->keys > 0;
+	for (TreeNode *x = minimum(words->root); ok && x != NULL; x = x->end->next)
+		ok = mappedSearch(mapped, x->elem) == rank(words, x->elem);
+	ASSERT(f, ok, "Mapped-15");
+	ASSERT(f, same_range(levelKeyQuery(words), mappedLevelKey(mapped)), "Mapped-16");
+	closeMappedTree(mapped);
+	destroyTree(words);
+
+	// The tombstones of a lazy tree are skipped, not compacted away
+	TTree *lazy = create_long_tree(0), *eager = create_long_tree(0);
+	treeLazyDelete(lazy, 1e9);
+	fill_lazy(lazy, eager);
+	saveTree(lazy, "outputs/long.snap", sizeof(long), sizeof(long));
+	mapped = loadTree("outputs/long.snap", compareLong);
+	ASSERT(f, mapped != NULL && summaryOf(lazy->root)->dead == 100 &&
+			  mapped->header->keys == 100 && mapped->header->size == eager->size &&
+			  same_mapped(eager, mapped, -2, 205), "Mapped-17");
+	closeMappedTree(mapped);
+	destroyTree(lazy);
+	destroyTree(eager);
+
+	// Nodes pointing out of their section are refused
+	snap = fopen("outputs/long.snap", "r+b");
+	MappedHeader header;
+	ok = snap != NULL && fread(&header, sizeof(header), 1, snap) == 1;
+	MappedNode node;
+	if (ok) {
+		fseek(snap, header.nodesOffset, SEEK_SET);
+		ok = fread(&node, sizeof(node), 1, snap) == 1;
+		node.left = header.keys;
+		fseek(snap, header.nodesOffset, SEEK_SET);
+		ok = ok && fwrite(&node, sizeof(node), 1, snap) == 1;
+	}
+	if (snap != NULL)
+		fclose(snap);
+	ASSERT(f, ok && loadTree("outputs/long.snap", compareLong) == NULL, "Mapped-18");
+
+	fprintf(f, "\nAll tests for Mapped passed!\n");
+	fclose(f);
+}
+
+
+/* Restore a long tree from the files of its log, as after a restart
+ */
+TTree* reopen_logged(LTree **logged) {
+	closeLoggedTree(*logged);
+	TTree *tree = create_long_tree(1);
+	*logged = openLoggedTree(tree, "outputs/logged", sizeof(long), sizeof(long));
+	return tree;
+}
+
+
+void test_logged() {
+
+	FILE *f = fopen("outputs/output_logged.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	remove("outputs/logged.snap");
+	remove("outputs/logged.wal");
+	TTree *tree = create_long_tree(1), *expected = create_long_tree(0);
+	LTree *logged = openLoggedTree(tree, "outputs/logged", sizeof(long), sizeof(long));
+	ASSERT(f, logged != NULL && logged->sequence == 0 && tree->root == NULL, "Logged-01");
+
+	// Committed changes survive a restart, duplicates in order
+	for (long key = 0, info = 0; key < 500; key++, info++) {
+		long k = key * 7 % 61;
+		loggedInsert(logged, &k, &info);
+		insert(expected, &k, &info);
+		if (key % 5 == 4) {
+			loggedDelete(logged, &k);
+			delete(expected, &k);
+		}
+	}
+	ASSERT(f, same_pairs(tree, expected) && logged->sequence == 600, "Logged-02");
+	destroyTree(tree);
+	tree = reopen_logged(&logged);
+	ASSERT(f, logged != NULL && logged->sequence == 600 &&
+			  same_pairs(tree, expected) && check_list(tree), "Logged-03");
+
+	// Only the log written after the checkpoint is replayed
+	ASSERT(f, loggedCheckpoint(logged) == 0 &&
+			  logged->logBytes == sizeof(LogHeader), "Logged-04");
+	for (long key = 0; key < 40; key++) {
+		loggedDelete(logged, &key);
+		delete(expected, &key);
+	}
+	destroyTree(tree);
+	tree = reopen_logged(&logged);
+	ASSERT(f, logged != NULL && logged->sequence == 640 &&
+			  same_pairs(tree, expected), "Logged-05");
+
+	// A checkpoint saved before the log could be replaced: the old
+	// changes are not applied twice
+	long key = 1000, info = 1;
+	loggedInsert(logged, &key, &info);
+	insert(expected, &key, &info);
+	loggedSync(logged);
+	saveCheckpoint(tree, "outputs/logged.snap", sizeof(long), sizeof(long), logged->sequence);
+	destroyTree(tree);
+	tree = reopen_logged(&logged);
+	ASSERT(f, logged != NULL && same_pairs(tree, expected), "Logged-06");
+
+	// A damaged tail (a group cut by a crash) is dropped
+	loggedInsert(logged, &key, &info);
+	insert(expected, &key, &info);
+	size_t committed = logged->logBytes + logged->used;
+	closeLoggedTree(logged);
+	FILE *wal = fopen("outputs/logged.wal", "ab");
+	fwrite("\x05\x00\x00\x00\x00", 1, 5, wal);
+	fclose(wal);
+	destroyTree(tree);
+	tree = create_long_tree(1);
+	logged = openLoggedTree(tree, "outputs/logged", sizeof(long), sizeof(long));
+	ASSERT(f, logged != NULL && same_pairs(tree, expected) &&
+			  logged->logBytes == committed, "Logged-07");
+
+	// Automatic checkpoints keep the log short
+	logged->checkpointBytes = 4096;
+	logged->groupRecords = 16;
+	for (key = 0; key < 2000; key++) {
+		loggedInsert(logged, &key, &key);
+		insert(expected, &key, &key);
+	}
+	ASSERT(f, logged->logBytes < 4096 + 16 * sizeof(LogRecord) * 4, "Logged-08");
+	destroyTree(tree);
+	tree = reopen_logged(&logged);
+	ASSERT(f, logged != NULL && same_pairs(tree, expected), "Logged-09");
+	closeLoggedTree(logged);
+	destroyTree(tree);
+	destroyTree(expected);
+
+	// Packed words of the Cipher dictionary
+	remove("outputs/logged.snap");
+	remove("outputs/logged.wal");
+	TTree *words = create_packed_dict();
+	logged = openLoggedTree(words, "outputs/logged", 0, sizeof(int));
+	char buffer[BUFLEN];
+	FILE *in = fopen("inputs/key.txt", "r");
+	int idx = 0;
+	while (in != NULL && fgets(buffer, BUFLEN, in)) {
+		char *token = strtok(buffer, " ,.?!\n");
+		while (token) {
+			loggedInsert(logged, token, &idx);
+			idx += strlen(token);
+			token = strtok(NULL, " ,.?!\n\r");
+		}
+	}
+	if (in != NULL)
+		fclose(in);
+	closeLoggedTree(logged);
+	TTree *restored = create_packed_dict();
+	logged = openLoggedTree(restored, "outputs/logged", 0, sizeof(int));
+	Range *a = levelKeyQuery(words), *b = levelKeyQuery(restored);
+	ASSERT(f, logged != NULL && restored->size == words->size &&
+			  same_range(inorderKeyQuery(words), inorderKeyQuery(restored)) &&
+			  same_range(a, b), "Logged-10");
+	closeLoggedTree(logged);
+	destroyTree(words);
+	destroyTree(restored);
+
+	// A change whose group cannot be committed is applied all the same
+	remove("outputs/logged.snap");
+	remove("outputs/logged.wal");
+	tree = create_long_tree(0);
+	logged = openLoggedTree(tree, "outputs/logged", sizeof(long), sizeof(long));
+	logged->groupRecords = 1;
+	close(logged->fd);
+	logged->fd = -1;
+	key = 5;
+	ASSERT(f, loggedInsert(logged, &key, &key) == 1 && search(tree, tree->root, &key) != NULL &&
+			  loggedDelete(logged, &key) == 1 && tree->root == NULL, "Logged-11");
+	closeLoggedTree(logged);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for Logged passed!\n");
+	fclose(f);
+}
+
+
+void test_lazy(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_lazy.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *lazy = create_long_tree(0), *eager = create_long_tree(0);
+	ASSERT(f, treeLazyDelete(lazy, 0) == -1 && treeLazyDelete(lazy, 1e9) == 0, "Lazy-01");
+	fill_lazy(lazy, eager);
+
+	// The deleted keys stay as tombstones, skipped by the queries
+	ASSERT(f, summaryOf(lazy->root)->dead == 100 && lazy->size == eager->size &&
+			  check_avl(lazy, lazy->root, NULL) > 0, "Lazy-02");
+	ASSERT(f, same_pairs(lazy, eager), "Lazy-03");
+	int ok = 1;
+	for (long key = -1; key <= 200; key++) {
+		long hi = key + 7;
+		ok &= (search(lazy, lazy->root, &key) == NULL) == (search(eager, eager->root, &key) == NULL);
+		ok &= rank(lazy, &key) == rank(eager, &key);
+		ok &= countRange(lazy, &key, &hi) == countRange(eager, &key, &hi);
+	}
+	ASSERT(f, ok, "Lazy-04");
+	long key = 4;
+	TreeCursor cursor = lowerBound(lazy, &key);
+	ASSERT(f, *(long*)cursorElem(&cursor) == 5 && cursorPrev(&cursor) &&
+			  *(long*)cursorElem(&cursor) == 3 && *(long*)cursorInfo(&cursor) == 31, "Lazy-05");
+	delete(lazy, &key);
+	ASSERT(f, summaryOf(lazy->root)->dead == 100 && lazy->size == eager->size, "Lazy-06");
+
+	// An insert revives the tombstone of its key
+	long info = 7;
+	insert(lazy, &key, &info);
+	insert(eager, &key, &info);
+	ASSERT(f, summaryOf(lazy->root)->dead == 99 && same_pairs(lazy, eager) &&
+			  *(long*)search(lazy, lazy->root, &key)->info == 7, "Lazy-07");
+
+	// Incremental compaction
+	ASSERT(f, compactTree(lazy, 10) == 10 && summaryOf(lazy->root)->dead == 89 &&
+			  check_avl(lazy, lazy->root, NULL) > 0 && same_pairs(lazy, eager), "Lazy-08");
+	ASSERT(f, compactTree(lazy, -1) == 89 && summaryOf(lazy->root)->dead == 0 &&
+			  check_avl(lazy, lazy->root, NULL) > 0 && check_list(lazy) &&
+			  same_pairs(lazy, eager), "Lazy-09");
+
+	// Above the ratio, the deletes remove tombstones themselves
+	treeLazyDelete(lazy, 0.1);
+	for (key = 1; key < 200; key += 2) {
+		delete(lazy, &key);
+		delete(eager, &key);
+		ok &= lazy->root == NULL || summaryOf(lazy->root)->dead <= 0.1 * lazy->size + 1;
+	}
+	ASSERT(f, ok && same_pairs(lazy, eager) && check_avl(lazy, lazy->root, NULL) > 0 &&
+			  isEmpty(lazy) == (eager->root == NULL), "Lazy-10");
+	destroyTree(lazy);
+	destroyTree(eager);
+
+	// Chunked duplicates
+	lazy = create_long_tree(1);
+	eager = create_long_tree(1);
+	treeLazyDelete(lazy, 1e9);
+	fill_lazy(lazy, eager);
+	ASSERT(f, summaryOf(lazy->root)->dead == 100 && same_pairs(lazy, eager), "Lazy-11");
+	TreeNode *top[3];
+	ASSERT(f, topFrequent(lazy, 3, top) == 3 && *(long*)top[0]->elem == 3 &&
+			  *(long*)top[1]->elem == 9 && *(long*)mostFrequent(lazy)->elem == 3, "Lazy-12");
+	destroyTree(lazy);
+	destroyTree(eager);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// The Cipher queries on words deleted lazily
+	lazy = create_packed_dict();
+	eager = create_packed_dict();
+	treeLazyDelete(lazy, 1e9);
+	buildTreeFromFile("inputs/key.txt", lazy);
+	buildTreeFromFile("inputs/key.txt", eager);
+	char *words[] = {"CD", "THE", "A", "GG", "IS", "AND", "OF"};
+	for (int i = 0; i < 7; i++)
+		for (int j = 0; j < 3; j++) {
+			delete(lazy, words[i]);
+			delete(eager, words[i]);
+		}
+	ASSERT(f, summaryOf(lazy->root)->dead > 0 &&
+			  same_range(inorderKeyQuery(eager), inorderKeyQuery(lazy)) &&
+			  same_range(rangeKeyQuery(eager, "CD", "GG"), rangeKeyQuery(lazy, "CD", "GG")),
+			  "Lazy-13");
+	destroyTree(lazy);
+	destroyTree(eager);
+
+	fprintf(f, "\nAll tests for Lazy passed!\n");
+	fclose(f);
+}
+
+
+/* Insert keys[i] / infos[i] into a tree with insertBatch and the same
+ * pairs one by one into a reference tree
+ */
+int batch_matches(TTree *tree, TTree *expected, long *keys, long *infos, long n) {
+	void **elems = malloc(n * sizeof(void*)), **values = malloc(n * sizeof(void*));
+	for (long i = 0; i < n; i++) {
+		elems[i] = keys + i;
+		values[i] = infos + i;
+		insert(expected, keys + i, infos + i);
+	}
+	int result = insertBatch(tree, elems, values, n);
+	free(elems);
+	free(values);
+	return result == 0 && same_pairs(tree, expected) &&
+		   check_avl(tree, tree->root, NULL) >= 0 && check_list(tree);
+}
+
+
+void test_insert_batch(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_insert_batch.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	long keys[2000], infos[2000];
+	for (long i = 0; i < 2000; i++) {
+		keys[i] = i * 7919 % 503;
+		infos[i] = i;
+	}
+	TTree *tree = create_long_tree(0), *expected = create_long_tree(0);
+	ASSERT(f, insertBatch(tree, NULL, NULL, 0) == 0 && tree->root == NULL, "InsertBatch-01");
+
+	// Into an empty tree, then merged with the entries already there
+	ASSERT(f, batch_matches(tree, expected, keys, infos, 600), "InsertBatch-02");
+	ASSERT(f, tree->root->height <= 10, "InsertBatch-03");
+	ASSERT(f, batch_matches(tree, expected, keys + 600, infos + 600, 900), "InsertBatch-04");
+
+	// A small batch is inserted key by key
+	ASSERT(f, batch_matches(tree, expected, keys + 1500, infos + 1500, 3), "InsertBatch-05");
+	destroyTree(tree);
+	destroyTree(expected);
+
+	// Chunked duplicates and tombstones
+	tree = create_long_tree(1);
+	expected = create_long_tree(1);
+	treeLazyDelete(tree, 1e9);
+	ASSERT(f, batch_matches(tree, expected, keys, infos, 1000), "InsertBatch-06");
+	for (long key = 0; key < 503; key += 2)
+		while (search(tree, tree->root, &key) != NULL) {
+			delete(tree, &key);
+			delete(expected, &key);
+		}
+	ASSERT(f, summaryOf(tree->root)->dead == 252 &&
+			  batch_matches(tree, expected, keys + 1000, infos + 1000, 1000) &&
+			  summaryOf(tree->root)->dead == 0, "InsertBatch-07");
+	destroyTree(tree);
+	destroyTree(expected);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// Packed words (radix sorted): the same entries as buildTreeFromFile
+	char buffer[BUFLEN], *words[BUFLEN];
+	int offsets[BUFLEN];
+	void *elems[BUFLEN], *values[BUFLEN];
+	long n = 0;
+	int idx = 0;
+	FILE *in = fopen("inputs/key.txt", "r");
+	while (in != NULL && fgets(buffer, BUFLEN, in)) {
+		char *token = strtok(buffer, " ,.?!\n");
+		while (token && n < BUFLEN) {
+			words[n] = strdup(token);
+			offsets[n] = idx;
+			elems[n] = words[n];
+			values[n] = offsets + n;
+			n++;
+			idx += strlen(token);
+			token = strtok(NULL, " ,.?!\n\r");
+		}
+	}
+	if (in != NULL)
+		fclose(in);
+	tree = create_packed_dict();
+	insertBatch(tree, elems, values, n / 3);
+	insertBatch(tree, elems + n / 3, values + n / 3, n - n / 3);
+	ASSERT(f, tree->size == (*dict)->size &&
+			  same_range(inorderKeyQuery(*dict), inorderKeyQuery(tree)) &&
+			  same_range(rangeKeyQuery(*dict, "CD", "GG"), rangeKeyQuery(tree, "CD", "GG")),
+			  "InsertBatch-08");
+	for (long i = 0; i < n; i++)
+		free(words[i]);
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for InsertBatch passed!\n");
+	fclose(f);
+}
+
+
+/* Search every key of a tree from another thread
+ *
+ * return: the counters of that thread
+ */
+void* countSearches(void* arg) {
+	TTree *tree = (TTree*) arg;
+	TreeCounters *counters = malloc(sizeof(TreeCounters));
+	resetTreeCounters();
+	for (long key = 0; key < tree->size; key++)
+		search(tree, tree->root, &key);
+	*counters = treeCounters;
+	return counters;
+}
+
+
+void test_stats(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_stats.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *tree = create_long_tree(0);
+	TreeStats stats = getTreeStats(tree);
+	ASSERT(f, stats.height == 0 && stats.keys == 0 && stats.entries == 0 &&
+			  stats.nodeBytes == 0 && getTreeStats(NULL).keys == 0, "Stats-01");
+
+	// Increasing keys only need single rotations
+	resetTreeCounters();
+	for (long key = 0; key < 1023; key++)
+		insert(tree, &key, &key);
+	stats = getTreeStats(tree);
+	ASSERT(f, stats.height == 10 && stats.maxHeight == 10 && stats.keys == 1023 &&
+			  stats.counters.singleRotations == 1013 && stats.counters.doubleRotations == 0,
+			  "Stats-02");
+	ASSERT(f, stats.counters.compares >= 1023 &&
+			  stats.counters.visits == stats.counters.compares, "Stats-03");
+	ASSERT(f, stats.nodeBytes >= 1023 * sizeof(TreeNode) &&
+			  stats.elemBytes >= 1023 * sizeof(long) &&
+			  stats.infoBytes >= 1023 * sizeof(long), "Stats-04");
+
+	// The counters of another thread are its own
+	pthread_t thread;
+	TreeCounters *counters;
+	pthread_create(&thread, NULL, countSearches, tree);
+	pthread_join(thread, (void**) &counters);
+	ASSERT(f, counters->visits > 1023 && counters->singleRotations == 0 &&
+			  treeCounters.visits == stats.counters.visits, "Stats-05");
+	free(counters);
+
+	// A zig-zag needs a double rotation
+	TTree *zigzag = create_long_tree(0);
+	long keys[] = {10, 5, 7};
+	resetTreeCounters();
+	for (int i = 0; i < 3; i++)
+		insert(zigzag, &keys[i], &keys[i]);
+	ASSERT(f, treeCounters.doubleRotations == 1 && treeCounters.singleRotations == 0 &&
+			  *(long*)zigzag->root->elem == 7, "Stats-06");
+	destroyTree(zigzag);
+
+	// Duplicate chains, and the height reached before the deletes
+	for (long i = 0; i < 9; i++) {
+		long key = 5;
+		insert(tree, &key, &i);
+	}
+	for (long key = 100; key < 1023; key++)
+		delete(tree, &key);
+	stats = getTreeStats(tree);
+	ASSERT(f, stats.keys == 100 && stats.entries == 109 && stats.longestChain == 10 &&
+			  stats.meanChain == 1.09 && stats.height < 10 && stats.maxHeight == 10,
+			  "Stats-07");
+	destroyTree(tree);
+
+	// Chunked duplicates and tombstones
+	tree = create_long_tree(1);
+	treeLazyDelete(tree, 1e9);
+	for (long i = 0; i < 40; i++) {
+		long key = i % 4;
+		insert(tree, &key, &i);
+	}
+	long key = 0;
+	for (int i = 0; i < 10; i++)
+		delete(tree, &key);
+	stats = getTreeStats(tree);
+	ASSERT(f, stats.keys == 3 && stats.tombstones == 1 && stats.longestChain == 10 &&
+			  stats.infoBytes >= 3 * INFO_CHUNK_BYTES, "Stats-08");
+	destroyTree(tree);
+
+	// An arena counts its blocks
+	tree = create_long_tree(0);
+	treeUseArena(tree, sizeof(long), sizeof(long));
+	for (long i = 0; i < 100; i++)
+		insert(tree, &i, &i);
+	stats = getTreeStats(tree);
+	ASSERT(f, stats.nodeBytes == arenaBytes(tree->arena) && stats.elemBytes == 0 &&
+			  stats.infoBytes == 0, "Stats-09");
+	destroyTree(tree);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// The buffers of the Cipher keys
+	resetTreeCounters();
+	Range *range = inorderKeyQuery(*dict);
+	ASSERT(f, range != NULL && treeCounters.rangeBytes == range->capacity * sizeof(int),
+		   "Stats-10");
+	free(range->index);
+	free(range);
+
+	// A buffer grown while it is filled counts at its final capacity
+	TTree *level = create_dict();
+	char *words[] = {"B", "A", "C", "A", "C"};
+	for (int i = 0; i < 5; i++)
+		insert(level, words[i], &i);
+	resetTreeCounters();
+	range = levelKeyQuery(level);
+	ASSERT(f, range != NULL && range->size == 4 && range->capacity == 4 &&
+			  treeCounters.rangeBytes == range->capacity * sizeof(int), "Stats-11");
+	free(range->index);
+	free(range);
+	destroyTree(level);
+
+	fprintf(f, "\nAll tests for Stats passed!\n");
+	fclose(f);
+}
+
+
+uint64_t hashLong(void* value) {
+	return *(long*)value;
+}
+
+
+/* Check that the hash index of a tree holds exactly its keys
+ */
+int check_index(TTree *tree) {
+	if (tree->slots == NULL)
+		return 0;
+	size_t keys = 0;
+	if (tree->root != NULL)
+		for (TreeNode *x = minimum(tree->root); x != NULL; x = x->next) {
+			if (x->parent == NULL && x != tree->root)
+				continue;
+			keys++;
+			if (search(tree, tree->root, x->elem) != (countOf(tree, x) > 0 ? x : NULL))
+				return 0;
+		}
+	return keys == tree->slotsUsed && 2 * (tree->slotsUsed + tree->slotsDeleted) <= tree->slotCount;
+}
+
+
+void test_hash_index(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_hash_index.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *tree = create_long_tree(0), *expected = create_long_tree(0);
+	ASSERT(f, treeUseHashIndex(tree, NULL) == -1 && treeUseHashIndex(tree, hashLong) == 0 &&
+			  treeUseHashIndex(tree, hashLong) == -1 && check_index(tree), "HashIndex-01");
+
+	// Inserts and deletes keep the index up to date
+	srand(7);
+	for (long i = 0; i < 5000; i++) {
+		long key = rand() % 300;
+		if (rand() % 3 == 0) {
+			delete(tree, &key);
+			delete(expected, &key);
+		} else {
+			insert(tree, &key, &i);
+			insert(expected, &key, &i);
+		}
+	}
+	ASSERT(f, same_pairs(tree, expected) && check_avl(tree, tree->root, NULL) >= 0 &&
+			  check_list(tree) && check_index(tree), "HashIndex-02");
+
+	// A search of the whole tree makes a single comparison
+	long key = *(long*)tree->root->elem, missing = 1000;
+	resetTreeCounters();
+	TreeNode *found = search(tree, tree->root, &key);
+	unsigned long comparisons = treeCounters.compares;
+	ASSERT(f, found == tree->root && search(expected, expected->root, &key) != NULL,
+		   "HashIndex-03");
+	ASSERT(f, comparisons == 1 && search(tree, tree->root, &missing) == NULL, "HashIndex-04");
+	void *keys[] = {&key, &missing};
+	TreeNode *out[2];
+	searchBatch(tree, keys, 2, out);
+	ASSERT(f, out[0] == found && out[1] == NULL, "HashIndex-05");
+	destroyTree(tree);
+	destroyTree(expected);
+
+	// Tombstones stay in the index until they are removed
+	tree = create_long_tree(0);
+	expected = create_long_tree(0);
+	treeUseHashIndex(tree, hashLong);
+	treeLazyDelete(tree, 1e9);
+	fill_lazy(tree, expected);
+	key = 4;
+	ASSERT(f, summaryOf(tree->root)->dead == 100 && search(tree, tree->root, &key) == NULL &&
+			  check_index(tree) && same_pairs(tree, expected), "HashIndex-06");
+	long info = 7;
+	insert(tree, &key, &info);
+	insert(expected, &key, &info);
+	ASSERT(f, compactTree(tree, -1) == 99 && check_index(tree) &&
+			  *(long*)search(tree, tree->root, &key)->info == 7 && same_pairs(tree, expected),
+			  "HashIndex-07");
+
+	// Batches, joins, splits and set operations index their keys again
+	long batch[600], infos[600];
+	for (long i = 0; i < 600; i++) {
+		batch[i] = i * 7919 % 401;
+		infos[i] = i;
+	}
+	ASSERT(f, batch_matches(tree, expected, batch, infos, 600) && check_index(tree), "HashIndex-08");
+	TTree *greater = create_long_tree(0), *expectedGreater = create_long_tree(0);
+	treeAugment(greater);	// like tree, which deletes lazily
+	treeUseHashIndex(greater, hashLong);
+	key = 150;
+	ASSERT(f, treeSplit(tree, &key, greater) == 0 && treeSplit(expected, &key, expectedGreater) == 0 &&
+			  check_index(tree) && check_index(greater) && same_pairs(greater, expectedGreater),
+			  "HashIndex-09");
+	ASSERT(f, treeJoin(tree, greater) == 0 && treeJoin(expected, expectedGreater) == 0 &&
+			  check_index(tree) && check_index(greater) && same_pairs(tree, expected), "HashIndex-10");
+	for (long i = 0; i < 600; i += 3) {
+		insert(greater, batch + i, infos + i);
+		insert(expectedGreater, batch + i, infos + i);
+	}
+	ASSERT(f, treeIntersect(tree, greater, NULL) == 0 &&
+			  treeIntersect(expected, expectedGreater, NULL) == 0 &&
+			  check_index(tree) && check_index(greater) && greater->slotsUsed == 0 &&
+			  same_pairs(tree, expected) && check_avl(tree, tree->root, NULL) >= 0, "HashIndex-11");
+	destroyTree(greater);
+	destroyTree(expectedGreater);
+	destroyTree(tree);
+	destroyTree(expected);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// The Cipher dictionary: packed keys are hashed, the keys do not change
+	tree = create_packed_dict();
+	buildTreeFromFile("inputs/key.txt", tree);
+	ASSERT(f, treeUseHashIndex(tree, NULL) == 0 && check_index(tree) &&
+			  same_range(inorderKeyQuery(*dict), inorderKeyQuery(tree)) &&
+			  same_range(levelKeyQuery(*dict), levelKeyQuery(tree)) &&
+			  same_range(rangeKeyQuery(*dict, "CD", "GG"), rangeKeyQuery(tree, "CD", "GG")),
+			  "HashIndex-12");
+	char *words[] = {"CD", "THE", "A", "GG", "IS", "AND", "OF", "ZZZ"};
+	int ok = 1;
+	for (int i = 0; i < 8; i++) {
+		TreeNode *a = search(*dict, (*dict)->root, words[i]), *b = search(tree, tree->root, words[i]);
+		ok &= (a == NULL) == (b == NULL) && (a == NULL || countOf(*dict, a) == countOf(tree, b));
+		delete(tree, words[i]);
+	}
+	ASSERT(f, ok && check_index(tree) && check_avl(tree, tree->root, NULL) >= 0, "HashIndex-13");
+	destroyTree(tree);
+
+	fprintf(f, "\nAll tests for HashIndex passed!\n");
+	fclose(f);
+}
+
+
+/* Infos released by the arena tests */
+long released_infos = 0;
+
+void destroyCountedLong(void* value) {
+	released_infos++;
+	free((long*)value);
+}
+
+
+/* Bytes handed out by malloc (0 - the allocator does not tell)
+ */
+size_t heap_bytes() {
+#ifdef __GLIBC__
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+#else
+	return 0;
+#endif
+}
+
+
+void test_arena(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_arena.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *tree = createTree(createLong, destroyLong,
+							 createLong, destroyLong, compareLong);
+	ASSERT(f, treeUseArena(NULL, 0, 0) == -1 && treeUseArena(tree, sizeof(long), sizeof(long)) == 0 &&
+			  treeUseArena(tree, sizeof(long), sizeof(long)) == -1, "Arena-01");
+
+	// Node, element and info share one slot
+	for (long key = 0; key < 1000; key++)
+		insert(tree, &key, &key);
+	int ok = tree->arena->used == 1000 && check_list(tree);
+	for (TreeNode *x = minimum(tree->root); ok && x != NULL; x = x->next)
+		ok = (char*) x->elem == (char*) x + tree->nodeSize &&
+			 (char*) x->info == (char*) x->elem + sizeof(long) &&
+			 *((long*)x->elem) == *((long*)x->info);
+	ASSERT(f, ok && check_avl(tree, tree->root, NULL) > 0, "Arena-02");
+
+	// A deleted slot is the next one handed out, no slab is added
+	size_t bytes = arenaBytes(tree->arena);
+	long key = 500;
+	TreeNode *slot = search(tree, tree->root, &key);
+	delete(tree, &key);
+	ASSERT(f, tree->arena->used == 999 && search(tree, tree->root, &key) == NULL, "Arena-03");
+	key = 5000;
+	insert(tree, &key, &key);
+	ASSERT(f, search(tree, tree->root, &key) == slot && *((long*)slot->info) == 5000 &&
+			  arenaBytes(tree->arena) == bytes, "Arena-04");
+	for (key = 0; key < 5001; key++)
+		delete(tree, &key);
+	ASSERT(f, tree->root == NULL && tree->arena->used == 0, "Arena-05");
+	for (key = 0; key < 1000; key++)
+		insert(tree, &key, &key);
+	ASSERT(f, arenaBytes(tree->arena) == bytes && check_list(tree), "Arena-06");
+	ASSERT(f, treeUseArena(tree, 0, 0) == -1, "Arena-07");
+	destroyTree(tree);
+
+	// destroyTree releases the infos kept outside and gives the slabs back
+	// (the heap shrinks by their bytes, if the allocator tells its size)
+	size_t before = heap_bytes();
+	released_infos = 0;
+	tree = createTree(createLong, destroyLong, createLong, destroyCountedLong, compareLong);
+	treeUseArena(tree, sizeof(long), 0);
+	for (long i = 0; i < 100000; i++) {
+		key = i % 50000;
+		insert(tree, &key, &i);
+	}
+	for (key = 0; key < 100; key++)
+		delete(tree, &key);
+	bytes = arenaBytes(tree->arena);
+	size_t grown = heap_bytes() - before;
+	destroyTree(tree);
+	ASSERT(f, released_infos == 100000, "Arena-08");
+	ASSERT(f, grown < bytes || heap_bytes() + bytes <= before + grown, "Arena-09");
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// The offsets of the Cipher dictionary kept in the slots
+	TTree *words = create_dict();
+	treeUseArena(words, 0, sizeof(int));
+	buildTreeFromFile("inputs/key.txt", words);
+	ASSERT(f, words->size == (*dict)->size && words->arena->used == words->size &&
+			  same_range(inorderKeyQuery(*dict), inorderKeyQuery(words)) &&
+			  same_range(levelKeyQuery(*dict), levelKeyQuery(words)) &&
+			  same_range(rangeKeyQuery(*dict, "CD", "GG"), rangeKeyQuery(words, "CD", "GG")),
+			  "Arena-10");
+	destroyTree(words);
+
+	fprintf(f, "\nAll tests for Arena passed!\n");
+	fclose(f);
+}
+
+
+void test_packed(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_packed.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	TTree *tree = createTree(NULL, NULL, createLong, destroyLong, NULL);
+	ASSERT(f, tree->nodeSize == sizeof(TreeNode) && treeUsePackedKeys(tree, 0) == -1 &&
+			  treeUsePackedKeys(tree, 8) == -1 && treeUsePackedKeys(tree, 5) == 0, "Packed-01");
+
+	// The key lives right after the node, cut to 5 characters
+	char *words[] = {"TREES", "TREE", "A", "TREESHADE", "ZEBRA", "AB", "TREE", "B"};
+	for (long i = 0; i < 8; i++)
+		insert(tree, words[i], &i);
+	TreeNode *x = search(tree, tree->root, "TREESTUMP");
+	ASSERT(f, tree->nodeSize == sizeof(TreeNode) + sizeof(uint64_t) && x != NULL &&
+			  (char*) x->elem == (char*) x + sizeof(TreeNode) &&
+			  strcmp((char*) x->elem, "TREES") == 0 && *((long*)x->info) == 0, "Packed-02");
+	ASSERT(f, countOf(tree, x) == 2 && *((long*)x->end->info) == 3, "Packed-03");
+
+	// Integer order is strncmp order
+	char *sorted[] = {"A", "AB", "B", "TREE", "TREE", "TREES", "TREES", "ZEBRA"};
+	int ok = check_avl(tree, tree->root, NULL) > 0;
+	long i = 0;
+	for (x = minimum(tree->root); ok && x != NULL; x = x->next, i++)
+		ok = strcmp((char*) x->elem, sorted[i]) == 0;
+	ASSERT(f, ok && i == 8, "Packed-04");
+	ASSERT(f, rank(tree, "TREE") == 3 && countRange(tree, "AB", "TREES") == 3, "Packed-05");
+	delete(tree, "TREESHADE");
+	delete(tree, "TREES");
+	delete(tree, "ZEBRAS");
+	ASSERT(f, search(tree, tree->root, "TREES") == NULL && tree->size == 5, "Packed-06");
+	ASSERT(f, treeUsePackedKeys(tree, 5) == -1, "Packed-07");
+	destroyTree(tree);
+
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+
+	// The Cipher dictionary with packed words
+	TTree *packed = create_dict();
+	treeUsePackedKeys(packed, ELEMENT_TREE_LENGTH);
+	buildTreeFromFile("inputs/key.txt", packed);
+	ASSERT(f, packed->size == (*dict)->size &&
+			  same_range(inorderKeyQuery(*dict), inorderKeyQuery(packed)) &&
+			  same_range(levelKeyQuery(*dict), levelKeyQuery(packed)) &&
+			  same_range(rangeKeyQuery(*dict, "CD", "GG"), rangeKeyQuery(packed, "CD", "GG")),
+			  "Packed-08");
+	destroyTree(packed);
+
+	fprintf(f, "\nAll tests for Packed passed!\n");
+	fclose(f);
+}
+
+
+void test_typed(TTree **dict) {
+
+	FILE *f = fopen("outputs/output_typed.out", "w");
+
+	if (f == NULL) {
+		printf("Error opening file!\n");
+		return;
+	}
+
+	struct avl_long *tree = avl_long_create();
+	ASSERT(f, tree != NULL && avl_long_isEmpty(tree), "Typed-01");
+
+	for (long i = 0; i < 9; i++)
+		avl_long_insert(tree, i, i);
+	ASSERT(f, tree->root->elem == 3 && tree->size == 9, "Typed-02");
+	ASSERT(f, tree->root->prev == avl_long_predecessor(tree->root), "Typed-03");
+	ASSERT(f, tree->root->next == avl_long_successor(tree->root), "Typed-04");
+
+	avl_long_insert(tree, 3, 4);
+	avl_long_insert(tree, 3, 5);
+	ASSERT(f, tree->root->end == tree->root->next->next, "Typed-05");
+	ASSERT(f, tree->root->end->info == 5, "Typed-06");
+	ASSERT(f, tree->root->end->next == avl_long_successor(tree->root), "Typed-07");
+
+	avl_long_delete(tree, 3);
+	ASSERT(f, tree->root->end->info == 4 && tree->size == 10, "Typed-08");
+	avl_long_delete(tree, 3);
+	avl_long_delete(tree, 3);
+	ASSERT(f, avl_long_search(tree, 3) == NULL, "Typed-09");
+	ASSERT(f, tree->root->elem == 4 && tree->root->prev->elem == 2, "Typed-10");
+	ASSERT(f, tree->root->next->elem == 5, "Typed-11");
+
+	for (long i = 0; i < 9; i++)
+		avl_long_delete(tree, i);
+	ASSERT(f, avl_long_isEmpty(tree) && tree->size == 0, "Typed-12");
+	avl_long_destroy(tree);
+
+	// Same words and order as the generic dictionary
+	if (*dict == NULL || (*dict)->root == NULL) {
+		fprintf(f, "Empty tree passed!\n");
+		fclose(f);
+		return;
+	}
+	struct avl_str5 *words = avl_str5_create();
+	char buffer[BUFLEN];
+	FILE *in = fopen("inputs/key.txt", "r");
+	int idx = 0;
+	while (in != NULL && fgets(buffer, BUFLEN, in)) {
+		char *token = strtok(buffer, " ,.?!\n");
+		while (token) {
+			avl_str5_insert(words, packKey(token, ELEMENT_TREE_LENGTH), idx);
+			idx += strlen(token);
+			token = strtok(NULL, " ,.?!\n\r");
+		}
+	}
+	if (in != NULL)
+		fclose(in);
+	ASSERT(f, words->size == (*dict)->size, "Typed-13");
+
+	int same = 1;
+	char word[sizeof(uint64_t)];
+	struct avl_str5_node *x = avl_str5_minimum(words->root);
+	TreeCursor y = cursorAt(*dict, minimum((*dict)->root));
+	for (; cursorValid(&y); cursorNext(&y), x = x->next)
+		if (x == NULL || x->info != *(int*)cursorInfo(&y)
+			|| strcmp(avl_str5_word(x->elem, word), (char*)cursorElem(&y)) != 0)
+			same = 0;
+	ASSERT(f, same && x == NULL, "Typed-14");
+	avl_str5_destroy(words);
+
+	fprintf(f, "\nAll tests for Typed passed!\n");
+	fclose(f);
+}
+
+
+int main() {
+
+	TTree *tree1 = NULL;
+	TTree *tree2 = NULL;
+
+	test_init(&tree1);
+	create_simple_tree(&tree1);
+	test_search(&tree1);
+	test_minmax(&tree1);
+	test_succ_pred(&tree1);
+	test_rotations(&tree1);
+	test_insert(&tree2);
+	test_delete(&tree2);
+	test_list_insert(&tree2);
+	test_list_delete(&tree2);
+	test_free(&tree1, &tree2);
+
+	TTree *dict = NULL;
+	dict = create_dict();
 
 	test_build_tree(&dict);
 	test_inorder_key(&dict);
 	test_level_key(&dict);
 	test_range_key(&dict);
+	test_typed(&dict);
+	test_comparisons();
+	test_search_batch(&dict);
+	test_bulk_load();
+	test_set_ops();
+	test_order_stats(&dict);
+	test_cursor(&dict);
+	test_frequency(&dict);
+	test_compact(&dict);
+	test_pool();
+	test_snapshot(&dict);
+	test_concurrent();
+	test_sharded(&dict);
+	test_frozen(&dict);
+	test_bplus(&dict);
+	test_mapped(&dict);
+	test_logged();
+	test_lazy(&dict);
+	test_insert_batch(&dict);
+	test_stats(&dict);
+	test_hash_index(&dict);
+	test_arena(&dict);
+	test_packed(&dict);
 
 	destroyTree(dict);
 